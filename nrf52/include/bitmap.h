@@ -3,7 +3,13 @@
 
 #include <stdint.h>
 
-enum image_encoding { image_encoding_1bit, image_encoding_565bits };
+// image_encoding_565rle is only used for images in the external flash, see
+// RGB565_to_RLE in utils/gen_image.py for the format.
+enum image_encoding {
+    image_encoding_1bit,
+    image_encoding_565bits,
+    image_encoding_565rle
+};
 
 struct external_flash_data;
 
@@ -7,7 +7,7 @@
 /// SPI0 for flash
 
 #define SPI0_ENABLED 1
-#define SPI0_USE_EASY_DMA 0
+#define SPI0_USE_EASY_DMA 1
 
 /// SPI1 unused
 #define SPI1_ENABLED 0
@@ -15,24 +15,18 @@
 /// SPI2 for display/ssd1306
 
 #define SPI2_ENABLED 1
-#define SPI2_USE_EASY_DMA 0
+#define SPI2_USE_EASY_DMA 1
 
 // UART to STM32
-#define UART_ENABLED 1
-#define UART_EASY_DMA_SUPPORT 0
-#define UART_LEGACY_SUPPORT 1
-
-#define UART_DEFAULT_CONFIG_HWFC NRF_UART_HWFC_DISABLED
-#define UART_DEFAULT_CONFIG_PARITY NRF_UART_PARITY_EXCLUDED
-#define UART_DEFAULT_CONFIG_BAUDRATE NRF_UART_BAUDRATE_115200
-#define UART_DEFAULT_CONFIG_IRQ_PRIORITY APP_IRQ_PRIORITY_LOW
-
-#define UART0_ENABLED 1
-#define UART0_CONFIG_USE_EASY_DMA 0
+// Driven directly through the UARTE (src/drivers/uart.c), which also carries
+// the CLI.  Set UART_CONFIG_HWFC to 1 to use the CTS/RTS lines.
+#define UART_ENABLED 0
+#define UART0_ENABLED 0
+#define UART_CONFIG_HWFC 0
 
 // CLI
 #define NRF_CLI_ENABLED 1
-#define NRF_CLI_UART_ENABLED 1
+#define NRF_CLI_UART_ENABLED 0
 #define NRF_CLI_BUILD_IN_CMDS_ENABLED 1
 #define NRF_CLI_ARGC_MAX 6
 #define NRF_CLI_ECHO_STATUS 1
@@ -53,6 +47,7 @@
 
 // PWM
 #define PWM_ENABLED 1
+#define PWM0_ENABLED 1 // Neopixels
 #define PWM2_ENABLED 1
 
 // Enable the power driver
@@ -111,14 +106,15 @@
 #define NRF_SDH_BLE_VS_UUID_COUNT 2
 #define NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE 1408
 #define NRF_SDH_BLE_SERVICE_CHANGED 0
-#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE 23
+#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE 247 //Largest ATT MTU, exchanged on connection by nrf_ble_gatt.
 #define NRF_SECTION_ITER_ENABLED 1
 #define BLE_LBS_BLE_OBSERVER_PRIO 2
 #define NRF_SDH_BLE_OBSERVER_PRIO_LEVELS 4
 #define NRF_SDH_BLE_PERIPHERAL_LINK_COUNT 1
 #define NRF_SDH_BLE_CENTRAL_LINK_COUNT 1
 #define NRF_SDH_BLE_TOTAL_LINK_COUNT 1 //Maximum number of total concurrent connections using the default configuration.
-#define NRF_SDH_BLE_GAP_EVENT_LENGTH 3 //The time set aside for this connection on every connection interval in 1.25 ms units.
+#define NRF_SDH_BLE_GAP_EVENT_LENGTH 6 //The time set aside for this connection on every connection interval in 1.25 ms units.
+#define NRF_SDH_BLE_GAP_DATA_LENGTH 251 //Link layer payload requested with the data length extension <27-251>.
 
 // Defines related to logging
 #define NRF_LOG_ENABLED 0
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <nordic_common.h>
 #include "3d.h"
 #include "drivers/display.h"
 #include "gfx_effect.h"
@@ -15,70 +16,55 @@
 #include "meshes/sphere.c"
 #include "meshes/torus.c"
 
-int nsec_multiply_matrix(nsec_matrix_t * result, nsec_matrix_t * m1, nsec_matrix_t * m2) {
-    if(m1 == result || m2 == result) {
-        return -1;
-    }
-    if(m1->cols < 1 || m1->rows < 1 || m2->cols < 1 || m2->rows < 1) {
-        return -2;
-    }
-    if(m1->cols != m2->rows) {
-        return -3;
-    }
-    if(result->rows * result->cols < m1->rows * m2->cols) {
-        return -4;
-    }
-    result->rows = m1->rows;
-    result->cols = m2->cols;
-    for(int i = 0; i < result->rows; i++) {
-        for(int j = 0; j < result->cols; j++) {
-          float sum = 0.0f;
-          for(int x = 0; x < m1->rows; x++) {
-            sum += NSEC_MATRIX_VALUE(m1, i, x) * NSEC_MATRIX_VALUE(m2, x, j);
-          }
-          NSEC_MATRIX_VALUE(result, i, j) = sum;
-        }
-    }
-    return 0;
+nsec_mesh_t * const nsec_meshes[] = {
+    &nsec_cube_m,
+    &nsec_tetra_m,
+    &nsec_icosphere_m,
+    &nsec_torus_m,
+};
+const int nsec_mesh_count = sizeof(nsec_meshes) / sizeof(nsec_meshes[0]);
+
+/* Light coming from the viewer, faces seen edge-on keep a quarter of it. */
+#define NSEC_AMBIENT_LIGHT (64)
+
+/*
+ * Rz * Ry * Rx, so that only 3 sinf/cosf pairs are computed per frame and
+ * every vertex costs a single 3x3 multiply.
+ */
+void nsec_rotation_from_angles(nsec_rotation_t * rotation, const float angles[3]) {
+    const float sx = sinf(angles[0]), cx = cosf(angles[0]);
+    const float sy = sinf(angles[1]), cy = cosf(angles[1]);
+    const float sz = sinf(angles[2]), cz = cosf(angles[2]);
+
+    rotation->m[0][0] = cz * cy;
+    rotation->m[0][1] = cz * sy * sx - sz * cx;
+    rotation->m[0][2] = cz * sy * cx + sz * sx;
+    rotation->m[1][0] = sz * cy;
+    rotation->m[1][1] = sz * sy * sx + cz * cx;
+    rotation->m[1][2] = sz * sy * cx - cz * sx;
+    rotation->m[2][0] = -sy;
+    rotation->m[2][1] = cy * sx;
+    rotation->m[2][2] = cy * cx;
 }
 
-void nsec_vertex_rotate(nsec_vertex_t * result, nsec_vertex_t * src, float angles[3]) {
-    NSEC_DECLARE_MATRIX(point, 3, 1);
-    memcpy(point->values, src->position, sizeof(src->position));
-    NSEC_DECLARE_MATRIX(result_matrix, 3, 1);
-    NSEC_DECLARE_MATRIX(rotation, 3, 3);
-    memcpy(rotation->values, (float[9]) {
-        1, 0,               0,
-        0, cosf(angles[0]), -sinf(angles[0]),
-        0, sinf(angles[0]),  cosf(angles[0])
-    }, sizeof(float[9]));
-    nsec_multiply_matrix(result_matrix, rotation, point);
-    memcpy(point, result_matrix, point_size);
-
-    memcpy(rotation->values, (float[9]) {
-         cosf(angles[1]), 0, sinf(angles[1]),
-         0,               1, 0,
-        -sinf(angles[1]), 0, cosf(angles[1])
-    }, sizeof(float[9]));
-    nsec_multiply_matrix(result_matrix, rotation, point);
-    memcpy(point, result_matrix, point_size);
-
-    memcpy(rotation->values, (float[9]) {
-        cosf(angles[2]), -sinf(angles[2]), 0,
-        sinf(angles[2]),  cosf(angles[2]), 0,
-        0              ,  0              , 1
-    }, sizeof(float[9]));
-    nsec_multiply_matrix(result_matrix, rotation, point);
-    memcpy(result, result_matrix->values, sizeof(*result));
+static void nsec_vertex_rotate(nsec_vertex_t * result, const nsec_vertex_t * src,
+                               const nsec_rotation_t * rotation) {
+    for(int i = 0; i < 3; i++) {
+        result->position[i] = rotation->m[i][0] * src->position[0] +
+                              rotation->m[i][1] * src->position[1] +
+                              rotation->m[i][2] * src->position[2];
+    }
 }
 
 void nsec_draw_rotated_mesh(nsec_mesh_t * mesh, int center[2], int size, float angles[3]) {
     nsec_vertex_t rotated_vertices[NSEC_MAX_VERTEX_ON_MESH];
+    nsec_rotation_t rotation;
     if(mesh->vertex_count > NSEC_MAX_VERTEX_ON_MESH) {
         return;
     }
+    nsec_rotation_from_angles(&rotation, angles);
     for(int i = 0; i < mesh->vertex_count; i++) {
-        nsec_vertex_rotate(&rotated_vertices[i], &mesh->vertices[i], angles);
+        nsec_vertex_rotate(&rotated_vertices[i], &mesh->vertices[i], &rotation);
     }
     for(int i = 0; i < mesh->edge_count; i++) {
       nsec_vertex_t * v1 = &rotated_vertices[mesh->edges[i].vertex_index[0]];
@@ -88,3 +74,90 @@ void nsec_draw_rotated_mesh(nsec_mesh_t * mesh, int center[2], int size, float a
                    DISPLAY_WHITE);
     }
 }
+
+static uint16_t nsec_shade_color(uint16_t color, uint16_t light) {
+    uint16_t r = ((color >> 11) * light) >> 8;
+    uint16_t g = (((color >> 5) & 0x3f) * light) >> 8;
+    uint16_t b = ((color & 0x1f) * light) >> 8;
+
+    return (r << 11) | (g << 5) | b;
+}
+
+void nsec_draw_filled_mesh(nsec_mesh_t * mesh, int center[2], int size,
+                           const nsec_rotation_t * rotation,
+                           uint16_t base_color, int16_t bbox[4]) {
+    nsec_vertex_t rotated;
+    int16_t screen[NSEC_MAX_VERTEX_ON_MESH][2];
+    float depth[NSEC_MAX_VERTEX_ON_MESH];
+    struct {
+        float depth;
+        uint16_t color;
+        uint8_t face;
+    } visible[NSEC_MAX_FACE_ON_MESH];
+    int visible_count = 0;
+
+    if(mesh->vertex_count > NSEC_MAX_VERTEX_ON_MESH ||
+       mesh->face_count > NSEC_MAX_FACE_ON_MESH) {
+        return;
+    }
+
+    bbox[0] = bbox[1] = INT16_MAX;
+    bbox[2] = bbox[3] = INT16_MIN;
+
+    for(int i = 0; i < mesh->vertex_count; i++) {
+        nsec_vertex_rotate(&rotated, &mesh->vertices[i], rotation);
+        screen[i][0] = lroundf(rotated.position[0] * size) + center[0];
+        screen[i][1] = lroundf(rotated.position[1] * size) + center[1];
+        depth[i] = rotated.position[2];
+
+        bbox[0] = MIN(bbox[0], screen[i][0]);
+        bbox[1] = MIN(bbox[1], screen[i][1]);
+        bbox[2] = MAX(bbox[2], screen[i][0]);
+        bbox[3] = MAX(bbox[3], screen[i][1]);
+    }
+
+    for(int i = 0; i < mesh->face_count; i++) {
+        const unsigned int * v = mesh->faces[i].vertex_index;
+        nsec_vertex_t a, b, c;
+
+        /* Only the normal of the rotated face is needed, rotate its edges. */
+        for(int k = 0; k < 3; k++) {
+            a.position[k] = mesh->vertices[v[1]].position[k] - mesh->vertices[v[0]].position[k];
+            b.position[k] = mesh->vertices[v[2]].position[k] - mesh->vertices[v[0]].position[k];
+        }
+        nsec_vertex_rotate(&c, &a, rotation);
+        nsec_vertex_rotate(&a, &b, rotation);
+
+        const float nx = c.position[1] * a.position[2] - c.position[2] * a.position[1];
+        const float ny = c.position[2] * a.position[0] - c.position[0] * a.position[2];
+        const float nz = c.position[0] * a.position[1] - c.position[1] * a.position[0];
+
+        /* Back-face culling, the viewer is looking down the z axis. */
+        if(nz <= 0) {
+            continue;
+        }
+
+        const float lambert = nz / sqrtf(nx * nx + ny * ny + nz * nz);
+        const uint16_t light = NSEC_AMBIENT_LIGHT +
+                               (uint16_t)(lambert * (256 - NSEC_AMBIENT_LIGHT));
+        const float face_depth = depth[v[0]] + depth[v[1]] + depth[v[2]];
+
+        /* Painter's algorithm, keep the faces sorted from far to near. */
+        int j = visible_count++;
+        while(j > 0 && visible[j - 1].depth > face_depth) {
+            visible[j] = visible[j - 1];
+            j--;
+        }
+        visible[j].depth = face_depth;
+        visible[j].color = nsec_shade_color(base_color, light);
+        visible[j].face = i;
+    }
+
+    for(int i = 0; i < visible_count; i++) {
+        const unsigned int * v = mesh->faces[visible[i].face].vertex_index;
+        gfx_fill_triangle(screen[v[0]][0], screen[v[0]][1],
+                          screen[v[1]][0], screen[v[1]][1],
+                          screen[v[2]][0], screen[v[2]][1],
+                          visible[i].color);
+    }
+}
@@ -3,11 +3,10 @@
 //
 //  License: MIT (see LICENSE for details)
 
-typedef struct {
-    int rows;
-    int cols;
-    float values[];
-} nsec_matrix_t;
+#ifndef _3D_H
+#define _3D_H
+
+#include <stdint.h>
 
 typedef struct {
     float position[3];
@@ -17,44 +16,68 @@ typedef struct {
     unsigned int vertex_index[2];
 } nsec_edge_t;
 
+/* Vertices are counter-clockwise when the face is seen from the outside. */
+typedef struct {
+    unsigned int vertex_index[3];
+} nsec_face_t;
+
 typedef struct nsec_mesh_s {
+    const char * name;
     int vertex_count;
     int edge_count;
+    int face_count;
     nsec_vertex_t * vertices;
     nsec_edge_t * edges;
+    nsec_face_t * faces;
 } nsec_mesh_t;
 
+/* Rotation composed once per frame, see nsec_rotation_from_angles. */
+typedef struct {
+    float m[3][3];
+} nsec_rotation_t;
+
 #define NSEC_UNWRAP(...) __VA_ARGS__
 
-#define NSEC_DECLARE_MESH(name, vertices, edges) \
+#define NSEC_DECLARE_MESH(name, label, vertices, edges, faces) \
     _Pragma("GCC diagnostic push"); \
     _Pragma("GCC diagnostic ignored \"-Wmissing-braces\""); \
     static nsec_vertex_t name##_vertices[] = { NSEC_UNWRAP vertices }; \
     static nsec_edge_t name##_edges[] = { NSEC_UNWRAP edges }; \
+    static nsec_face_t name##_faces[] = { NSEC_UNWRAP faces }; \
     _Pragma("GCC diagnostic pop"); \
     nsec_mesh_t name##_m = { \
+        (label), \
         sizeof(name##_vertices) / sizeof(nsec_vertex_t), \
         sizeof(name##_edges) / sizeof(nsec_edge_t), \
+        sizeof(name##_faces) / sizeof(nsec_face_t), \
         (name##_vertices), \
-        (name##_edges) \
+        (name##_edges), \
+        (name##_faces) \
     }; \
     nsec_mesh_t * name = &name##_m;
 
-#define NSEC_DECLARE_MATRIX(name, rows, cols) \
-    struct { \
-        nsec_matrix_t m; \
-        float values[(rows)*(cols)]; \
-    } name##_m = { { (rows), (cols) } }; \
-    nsec_matrix_t * name = (nsec_matrix_t *) &name##_m; \
-    const size_t name##_size __attribute__((unused)) = sizeof(name##_m);
-
 #define NSEC_MAX_VERTEX_ON_MESH (32)
-
-#define NSEC_MATRIX_VALUE(m, row, col) (m)->values[(row) * (m)->cols + (col)]
+#define NSEC_MAX_FACE_ON_MESH (32)
 
 extern nsec_mesh_t * nsec_cube;
 extern nsec_mesh_t * nsec_tetra;
 extern nsec_mesh_t * nsec_icosphere;
 extern nsec_mesh_t * nsec_torus;
 
+extern nsec_mesh_t * const nsec_meshes[];
+extern const int nsec_mesh_count;
+
+void nsec_rotation_from_angles(nsec_rotation_t * rotation, const float angles[3]);
+
 void nsec_draw_rotated_mesh(nsec_mesh_t * mesh, int center[2], int size, float angles[3]);
+
+/*
+ * Draw the faces turned towards the viewer, flat shaded from base_color.
+ * The area covered by the mesh is returned in bbox (x0, y0, x1, y1) so that
+ * the caller can erase it before the next frame.
+ */
+void nsec_draw_filled_mesh(nsec_mesh_t * mesh, int center[2], int size,
+                           const nsec_rotation_t * rotation,
+                           uint16_t base_color, int16_t bbox[4]);
+
+#endif
@@ -0,0 +1,164 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#include <math.h>
+#include <string.h>
+
+#include <app_timer.h>
+#include <nordic_common.h>
+
+#include "drivers/controls.h"
+#include "drivers/display.h"
+
+#include "3d.h"
+#include "app_3d.h"
+#include "application.h"
+#include "gfx_effect.h"
+#include "gui.h"
+#include "home_menu.h"
+#include "menu.h"
+#include "nsec_games_menu.h"
+
+// 30 fps, the torus and the sphere need less than 20 ms of SPI per frame.
+#define APP_3D_FRAME_MS 33
+#define APP_3D_CENTER_X 80
+#define APP_3D_CENTER_Y 44
+// Radius of the circle the mesh has to fit in once rotated.
+#define APP_3D_RADIUS 34
+#define APP_3D_MAX_MESHES 8
+
+APP_TIMER_DEF(m_3d_timer);
+
+static volatile bool frame_due;
+static int selected_mesh;
+static menu_item_s mesh_menu_items[APP_3D_MAX_MESHES];
+
+static void app_3d_menu_button_handler(button_t button);
+
+static void app_3d_start(uint8_t item)
+{
+    menu_close();
+    nsec_controls_suspend_handler(app_3d_menu_button_handler);
+
+    selected_mesh = item;
+    application_set(app_3d);
+}
+
+static void draw_3d_title(void)
+{
+    struct title title;
+    title.pos_y = 5;
+    title.pos_x = 50;
+    title.text_color = DISPLAY_BLUE;
+    title.bg_color = DISPLAY_WHITE;
+    strcpy(title.text, "3D");
+    draw_title(&title);
+}
+
+void app_3d_menu_show(void)
+{
+    int count = MIN(nsec_mesh_count, APP_3D_MAX_MESHES);
+
+    for (int i = 0; i < count; i++) {
+        mesh_menu_items[i].label = nsec_meshes[i]->name;
+        mesh_menu_items[i].handler = app_3d_start;
+    }
+
+    draw_3d_title();
+
+    gfx_fill_rect(GEN_MENU_POS, GEN_MENU_WIDTH, GEN_MENU_HEIGHT, DISPLAY_WHITE);
+
+    menu_init(CONF_POS, GEN_MENU_WIDTH, GEN_MENU_HEIGHT, count,
+              mesh_menu_items, HOME_MENU_BG_COLOR, DISPLAY_WHITE);
+
+    nsec_controls_add_handler(app_3d_menu_button_handler);
+}
+
+static void app_3d_menu_button_handler(button_t button)
+{
+    switch (button) {
+    case BUTTON_BACK:
+        menu_close();
+        nsec_controls_suspend_handler(app_3d_menu_button_handler);
+        nsec_games_menu_show();
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void app_3d_button_handler(button_t button)
+{
+    if (button == BUTTON_BACK) {
+        application_clear();
+    }
+}
+
+static void app_3d_timer_handler(void *p_context)
+{
+    frame_due = true;
+}
+
+/*
+ * Scale so that the mesh stays inside APP_3D_RADIUS whatever the rotation.
+ */
+static int app_3d_mesh_size(const nsec_mesh_t *mesh)
+{
+    float radius = 0;
+
+    for (int i = 0; i < mesh->vertex_count; i++) {
+        const float *p = mesh->vertices[i].position;
+        radius = MAX(radius, sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]));
+    }
+
+    return radius > 0 ? APP_3D_RADIUS / radius : APP_3D_RADIUS;
+}
+
+void app_3d(void (*service_device)())
+{
+    nsec_mesh_t *mesh = nsec_meshes[selected_mesh];
+    int center[2] = {APP_3D_CENTER_X, APP_3D_CENTER_Y};
+    int size = app_3d_mesh_size(mesh);
+    float angles[3] = {0, 0, 0};
+    int16_t bbox[4] = {0, 0, -1, -1};
+    nsec_rotation_t rotation;
+
+    gfx_fill_screen(DISPLAY_BLACK);
+    gfx_set_cursor(0, 0);
+    gfx_set_text_size(1);
+    gfx_set_text_background_color(DISPLAY_WHITE, DISPLAY_BLACK);
+    gfx_puts(mesh->name);
+
+    nsec_controls_add_handler(app_3d_button_handler);
+
+    APP_ERROR_CHECK(app_timer_create(&m_3d_timer, APP_TIMER_MODE_REPEATED,
+                                     app_3d_timer_handler));
+    APP_ERROR_CHECK(
+        app_timer_start(m_3d_timer, APP_TIMER_TICKS(APP_3D_FRAME_MS), NULL));
+
+    while (application_get() == app_3d) {
+        if (frame_due) {
+            frame_due = false;
+
+            // The rotation is composed once, vertices only get a 3x3 multiply.
+            nsec_rotation_from_angles(&rotation, angles);
+            angles[0] += 0.05f;
+            angles[1] += 0.03f;
+            angles[2] += 0.02f;
+
+            gfx_fill_rect(bbox[0], bbox[1], bbox[2] - bbox[0] + 1,
+                          bbox[3] - bbox[1] + 1, DISPLAY_BLACK);
+            nsec_draw_filled_mesh(mesh, center, size, &rotation, DISPLAY_CYAN,
+                                  bbox);
+            gfx_update();
+        }
+
+        service_device();
+    }
+
+    APP_ERROR_CHECK(app_timer_stop(m_3d_timer));
+    nsec_controls_suspend_handler(app_3d_button_handler);
+}
@@ -0,0 +1,12 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef app_3d_h
+#define app_3d_h
+
+void app_3d_menu_show(void);
+void app_3d(void (*service_device)());
+
+#endif
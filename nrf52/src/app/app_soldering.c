@@ -27,6 +27,8 @@ APP_TIMER_DEF(m_soldering_track);
 char flash_flag[24];
 uint8_t next_action;
 uint8_t success = 0;
+// Set by the timer, the flag is drawn from the application loop.
+static volatile bool show_flag_requested = false;
 
 static void print_button_flag(void)
 {
@@ -85,7 +87,12 @@ static void soldering_button_handler(button_t button)
     }
 }
 
-static void show_soldering_flag(void * p_context)
+static void soldering_timer_handler(void * p_context)
+{
+    show_flag_requested = true;
+}
+
+static void show_soldering_flag(void)
 {
     gfx_fill_rect(0, 0, 160, 36, DISPLAY_BLACK);
     gfx_set_text_size(1);
@@ -136,7 +143,7 @@ static void init_soldering_track(void) {
 
     ret_code_t err_code = app_timer_create(&m_soldering_track,
                                 APP_TIMER_MODE_SINGLE_SHOT,
-                                show_soldering_flag);
+                                soldering_timer_handler);
     APP_ERROR_CHECK(err_code);
 
     err_code = app_timer_start(m_soldering_track, APP_TIMER_TICKS(5000), NULL);
@@ -159,6 +166,10 @@ void app_soldering(void (*service_callback)()) {
     init_soldering_track();
 
     while (application_get() == app_soldering) {
+        if (show_flag_requested) {
+            show_flag_requested = false;
+            show_soldering_flag();
+        }
         service_callback();
     }
 
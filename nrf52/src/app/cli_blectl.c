@@ -48,12 +48,6 @@ struct service_doc
     const char* description;
 };
 
-typedef struct
-{
-    uint8_t * p_data;
-    uint16_t  data_len;
-} data_t;
-
 static struct service_doc identity =
 {
     .name = "Identity",
@@ -139,45 +133,15 @@ static void add_to_device_list(const ble_gap_evt_adv_report_t* report)
     device_count++;
 }
 
-static uint32_t adv_report_parse(uint8_t type, data_t * p_advdata, data_t * p_typedata)
-{
-    uint32_t  index = 0;
-    uint8_t * p_data;
-
-    p_data = p_advdata->p_data;
-
-    while (index < p_advdata->data_len)
-    {
-        uint8_t field_length = p_data[index];
-        uint8_t field_type   = p_data[index + 1];
+static void on_advertising_report(const struct AdvReport* parsed) {
+    const ble_gap_evt_adv_report_t* report = parsed->report;
 
-        if (field_type == type)
-        {
-            p_typedata->p_data   = &p_data[index + 2];
-            p_typedata->data_len = field_length - 1;
-            return NRF_SUCCESS;
-        }
-        index += field_length + 1;
-    }
-    return NRF_ERROR_NOT_FOUND;
-}
-
-static void on_advertising_report(const ble_gap_evt_adv_report_t* report) {
     if (scan_in_progress) {
         if (!is_in_device_list(report)) {
-            data_t adv_data;
-            data_t dev_name;
-            uint8_t data[32];
             char dev_str[32];
 
-            memcpy(data, report->data, BLE_GAP_ADV_MAX_SIZE);
-            adv_data.p_data = data;
-            adv_data.data_len = report->dlen;
-
-            if (adv_report_parse(BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, &adv_data, &dev_name) != NRF_SUCCESS) {
-                if (adv_report_parse(BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME, &adv_data, &dev_name) != NRF_SUCCESS) {
-                    return;
-                }
+            if (parsed->name.data == NULL) {
+                return;
             }
 
             cli_printf("%02X:%02X:%02X:%02X:%02X:%02X ", report->peer_addr.addr[5],
@@ -185,8 +149,8 @@ static void on_advertising_report(const ble_gap_evt_adv_report_t* report) {
                        report->peer_addr.addr[2], report->peer_addr.addr[1],
                        report->peer_addr.addr[0]);
 
-            strncpy(dev_str, (char*)dev_name.p_data, dev_name.data_len);
-            dev_str[dev_name.data_len] = '\0';
+            strncpy(dev_str, (char*)parsed->name.data, parsed->name.length);
+            dev_str[parsed->name.length] = '\0';
 
             cli_printf("%s ", dev_str);
 
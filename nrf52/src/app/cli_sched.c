@@ -23,17 +23,12 @@
 #include "cli_sched.h"
 #include "cli.h"
 #include "conf_sched.h"
-#include "conf_sched.inc"
 
-static int is_between(int h, int m, int start_h, int start_m, int end_h,
-                      int end_m)
-{
-    int flat_start = 100 * start_h + start_m;
-    int flat_end = 100 * end_h + end_m;
-    int flat_time = 100 * h + m;
+/* Schedule strings are read from the external flash in here, one at a time.  */
+static char text_buf[CONF_SCHED_STRING_MAX];
 
-    return flat_time >= flat_start && flat_time < flat_end;
-}
+/* Enough for all the talks running at the same time.  */
+static uint16_t talks_buf[16];
 
 static int parse_time(const char *time, unsigned int *p_h, unsigned int *p_m)
 {
@@ -113,7 +108,10 @@ static void print_day_help(nrf_cli_t const *p_cli, const char *day)
     static const nrf_cli_getopt_option_t opt[] = {
         NRF_CLI_OPT(NULL, "-v",
                     "Be more verbose. Use once to show abstracts, twice to "
-                    "show detailed description.")};
+                    "show detailed description."),
+        NRF_CLI_OPT(NULL, "-n",
+                    "Show the next talks or workshops to start after the "
+                    "given time.")};
     nrf_cli_help_print(p_cli, opt, ARRAY_SIZE(opt));
     nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
                     "\r\n"
@@ -125,23 +123,86 @@ static void print_day_help(nrf_cli_t const *p_cli, const char *day)
                     day);
 }
 
+static int schedule_available(nrf_cli_t const *p_cli)
+{
+    if (!conf_sched_available()) {
+        nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
+                        "The schedule is missing from the external flash.\r\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static void print_wrapped(nrf_cli_t const *p_cli, const char *label,
+                          const char *text)
+{
+    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
+                    "  \x1b[4m%s\x1b[m: ", label);
+
+    text = print_up_to_n_chars(p_cli, text, 76 - strlen(label));
+    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
+
+    while (text) {
+        nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "  ");
+        text = print_up_to_n_chars(p_cli, text, 78);
+        nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
+    }
+}
+
+static void print_talk(nrf_cli_t const *p_cli, uint16_t index, int verbosity)
+{
+    struct conf_sched_talk t;
+
+    if (conf_sched_get_talk(index, &t) != NRF_SUCCESS) {
+        return;
+    }
+
+    conf_sched_get_string(t.title, text_buf, sizeof(text_buf));
+    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "- ");
+    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_WHITE,
+                    "\x1b[4m\x1b[1m%s\x1b[m\r\n", text_buf);
+
+    conf_sched_get_string(t.names, text_buf, sizeof(text_buf));
+    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
+                    "  presented by %s\r\n", text_buf);
+
+    conf_sched_get_track(t.track, text_buf, sizeof(text_buf));
+    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
+                    "  %u:%02u to %u:%02u, room: %s\r\n", t.start / 60,
+                    t.start % 60, t.end / 60, t.end % 60, text_buf);
+
+    if (verbosity > 0) {
+        conf_sched_get_string(t.abstract, text_buf, sizeof(text_buf));
+        print_wrapped(p_cli, "Abstract", text_buf);
+    }
+    if (verbosity > 1) {
+        conf_sched_get_string(t.detailed, text_buf, sizeof(text_buf));
+        print_wrapped(p_cli, "Description", text_buf);
+    }
+    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
+}
+
 static void do_schedule_day_common(nrf_cli_t const *p_cli, int argc,
-                                   char **argv, const struct talk *talks,
-                                   int ntalks, const char *day)
+                                   char **argv, uint8_t day,
+                                   const char *day_name)
 {
     int time_specified = 0;
     unsigned int h, m;
     int verbosity = 0;
+    int next = 0;
     const char *time_str = NULL;
 
     if (nrf_cli_help_requested(p_cli)) {
-        print_day_help(p_cli, day);
+        print_day_help(p_cli, day_name);
         return;
     }
 
     for (int n = 1; n < argc; n++) {
         if (strcmp(argv[n], "-v") == 0) {
             verbosity++;
+        } else if (strcmp(argv[n], "-n") == 0) {
+            next = 1;
         } else {
             if (time_specified) {
                 nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
@@ -159,78 +220,65 @@ static void do_schedule_day_common(nrf_cli_t const *p_cli, int argc,
         }
     }
 
-    int n_displayed = 0;
-    for (int i = 0; i < ntalks; i++) {
-        const struct talk *t = &talks[i];
+    if (next && !time_specified) {
+        nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
+                        "-n needs a time.\r\n");
+        return;
+    }
 
-        if (!time_specified ||
-            is_between(h, m, t->start_h, t->start_m, t->end_h, t->end_m)) {
-            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "- ");
-            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_WHITE,
-                            "\x1b[4m\x1b[1m%s\x1b[m\r\n", t->title);
-            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
-                            "  presented by %s\r\n", t->names);
-            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
-                            "  %u:%02u to %u:%02u, room: %s\r\n", t->start_h,
-                            t->start_m, t->end_h, t->end_m, tracks[t->track]);
+    if (!schedule_available(p_cli)) {
+        return;
+    }
 
-            if (verbosity > 0) {
-                nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
-                                "  \x1b[4mAbstract\x1b[m: ");
-                const char *text = t->abstract;
+    if (!time_specified) {
+        struct conf_sched_day d;
 
-                text = print_up_to_n_chars(p_cli, text, 68);
-                nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
+        if (conf_sched_get_day(day, &d) != NRF_SUCCESS) {
+            return;
+        }
 
-                while (text) {
-                    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "  ");
-                    text = print_up_to_n_chars(p_cli, text, 78);
-                    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
-                }
-            }
-            if (verbosity > 1) {
-                nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
-                                "  \x1b[4mDescription\x1b[m: ");
-                const char *text = t->detailed;
+        for (int i = 0; i < d.num_talks; i++) {
+            print_talk(p_cli, d.first_talk + i, verbosity);
+        }
 
-                text = print_up_to_n_chars(p_cli, text, 65);
-                nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
+        return;
+    }
 
-                while (text) {
-                    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "  ");
-                    text = print_up_to_n_chars(p_cli, text, 78);
-                    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
-                                    " \r\n");
-                }
-            }
-            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
+    uint16_t minute = h * 60 + m;
+    int n_talks;
 
-            n_displayed++;
-        }
+    if (next) {
+        n_talks = conf_sched_talks_next(day, minute, talks_buf,
+                                        ARRAY_SIZE(talks_buf));
+    } else {
+        n_talks = conf_sched_talks_at(day, minute, talks_buf,
+                                      ARRAY_SIZE(talks_buf));
+    }
+
+    for (int i = 0; i < n_talks; i++) {
+        print_talk(p_cli, talks_buf[i], verbosity);
     }
 
-    if (time_specified && n_displayed == 0) {
-        printf("No talks are happening at %s\r\n", time_str);
+    if (n_talks == 0) {
+        printf("No talks are %s at %s\r\n",
+               next ? "starting after" : "happening", time_str);
     }
 }
 
 static void do_schedule_thursday(nrf_cli_t const *p_cli, size_t argc,
                                  char **argv)
 {
-    do_schedule_day_common(p_cli, argc, argv, talks_16,
-                           sizeof(talks_16) / sizeof(talks_16[0]), "thursday");
+    do_schedule_day_common(p_cli, argc, argv, 0, "thursday");
 }
 
 static void do_schedule_friday(nrf_cli_t const *p_cli, size_t argc, char **argv)
 {
-    do_schedule_day_common(p_cli, argc, argv, talks_17,
-                           sizeof(talks_17) / sizeof(talks_17[0]), "friday");
+    do_schedule_day_common(p_cli, argc, argv, 1, "friday");
 }
 
 static void do_schedule_speakers(nrf_cli_t const *p_cli, size_t argc,
                                  char **argv)
 {
-    int nspeakers = ARRAY_SIZE(speakers);
     int verbosity = 0;
     int n_displayed = 0;
     const char *filter = NULL;
@@ -259,28 +307,27 @@ static void do_schedule_speakers(nrf_cli_t const *p_cli, size_t argc,
         }
     }
 
-    for (int i = 0; i < nspeakers; i++) {
-        const struct speaker *s = &speakers[i];
+    if (!schedule_available(p_cli)) {
+        return;
+    }
 
-        if (!filter || strstr(s->name, filter)) {
-            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "- ");
-            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_WHITE,
-                            "\x1b[4m\x1b[1m%s\x1b[m\r\n", s->name);
+    for (int i = 0; i < conf_sched_num_speakers(); i++) {
+        struct conf_sched_speaker s;
 
-            if (verbosity > 0) {
-                nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT,
-                                "  \x1b[4mBio\x1b[m: ");
-                const char *text = s->bio;
+        if (conf_sched_get_speaker(i, &s) != NRF_SUCCESS) {
+            break;
+        }
 
-                text = print_up_to_n_chars(p_cli, text, 73);
-                nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
+        conf_sched_get_string(s.name, text_buf, sizeof(text_buf));
 
-                while (text) {
-                    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "  ");
-                    text = print_up_to_n_chars(p_cli, text, 78);
-                    nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
-                }
+        if (!filter || strstr(text_buf, filter)) {
+            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "- ");
+            nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_WHITE,
+                            "\x1b[4m\x1b[1m%s\x1b[m\r\n", text_buf);
 
+            if (verbosity > 0) {
+                conf_sched_get_string(s.bio, text_buf, sizeof(text_buf));
+                print_wrapped(p_cli, "Bio", text_buf);
                 nrf_cli_fprintf(p_cli, NRF_CLI_VT100_COLOR_DEFAULT, "\r\n");
             }
 
@@ -0,0 +1,384 @@
+/*
+ * Copyright 2019 Simon Marchi <simon.marchi@polymtl.ca>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "conf_sched.h"
+
+#include <app_error.h>
+#include <nordic_common.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "drivers/flash.h"
+#include "external_flash.h"
+
+/* Records are read from the flash by aligned lines, and the most recently
+   used lines are kept around: browsing a day or going back to a menu reads
+   the same few records over and over.  A day of talks fits in the cache.  */
+#define CACHE_LINE_SIZE 64
+#define CACHE_LINES 16
+
+/* Strings are read from the flash by chunks of this size.  */
+#define STRING_CHUNK_SIZE 32
+
+struct cache_line {
+    uint32_t address;
+    uint32_t last_use;
+    bool valid;
+    uint8_t data[CACHE_LINE_SIZE];
+};
+
+static struct cache_line cache[CACHE_LINES];
+static uint32_t cache_clock;
+
+static struct conf_sched_header header;
+static uint32_t db_address;
+static uint32_t db_size;
+static bool db_valid = false;
+
+static struct cache_line *get_line(uint32_t address)
+{
+    struct cache_line *victim = &cache[0];
+
+    for (int i = 0; i < CACHE_LINES; i++) {
+        struct cache_line *line = &cache[i];
+
+        if (line->valid && line->address == address) {
+            line->last_use = ++cache_clock;
+            return line;
+        }
+
+        if (!line->valid ||
+            (victim->valid && line->last_use < victim->last_use)) {
+            victim = line;
+        }
+    }
+
+    victim->valid = false;
+    if (flash_read(address, victim->data, CACHE_LINE_SIZE) != NRF_SUCCESS) {
+        return NULL;
+    }
+
+    victim->address = address;
+    victim->last_use = ++cache_clock;
+    victim->valid = true;
+
+    return victim;
+}
+
+/* Read LEN bytes at OFFSET in the database, through the cache.  */
+static ret_code_t read_cached(uint32_t offset, void *data, size_t len)
+{
+    uint8_t *p = data;
+
+    if (!db_valid || offset > db_size || len > db_size - offset) {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+
+    uint32_t address = db_address + offset;
+
+    while (len > 0) {
+        uint32_t line_address = address & ~(CACHE_LINE_SIZE - 1);
+        size_t line_offset = address - line_address;
+        size_t n = MIN(len, CACHE_LINE_SIZE - line_offset);
+        struct cache_line *line = get_line(line_address);
+
+        if (!line) {
+            return NRF_ERROR_INTERNAL;
+        }
+
+        memcpy(p, &line->data[line_offset], n);
+        p += n;
+        address += n;
+        len -= n;
+    }
+
+    return NRF_SUCCESS;
+}
+
+/* Check that COUNT records of SIZE bytes at OFFSET are in the database.  */
+static bool table_fits(uint32_t offset, uint32_t count, size_t size)
+{
+    return offset <= db_size && count * size <= db_size - offset;
+}
+
+/* Read and validate the database header, once at boot: the external flash
+   is only rewritten by the flash mode, which ends with a reset.  */
+ret_code_t conf_sched_init(void)
+{
+    db_valid = false;
+
+    for (int i = 0; i < CACHE_LINES; i++) {
+        cache[i].valid = false;
+    }
+
+#if defined(NSEC_FLAVOR_CONF)
+    db_address = external_flash_conf_sched_db.offset;
+    db_size = external_flash_conf_sched_db.size;
+#else
+    return NRF_ERROR_NOT_SUPPORTED;
+#endif
+
+    if (db_size < sizeof(header)) {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    ret_code_t ret = flash_read(db_address, (uint8_t *)&header, sizeof(header));
+    if (ret != NRF_SUCCESS) {
+        return ret;
+    }
+
+    if (header.magic != CONF_SCHED_MAGIC ||
+        header.version != CONF_SCHED_VERSION) {
+        return NRF_ERROR_INVALID_DATA;
+    }
+
+    if (!table_fits(header.days, header.num_days,
+                    sizeof(struct conf_sched_day)) ||
+        !table_fits(header.talks, header.num_talks,
+                    sizeof(struct conf_sched_talk)) ||
+        !table_fits(header.speakers, header.num_speakers,
+                    sizeof(struct conf_sched_speaker)) ||
+        !table_fits(header.tracks, header.num_tracks, sizeof(uint32_t)) ||
+        !table_fits(header.slots, 0, sizeof(struct conf_sched_slot)) ||
+        !table_fits(header.slot_talks, 0, sizeof(uint16_t)) ||
+        !table_fits(header.strings, 0, 1)) {
+        return NRF_ERROR_INVALID_DATA;
+    }
+
+    db_valid = true;
+
+    return NRF_SUCCESS;
+}
+
+bool conf_sched_available(void)
+{
+    return db_valid;
+}
+
+uint8_t conf_sched_num_days(void)
+{
+    return db_valid ? header.num_days : 0;
+}
+
+uint16_t conf_sched_num_speakers(void)
+{
+    return db_valid ? header.num_speakers : 0;
+}
+
+ret_code_t conf_sched_get_day(uint8_t day, struct conf_sched_day *d)
+{
+    if (day >= conf_sched_num_days()) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    return read_cached(header.days + day * sizeof(*d), d, sizeof(*d));
+}
+
+ret_code_t conf_sched_get_talk(uint16_t index, struct conf_sched_talk *t)
+{
+    if (!db_valid || index >= header.num_talks) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    return read_cached(header.talks + index * sizeof(*t), t, sizeof(*t));
+}
+
+ret_code_t conf_sched_get_speaker(uint16_t index,
+                                  struct conf_sched_speaker *s)
+{
+    if (index >= conf_sched_num_speakers()) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    return read_cached(header.speakers + index * sizeof(*s), s, sizeof(*s));
+}
+
+/* Copy string REF in BUF, truncating it to SIZE - 1 characters.  Return the
+   length of the copied string.  */
+size_t conf_sched_get_string(uint32_t ref, char *buf, size_t size)
+{
+    struct flash_stream stream;
+    size_t len = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    buf[0] = '\0';
+
+    if (!db_valid || ref >= db_size - header.strings) {
+        return 0;
+    }
+
+    /* Don't read past the end of the database.  */
+    size_t max = MIN(size - 1, db_size - header.strings - ref);
+
+    if (flash_stream_open(&stream, db_address + header.strings + ref) !=
+        NRF_SUCCESS) {
+        return 0;
+    }
+
+    while (len < max) {
+        size_t n = MIN(max - len, STRING_CHUNK_SIZE);
+
+        if (flash_stream_read(&stream, (uint8_t *)&buf[len], n) !=
+            NRF_SUCCESS) {
+            break;
+        }
+
+        char *nul = memchr(&buf[len], '\0', n);
+        if (nul) {
+            len = nul - buf;
+            break;
+        }
+
+        len += n;
+    }
+
+    flash_stream_close(&stream);
+
+    buf[len] = '\0';
+
+    return len;
+}
+
+size_t conf_sched_get_track(uint8_t track, char *buf, size_t size)
+{
+    uint32_t ref;
+
+    if (!db_valid || track >= header.num_tracks ||
+        read_cached(header.tracks + track * sizeof(ref), &ref, sizeof(ref)) !=
+            NRF_SUCCESS) {
+        if (size > 0) {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+
+    return conf_sched_get_string(ref, buf, size);
+}
+
+static ret_code_t get_slot(uint16_t index, struct conf_sched_slot *slot)
+{
+    return read_cached(header.slots + index * sizeof(*slot), slot,
+                       sizeof(*slot));
+}
+
+/* Copy the talk indices listed by SLOT in TALKS, at most MAX of them.  Return
+   the number of talks copied.  */
+static int get_slot_talks(const struct conf_sched_slot *slot, uint16_t *talks,
+                          int max)
+{
+    int n = MIN(slot->num_talks, max);
+
+    if (read_cached(header.slot_talks + slot->first_talk * sizeof(uint16_t),
+                    talks, n * sizeof(uint16_t)) != NRF_SUCCESS) {
+        return 0;
+    }
+
+    return n;
+}
+
+/* Find the last slot of DAY starting at or before MINUTE.  Return -1 if
+   MINUTE is before the first slot.  */
+static int find_slot(const struct conf_sched_day *d, uint16_t minute)
+{
+    int lo = 0, hi = d->num_slots;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        struct conf_sched_slot slot;
+
+        if (get_slot(d->first_slot + mid, &slot) != NRF_SUCCESS) {
+            return -1;
+        }
+
+        if (slot.minute <= minute) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo - 1;
+}
+
+/* Put in TALKS the indices of the talks of DAY running at MINUTE, at most
+   MAX of them.  Return the number of talks found.  */
+int conf_sched_talks_at(uint8_t day, uint16_t minute, uint16_t *talks,
+                        int max)
+{
+    struct conf_sched_day d;
+    struct conf_sched_slot slot;
+
+    if (conf_sched_get_day(day, &d) != NRF_SUCCESS) {
+        return 0;
+    }
+
+    int i = find_slot(&d, minute);
+    if (i < 0 || get_slot(d.first_slot + i, &slot) != NRF_SUCCESS) {
+        return 0;
+    }
+
+    return get_slot_talks(&slot, talks, max);
+}
+
+/* Put in TALKS the indices of the next talks of DAY to start after MINUTE,
+   at most MAX of them.  Return the number of talks found.  */
+int conf_sched_talks_next(uint8_t day, uint16_t minute, uint16_t *talks,
+                          int max)
+{
+    struct conf_sched_day d;
+    uint16_t running[16];
+
+    if (conf_sched_get_day(day, &d) != NRF_SUCCESS) {
+        return 0;
+    }
+
+    /* Some slots only mark the end of a talk, skip over them.  */
+    for (int i = find_slot(&d, minute) + 1; i < d.num_slots; i++) {
+        struct conf_sched_slot slot;
+        int n = 0;
+
+        if (get_slot(d.first_slot + i, &slot) != NRF_SUCCESS) {
+            return 0;
+        }
+
+        int num_running = get_slot_talks(&slot, running, ARRAY_SIZE(running));
+
+        for (int j = 0; j < num_running && n < max; j++) {
+            struct conf_sched_talk t;
+
+            if (conf_sched_get_talk(running[j], &t) == NRF_SUCCESS &&
+                t.start == slot.minute) {
+                talks[n++] = running[j];
+            }
+        }
+
+        if (n > 0) {
+            return n;
+        }
+    }
+
+    return 0;
+}
@@ -8,26 +8,85 @@
 #ifndef SRC_APP_CONF_SCHED_H_
 #define SRC_APP_CONF_SCHED_H_
 
-struct talk {
-    const char *title, *names, *abstract, *detailed;
-    unsigned char start_h, start_m;
-    unsigned char end_h, end_m;
-    unsigned char track;
-};
-
-struct speaker {
-    const char *name, *bio;
-};
-
-/* These are defined in conf_sched.inc.  */
-extern const struct talk talks_16[];
-extern const struct talk talks_17[];
-extern const int num_talks_16;
-extern const int num_talks_17;
-
-extern const struct speaker speakers[];
-extern const int num_speakers;
-
-extern const char *const tracks[];
+#include <sdk_errors.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The conference schedule is a database in the external flash, generated from
+   conf_sched.json by utils/gen-conf-structs.py.  All the records are little
+   endian, and the offsets are relative to the start of the database.  */
+
+#define CONF_SCHED_MAGIC 0x4443534e /* "NSCD" */
+#define CONF_SCHED_VERSION 1
+
+/* Strings, including their NUL, are never longer than this.  The longest
+   talk descriptions are around 2400 characters.  */
+#define CONF_SCHED_STRING_MAX 4096
+
+struct conf_sched_header {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t num_days;
+    uint8_t num_tracks;
+    uint16_t num_talks;
+    uint16_t num_speakers;
+    /* struct conf_sched_day[num_days] */
+    uint32_t days;
+    /* struct conf_sched_talk[num_talks], sorted by day, start and track.  */
+    uint32_t talks;
+    /* struct conf_sched_speaker[num_speakers], sorted by name.  */
+    uint32_t speakers;
+    /* String references to the track names, uint32_t[num_tracks].  */
+    uint32_t tracks;
+    /* struct conf_sched_slot[], the time index of all days.  */
+    uint32_t slots;
+    /* Talk indices, uint16_t[], listed by the slots.  */
+    uint32_t slot_talks;
+    /* NUL-terminated strings, referenced by their offset in this blob.  */
+    uint32_t strings;
+} __attribute__((packed));
+
+struct conf_sched_day {
+    uint32_t name;
+    uint16_t first_talk, num_talks;
+    uint16_t first_slot, num_slots;
+} __attribute__((packed));
+
+struct conf_sched_talk {
+    uint32_t title, names, abstract, detailed;
+    /* Minutes since midnight.  */
+    uint16_t start, end;
+    uint8_t track, day;
+    uint16_t reserved;
+} __attribute__((packed));
+
+struct conf_sched_speaker {
+    uint32_t name, bio;
+} __attribute__((packed));
+
+/* A slot starts at every minute where a talk of the day starts or ends, and
+   lists the talks running until the next slot.  */
+struct conf_sched_slot {
+    uint16_t minute;
+    uint16_t first_talk;
+    uint8_t num_talks;
+    uint8_t reserved;
+} __attribute__((packed));
+
+ret_code_t conf_sched_init(void);
+bool conf_sched_available(void);
+uint8_t conf_sched_num_days(void);
+uint16_t conf_sched_num_speakers(void);
+ret_code_t conf_sched_get_day(uint8_t day, struct conf_sched_day *d);
+ret_code_t conf_sched_get_talk(uint16_t index, struct conf_sched_talk *t);
+ret_code_t conf_sched_get_speaker(uint16_t index,
+                                  struct conf_sched_speaker *s);
+size_t conf_sched_get_string(uint32_t ref, char *buf, size_t size);
+size_t conf_sched_get_track(uint8_t track, char *buf, size_t size);
+int conf_sched_talks_at(uint8_t day, uint16_t minute, uint16_t *talks,
+                        int max);
+int conf_sched_talks_next(uint8_t day, uint16_t minute, uint16_t *talks,
+                          int max);
 
 #endif /* SRC_APP_CONF_SCHED_H_ */
@@ -34,8 +34,69 @@
 #include "gfx_effect.h"
 #include <drivers/display.h>
 #include <drivers/flash.h>
+#include <drivers/power.h>
 #include <drivers/uart.h>
 
+// Binary mode, see handle_binary.
+#define BINARY_SECTOR_SIZE 4096
+// Packets the client may send before waiting for an ack.  Each one has its
+// own buffer, so one can be written to the flash while the next arrives.
+#define BINARY_WINDOW 2
+// Largest packet: type, sequence, address, flags, a sector of data and CRC.
+#define BINARY_MAX_PACKET (2 + 4 + 1 + BINARY_SECTOR_SIZE + 4)
+#define BINARY_MAX_READ 512
+
+#define BINARY_CMD_WRITE 0x01
+#define BINARY_CMD_READ 0x02
+#define BINARY_CMD_CHECKSUM 0x03
+#define BINARY_CMD_SECTOR_CRCS 0x04
+#define BINARY_RESPONSE 0x80
+#define BINARY_BAD_PACKET 0xff
+
+#define BINARY_WRITE_ERASE 0x01
+
+enum binary_status {
+    BINARY_STATUS_OK = 0,
+    BINARY_STATUS_BAD_PACKET = 1,
+    BINARY_STATUS_BAD_ARGS = 2,
+    BINARY_STATUS_FLASH_ERROR = 3,
+};
+
+enum slot_state {
+    // Free to receive the next packet.
+    SLOT_FREE,
+    // The packet is being written to the flash.
+    SLOT_BUSY,
+    // Waiting for its response, packets are answered in order.
+    SLOT_DONE,
+};
+
+struct binary_slot {
+    enum slot_state state;
+    uint8_t packet[BINARY_MAX_PACKET];
+    size_t len;
+    // The packet didn't fit, or its COBS encoding was broken.
+    bool bad;
+    ret_code_t result;
+};
+
+// The slots take two sectors of RAM, they live on binary_mode's stack rather
+// than in .bss since flash mode only runs at boot and ends with a reset.
+static struct binary_slot *slots;
+// Slot receiving the next packet, and slot answered next.
+static uint8_t rx_slot = 0;
+static uint8_t ack_slot = 0;
+
+// COBS decoder state: bytes left in the current block, and whether a zero
+// goes before the next one.
+static uint8_t cobs_left = 0;
+static bool cobs_zero = false;
+
+// Bytes taken from the uart but not decoded yet, the slots were all busy.
+static uint8_t rx_buf[64];
+static size_t rx_len = 0;
+static size_t rx_pos = 0;
+
 static const char *skip_spaces(const char *p) {
     while (*p == ' ') {
         p++;
@@ -237,6 +298,399 @@ static void handle_checksum(const char *args) {
     uart_printf("checksum ok 0x%x\n", crc);
 }
 
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_le32(uint8_t *p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+// COBS-encode the LEN bytes of DATA, add the 0 delimiter and send it all.
+static void binary_send(const uint8_t *data, size_t len) {
+    static uint8_t encoded[BINARY_MAX_READ + 16];
+    size_t out = 1;
+    size_t code_pos = 0;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != 0) {
+            encoded[out++] = data[i];
+            code++;
+        }
+
+        if (data[i] == 0 || code == 0xff) {
+            encoded[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+    }
+
+    encoded[code_pos] = code;
+    encoded[out++] = 0;
+
+    uart_send(encoded, out);
+}
+
+// Send the response to the packet with sequence number SEQ.
+static void binary_respond(uint8_t type, uint8_t seq, enum binary_status status,
+                           uint8_t *response, size_t payload_len) {
+    response[0] = type;
+    response[1] = seq;
+    response[2] = status;
+    put_le32(response + 3 + payload_len,
+             crc32_compute(response, 3 + payload_len, NULL));
+
+    binary_send(response, 3 + payload_len + 4);
+}
+
+// CRC32 of LEN bytes of flash at ADDRESS, read in a single stream.
+static ret_code_t binary_flash_crc(uint32_t address, uint32_t len,
+                                   uint32_t *crc) {
+    struct flash_stream stream;
+    uint8_t data[128];
+
+    *crc = 0;
+    if (len == 0) {
+        return NRF_SUCCESS;
+    }
+
+    ret_code_t ret = flash_stream_open(&stream, address);
+    if (ret != NRF_SUCCESS) {
+        return ret;
+    }
+
+    uint32_t *p_crc = NULL;
+    while (len > 0 && ret == NRF_SUCCESS) {
+        size_t chunk = len < sizeof(data) ? len : sizeof(data);
+
+        ret = flash_stream_read(&stream, data, chunk);
+        *crc = crc32_compute(data, chunk, p_crc);
+        p_crc = crc;
+        len -= chunk;
+    }
+
+    flash_stream_close(&stream);
+
+    return ret;
+}
+
+// The erase and the write of a packet both report here.
+static void binary_write_done(ret_code_t result, void *context) {
+    struct binary_slot *slot = context;
+
+    if (slot->result == NRF_SUCCESS) {
+        slot->result = result;
+    }
+}
+
+static void binary_write_last(ret_code_t result, void *context) {
+    struct binary_slot *slot = context;
+
+    binary_write_done(result, context);
+    slot->state = SLOT_DONE;
+}
+
+// A complete packet arrived in SLOT.  Writes are queued to the flash right
+// away, everything else waits for its turn to be answered.
+static void binary_start(struct binary_slot *slot) {
+    uint8_t *p = slot->packet;
+
+    slot->result = NRF_SUCCESS;
+    slot->state = SLOT_DONE;
+
+    if (slot->bad || slot->len < 2 + 4 ||
+        crc32_compute(p, slot->len - 4, NULL) != get_le32(p + slot->len - 4)) {
+        slot->bad = true;
+        return;
+    }
+
+    // Header, address and flags.
+    if (p[0] != BINARY_CMD_WRITE || slot->len < 2 + 5 + 4) {
+        return;
+    }
+
+    uint32_t address = get_le32(p + 2);
+    uint8_t flags = p[6];
+    uint8_t *data = p + 7;
+    size_t len = slot->len - 7 - 4;
+
+    if ((flags & BINARY_WRITE_ERASE) &&
+        (address % BINARY_SECTOR_SIZE != 0 || len > BINARY_SECTOR_SIZE)) {
+        slot->result = NRF_ERROR_INVALID_PARAM;
+        return;
+    }
+
+    slot->state = SLOT_BUSY;
+
+    if (flags & BINARY_WRITE_ERASE) {
+        ret_code_t ret = flash_erase_async(address, binary_write_done, slot);
+        if (ret != NRF_SUCCESS) {
+            binary_write_last(ret, slot);
+            return;
+        }
+    }
+
+    ret_code_t ret =
+        flash_write_async(address, data, len, binary_write_last, slot);
+    if (ret != NRF_SUCCESS) {
+        binary_write_last(ret, slot);
+    }
+}
+
+// Answer the packet in SLOT, whose flash work is done.
+static void binary_answer(struct binary_slot *slot) {
+    static uint8_t response[3 + BINARY_MAX_READ + 4];
+    uint8_t *p = slot->packet;
+    uint8_t *args = p + 2;
+    size_t args_len = slot->len - 2 - 4;
+    uint8_t type = p[0] | BINARY_RESPONSE;
+    uint8_t seq = p[1];
+    ret_code_t ret = slot->result;
+
+    if (slot->bad) {
+        binary_respond(BINARY_BAD_PACKET, slot->len >= 2 ? seq : 0,
+                       BINARY_STATUS_BAD_PACKET, response, 0);
+        return;
+    }
+
+    switch (p[0]) {
+    // Write the data at an address, after erasing its sector if asked to.
+    // The data is read back and the response holds its CRC32.
+    //
+    // Packet:   01 seq address:u32 flags:u8 data[0..4096]
+    // Response: 81 seq status crc:u32
+    case BINARY_CMD_WRITE: {
+        if (args_len < 5 || ret == NRF_ERROR_INVALID_PARAM) {
+            binary_respond(type, seq, BINARY_STATUS_BAD_ARGS, response, 0);
+            return;
+        }
+
+        uint32_t crc;
+        if (ret == NRF_SUCCESS) {
+            ret = binary_flash_crc(get_le32(args), args_len - 5, &crc);
+        }
+
+        if (ret != NRF_SUCCESS) {
+            binary_respond(type, seq, BINARY_STATUS_FLASH_ERROR, response, 0);
+            return;
+        }
+
+        put_le32(response + 3, crc);
+        binary_respond(type, seq, BINARY_STATUS_OK, response, 4);
+        return;
+    }
+
+    // Packet:   02 seq address:u32 length:u16
+    // Response: 82 seq status data[length]
+    case BINARY_CMD_READ: {
+        uint16_t len = args_len == 6 ? args[4] | args[5] << 8 : 0;
+
+        if (args_len != 6 || len > BINARY_MAX_READ) {
+            binary_respond(type, seq, BINARY_STATUS_BAD_ARGS, response, 0);
+            return;
+        }
+
+        if (flash_read(get_le32(args), response + 3, len) != NRF_SUCCESS) {
+            binary_respond(type, seq, BINARY_STATUS_FLASH_ERROR, response, 0);
+            return;
+        }
+
+        binary_respond(type, seq, BINARY_STATUS_OK, response, len);
+        return;
+    }
+
+    // Packet:   03 seq address:u32 length:u32
+    // Response: 83 seq status crc:u32
+    case BINARY_CMD_CHECKSUM: {
+        uint32_t crc;
+
+        if (args_len != 8) {
+            binary_respond(type, seq, BINARY_STATUS_BAD_ARGS, response, 0);
+            return;
+        }
+
+        if (binary_flash_crc(get_le32(args), get_le32(args + 4), &crc) !=
+            NRF_SUCCESS) {
+            binary_respond(type, seq, BINARY_STATUS_FLASH_ERROR, response, 0);
+            return;
+        }
+
+        put_le32(response + 3, crc);
+        binary_respond(type, seq, BINARY_STATUS_OK, response, 4);
+        return;
+    }
+
+    // CRC32 of each of COUNT sectors starting at ADDRESS, so that a client
+    // only rewrites the ones that changed.
+    //
+    // Packet:   04 seq address:u32 count:u16
+    // Response: 84 seq status crc:u32[count]
+    case BINARY_CMD_SECTOR_CRCS: {
+        uint16_t count = args_len == 6 ? args[4] | args[5] << 8 : 0;
+        uint32_t address = get_le32(args);
+
+        if (args_len != 6 || count > BINARY_MAX_READ / 4 ||
+            address % BINARY_SECTOR_SIZE != 0) {
+            binary_respond(type, seq, BINARY_STATUS_BAD_ARGS, response, 0);
+            return;
+        }
+
+        for (uint16_t i = 0; i < count; i++) {
+            uint32_t crc;
+
+            if (binary_flash_crc(address + i * BINARY_SECTOR_SIZE,
+                                 BINARY_SECTOR_SIZE, &crc) != NRF_SUCCESS) {
+                binary_respond(type, seq, BINARY_STATUS_FLASH_ERROR, response,
+                               0);
+                return;
+            }
+
+            put_le32(response + 3 + i * 4, crc);
+        }
+
+        binary_respond(type, seq, BINARY_STATUS_OK, response, count * 4);
+        return;
+    }
+
+    default:
+        binary_respond(type, seq, BINARY_STATUS_BAD_ARGS, response, 0);
+        return;
+    }
+}
+
+static void binary_append(struct binary_slot *slot, uint8_t c) {
+    if (slot->len == BINARY_MAX_PACKET) {
+        slot->bad = true;
+        return;
+    }
+
+    slot->packet[slot->len++] = c;
+}
+
+// Feed received bytes to the COBS decoder, as long as there is a free slot
+// to put them in.  Return whether something was done.
+static bool binary_receive(void) {
+    bool progress = false;
+
+    while (slots[rx_slot].state == SLOT_FREE) {
+        struct binary_slot *slot = &slots[rx_slot];
+
+        if (rx_pos == rx_len) {
+            rx_len = uart_read_available(rx_buf, sizeof(rx_buf));
+            rx_pos = 0;
+
+            if (rx_len == 0) {
+                break;
+            }
+        }
+
+        uint8_t c = rx_buf[rx_pos++];
+
+        progress = true;
+
+        if (c == 0) {
+            // End of packet, empty ones are just padding.
+            if (slot->len > 0 || slot->bad) {
+                slot->bad |= cobs_left != 0;
+                binary_start(slot);
+                rx_slot = (rx_slot + 1) % BINARY_WINDOW;
+            }
+
+            cobs_left = 0;
+            cobs_zero = false;
+            continue;
+        }
+
+        if (cobs_left == 0) {
+            // A block code, the zero ending the previous block goes first.
+            if (cobs_zero) {
+                binary_append(slot, 0);
+            }
+
+            cobs_left = c - 1;
+            cobs_zero = c != 0xff;
+            continue;
+        }
+
+        binary_append(slot, c);
+        cobs_left--;
+    }
+
+    return progress;
+}
+
+// Enter binary mode: COBS-framed packets, each ending with a CRC32, are
+// answered in order.  The client may have up to BINARY_WINDOW packets in
+// flight; writes proceed in the background while the next packet arrives.
+//
+// The only way out is to reset the chip.
+static void binary_mode(void) {
+    // See __STACK_SIZE in the Makefile.  binary_mode never returns, so the
+    // slots stay valid.
+    struct binary_slot stack_slots[BINARY_WINDOW];
+
+    slots = stack_slots;
+
+    for (int i = 0; i < BINARY_WINDOW; i++) {
+        slots[i].state = SLOT_FREE;
+        slots[i].len = 0;
+        slots[i].bad = false;
+    }
+
+    while (1) {
+        bool progress = binary_receive();
+
+        flash_process();
+
+        while (slots[ack_slot].state == SLOT_DONE) {
+            struct binary_slot *slot = &slots[ack_slot];
+
+            binary_answer(slot);
+            slot->len = 0;
+            slot->bad = false;
+            slot->state = SLOT_FREE;
+            ack_slot = (ack_slot + 1) % BINARY_WINDOW;
+            progress = true;
+        }
+
+        if (uart_clear_errors() && slots[rx_slot].state == SLOT_FREE) {
+            // Bytes were lost, the packet being received is garbage.
+            slots[rx_slot].bad = true;
+        }
+
+        if (!progress) {
+            power_manage();
+        }
+    }
+}
+
+// Switch to the binary protocol, optionally at another baud rate.
+//
+// Synopsis: binary [baud rate in decimal]
+// Response: binary ok <baud rate> <window> <max data per write>
+static void handle_binary(const char *args) {
+    unsigned long baud = strtoul(args, NULL, 10);
+
+    if (baud == 0) {
+        baud = 115200;
+    }
+
+    uart_printf("binary ok %lu %d %d\n", baud, BINARY_WINDOW,
+                BINARY_SECTOR_SIZE);
+
+    ret_code_t ret = uart_set_baudrate(baud);
+    if (ret != NRF_SUCCESS) {
+        // The client expects the new rate, it will time out.
+        uart_set_baudrate(115200);
+    }
+
+    binary_mode();
+}
+
 static void handle_command(const char *command) {
     if (strncmp(command, "write ", strlen("write ")) == 0) {
         handle_write(command + strlen("write "));
@@ -246,6 +700,8 @@ static void handle_command(const char *command) {
         handle_erase(command + strlen("erase "));
     } else if (strncmp(command, "checksum ", strlen("checksum ")) == 0) {
         handle_checksum(command + strlen("checksum "));
+    } else if (strncmp(command, "binary", strlen("binary")) == 0) {
+        handle_binary(command + strlen("binary"));
     } else {
         uart_puts("error: unknown command: ");
         uart_puts(command);
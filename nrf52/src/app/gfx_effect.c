@@ -6,7 +6,7 @@
 
 #include "gfx_effect.h"
 #include "drivers/display.h"
-#include "drivers/flash.h"
+#include "drivers/bitmap_reader.h"
 #include "external_flash.h"
 #include "images/font_bitmap.h"
 #include "random.h"
@@ -129,10 +129,7 @@ void gfx_draw_rect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
 }
 
 void gfx_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
-    // Update in subclasses if desired!
-    for (int16_t i = x; i < x + w; i++) {
-        gfx_draw_fast_vline(i, y, h, color);
-    }
+    display_fill_rect(x, y, w, h, color);
 }
 
 void gfx_draw_circle(int16_t x0, int16_t y0, int16_t r, uint16_t colour) {
@@ -395,18 +392,7 @@ void gfx_draw_bitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w,
 // foreground color and bg as the background color.
 void gfx_draw_bitmap_bg(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w,
                         int16_t h, uint16_t color, uint16_t bg) {
-    int16_t i, j, byteWidth = (w + 7) / 8;
-
-    for (j = 0; j < h; j++) {
-        for (i = 0; i < w; i++) {
-            if (pgm_read_byte(bitmap + j * byteWidth + i / 8) &
-                (128 >> (i & 7))) {
-                display_draw_pixel(x + i, y + j, color);
-            } else {
-                display_draw_pixel(x + i, y + j, bg);
-            }
-        }
-    }
+    display_draw_bitmap(x, y, bitmap, w, h, color, bg);
 }
 
 // Draw XBitMap Files (*.xbm), exported from GIMP,
@@ -428,21 +414,26 @@ void gfx_draw_xbitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w,
 
 void gfx_draw_bitmap_ext_flash(int16_t x, int16_t y,
                                const struct bitmap_ext *bitmap) {
-    static uint8_t buf[128];
+    static uint8_t buf[256];
     unsigned int buf_idx = sizeof(buf);
-    unsigned int flash_address = bitmap->flash_data->offset;
+    struct bitmap_reader reader;
 
     unsigned int width = bitmap->width;
     unsigned int height = bitmap->height;
 
+    if (bitmap_reader_open(&reader, bitmap) != NRF_SUCCESS) {
+        return;
+    }
+
     for (uint16_t j = 0; j < height; j++) {
         for (uint16_t i = 0; i < width; i++) {
             if (buf_idx >= sizeof(buf)) {
-                ret_code_t ret = flash_read_128(flash_address, buf);
+                ret_code_t ret =
+                    bitmap_reader_read(&reader, buf, sizeof(buf) / 2);
                 if (ret != NRF_SUCCESS) {
+                    bitmap_reader_close(&reader);
                     return;
                 }
-                flash_address += 128;
                 buf_idx = 0;
             }
 
@@ -453,8 +444,84 @@ void gfx_draw_bitmap_ext_flash(int16_t x, int16_t y,
             display_draw_pixel(x + i, y + j, color);
         }
     }
+
+    bitmap_reader_close(&reader);
 }
 
+static uint8_t gfx_font_column(unsigned char c, int8_t i) {
+    if (i == 5)
+        return 0x0;
+    return pgm_read_byte(font_bitmap.image + (c * 5) + i);
+}
+
+#ifdef BOARD_BRAIN
+// Characters drawn over a background are expanded into a block of pixels and
+// sent in one go.  The size 1 glyphs, by far the most common, are kept in a
+// small cache indexed by character.
+#define GLYPH_CACHE_SIZE 16
+#define GLYPH_BLOCK_MAX_SIZE 3
+
+struct glyph_cache_entry {
+    uint16_t color;
+    uint16_t bg;
+    unsigned char c;
+    bool valid;
+    uint8_t pixels[6 * 8 * 2];
+};
+
+static struct glyph_cache_entry glyph_cache[GLYPH_CACHE_SIZE];
+static uint8_t glyph_block[6 * 8 * GLYPH_BLOCK_MAX_SIZE * GLYPH_BLOCK_MAX_SIZE * 2];
+
+// Fill BLOCK with the glyph of C in big endian RGB565, as the display wants.
+static void gfx_expand_glyph(uint8_t *block, unsigned char c, uint16_t color,
+                             uint16_t bg, uint8_t size) {
+    uint16_t w = 6 * size;
+
+    for (int8_t i = 0; i < 6; i++) {
+        uint8_t line = gfx_font_column(c, i);
+        for (int8_t j = 0; j < 8; j++, line >>= 1) {
+            uint16_t pixel = (line & 0x1) ? color : bg;
+            for (uint8_t dy = 0; dy < size; dy++) {
+                uint8_t *p = &block[((j * size + dy) * w + i * size) * 2];
+                for (uint8_t dx = 0; dx < size; dx++) {
+                    *p++ = pixel >> 8;
+                    *p++ = pixel;
+                }
+            }
+        }
+    }
+}
+
+static bool gfx_draw_char_block(int16_t x, int16_t y, unsigned char c,
+                                uint16_t color, uint16_t bg, uint8_t size) {
+    const uint8_t *pixels;
+
+    if (size > GLYPH_BLOCK_MAX_SIZE) {
+        return false;
+    }
+
+    if (size == 1) {
+        struct glyph_cache_entry *entry = &glyph_cache[c % GLYPH_CACHE_SIZE];
+        if (!entry->valid || entry->c != c || entry->color != color ||
+            entry->bg != bg) {
+            gfx_expand_glyph(entry->pixels, c, color, bg, 1);
+            entry->c = c;
+            entry->color = color;
+            entry->bg = bg;
+            entry->valid = true;
+        }
+        pixels = entry->pixels;
+    } else {
+        gfx_expand_glyph(glyph_block, c, color, bg, size);
+        pixels = glyph_block;
+    }
+
+    // With a black "transparent" colour, the block goes through untouched.
+    display_draw_16bit_bitmap(x, y, pixels, 6 * size, 8 * size, DISPLAY_BLACK);
+    return true;
+}
+#endif
+
 // Draw a character
 void gfx_draw_char(int16_t x, int16_t y, unsigned char c, uint16_t color,
                    uint16_t bg, uint8_t size) {
@@ -464,28 +531,55 @@ void gfx_draw_char(int16_t x, int16_t y, unsigned char c, uint16_t color,
         ((y + 8 * size - 1) < 0))   // Clip top
         return;
 
+    bool inside = (x >= 0) && (y >= 0) && (x + 6 * size <= gfx_width) &&
+                  (y + 8 * size <= gfx_height);
+
+#ifdef BOARD_BRAIN
+    if (inside && bg != color && gfx_draw_char_block(x, y, c, color, bg, size)) {
+        return;
+    }
+#endif
+
     for (int8_t i = 0; i < 6; i++) {
-        uint8_t line;
-        if (i == 5)
-            line = 0x0;
-        else
-            line = pgm_read_byte(font_bitmap.image + (c * 5) + i);
-        for (int8_t j = 0; j < 8; j++) {
-            if (line & 0x1) {
-                if (size == 1) { // default size
-                    display_draw_pixel(x + i, y + j, color);
-                } else { // big size
-                    gfx_fill_rect(x + (i * size), y + (j * size), size, size,
-                                  color);
-                }
-            } else if (bg != color) {
-                if (size == 1) // default size
-                    display_draw_pixel(x + i, y + j, bg);
-                else { // big size
-                    gfx_fill_rect(x + i * size, y + j * size, size, size, bg);
+        uint8_t line = gfx_font_column(c, i);
+        int8_t j = 0;
+
+        if (!inside) {
+            // Partly off screen, let the pixels be clipped one by one.
+            for (j = 0; j < 8; j++, line >>= 1) {
+                if (line & 0x1) {
+                    if (size == 1) { // default size
+                        display_draw_pixel(x + i, y + j, color);
+                    } else { // big size
+                        gfx_fill_rect(x + (i * size), y + (j * size), size,
+                                      size, color);
+                    }
+                } else if (bg != color) {
+                    if (size == 1) // default size
+                        display_draw_pixel(x + i, y + j, bg);
+                    else { // big size
+                        gfx_fill_rect(x + i * size, y + j * size, size, size,
+                                      bg);
+                    }
                 }
             }
-            line >>= 1;
+            continue;
+        }
+
+        // Draw each vertical run of same colour pixels at once
+        while (j < 8) {
+            bool on = line & 0x1;
+            int8_t run = 0;
+            while (j + run < 8 && (bool)(line & 0x1) == on) {
+                line >>= 1;
+                run++;
+            }
+
+            if (on || bg != color) {
+                gfx_fill_rect(x + (i * size), y + (j * size), size, run * size,
+                              on ? color : bg);
+            }
+            j += run;
         }
     }
 }
@@ -518,6 +612,7 @@ void gfx_puts(const char *s) {
 void gfx_puts_lag(const char *s, uint32_t delay_ms) {
     while (*s) {
         gfx_write((uint8_t)*s++);
+        gfx_update();
         nrf_delay_ms(delay_ms);
     }
 }
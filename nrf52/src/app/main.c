@@ -29,12 +29,13 @@
 
 #include "application.h"
 #include "cli.h"
+#include "conf_sched.h"
 #include "gfx_effect.h"
 #include "identity.h"
-#include "nsec_conf_schedule.h"
 #include "nsec_settings.h"
 #include "timer.h"
 #include "status_bar.h"
+#include "text_box.h"
 #include "utils.h"
 #include "nsec_led_pattern.h"
 #include "nsec_warning.h"
@@ -48,6 +49,7 @@
 #include "resistance_slideshow.h"
 
 #include "ble/button_service.h"
+#include "ble/upload_service.h"
 #include "ble/ble_device_info.h"
 #include "ble/resistance_bar_beacon.h"
 #include "ble/service_advertiser.h"
@@ -62,11 +64,27 @@
 
 static char g_device_id[10];
 
+/*
+ * Only sync the settings if the fault didn't interrupt a flash command, and
+ * only once: a fault during the sync lands here again.
+ */
+static bool can_sync_settings(void) {
+    static bool sync_attempted = false;
+
+    if (sync_attempted) {
+        return false;
+    }
+    sync_attempted = true;
+
+    return !flash_is_busy();
+}
+
 /*
  * Callback function when APP_ERROR_CHECK() fails
  *
  *  - Display the filename, line number and error code.
  *  - Flash all neopixels red for 5 seconds.
+ *  - Write the pending settings changes.
  *  - Reset the system.
  */
 void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info) {
@@ -99,6 +117,10 @@ void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info) {
         count--;
     }
 
+    if (can_sync_settings()) {
+        persistency_sync();
+    }
+
     NVIC_SystemReset();
 }
 
@@ -116,6 +138,7 @@ static void init_ble() {
     /*nsec_led_ble_init();*/
     init_identity_service();
     init_button_service();
+    init_upload_service();
     nsec_ble_init_device_information_service();
     set_vendor_service_in_advertising_packet(nsec_identity_get_service(), false);
     //set_vendor_service_in_scan_response(nsec_identity_get_service(), true);
@@ -136,6 +159,15 @@ static void main_service_device() {
     battery_status_process();
     mode_zombie_process();
     service_WS2812FX();
+    flash_process();
+    ble_device_process();
+    persistency_process();
+    text_box_process();
+
+#ifdef ST7735_FRAMEBUFFER
+    /* Push whatever the application drew since the last iteration */
+    display_update();
+#endif
 
     /* Wait until next event */
     power_manage();
@@ -171,6 +203,9 @@ int main(void) {
     softdevice_init();
     timer_init();
     flash_init();
+#ifdef NSEC_FLAVOR_CONF
+    conf_sched_init();
+#endif
     init_WS2812FX();
     display_init();
     load_persistency();
@@ -185,8 +220,6 @@ int main(void) {
     // (the CLI takes over the UART, which the flash mode uses).
     cli_init();
 
-    nsec_conf_length_check();
-
     screensaver_init();
 
     init_ble();
@@ -5,6 +5,7 @@
 //  License: MIT (see LICENSE for details)
 
 #include <nordic_common.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "application.h"
@@ -115,6 +116,7 @@ enum schedule_state {
     SCHEDULE_STATE_SPEAKER_DETAILS,
     SCHEDULE_STATE_EVENTS,
     SCHEDULE_STATE_EVENT_DESC,
+    SCHEDULE_STATE_MISSING,
 };
 
 static enum schedule_state schedule_state = SCHEDULE_STATE_CLOSED;
@@ -157,26 +159,59 @@ static void nsec_schedule_return_to_speakers(void)
     menu_ui_redraw_all();
 }
 
-static const struct talk *cur_talks = NULL;
-static int cur_num_talks = 0;
+static struct conf_sched_day cur_day;
 
-static char big_buf[10000];
+/* Menu labels and the text box contents are read from the external flash in
+   here.  The text box copies what it shows, and doesn't take more than
+   2 KiB.  */
+static char big_buf[4096];
 
-static int format_talk_detailed(char *buf, const struct talk *t)
+static const char *missing_schedule =
+    "The schedule is missing from the external flash.";
+
+static void nsec_schedule_show_missing(void)
+{
+    menu_close();
+    gfx_fill_rect(GEN_MENU_POS, GEN_MENU_WIDTH, GEN_MENU_HEIGHT, DISPLAY_WHITE);
+    text_box_init(missing_schedule, &config);
+
+    schedule_state = SCHEDULE_STATE_MISSING;
+}
+
+/* Advance P past the N characters snprintf wanted to write, or to the end of
+   the buffer if they didn't fit.  */
+static char *advance(char *p, char *end, int n)
 {
-    return sprintf(buf, "%s\n%d:%02d to %d:%02d\n%s\n%s\n\n%s", t->title,
-                   t->start_h, t->start_m, t->end_h, t->end_m, tracks[t->track],
-                   t->names, t->abstract);
+    return MIN(p + n, end - 1);
+}
+
+static void format_talk_detailed(char *buf, size_t size,
+                                 const struct conf_sched_talk *t)
+{
+    char *end = buf + size;
+    char *p = buf;
+
+    p += conf_sched_get_string(t->title, p, end - p);
+    p = advance(p, end,
+                snprintf(p, end - p, "\n%d:%02d to %d:%02d\n", t->start / 60,
+                         t->start % 60, t->end / 60, t->end % 60));
+    p += conf_sched_get_track(t->track, p, end - p);
+    p = advance(p, end, snprintf(p, end - p, "\n"));
+    p += conf_sched_get_string(t->names, p, end - p);
+    p = advance(p, end, snprintf(p, end - p, "\n\n"));
+    conf_sched_get_string(t->abstract, p, end - p);
 }
 
 static void nsec_schedule_show_talk_details(uint8_t item)
 {
-    APP_ERROR_CHECK_BOOL(item < cur_num_talks);
+    struct conf_sched_talk t;
+
+    APP_ERROR_CHECK_BOOL(item < cur_day.num_talks);
     menu_close();
 
-    const struct talk *t = &cur_talks[item];
+    APP_ERROR_CHECK(conf_sched_get_talk(cur_day.first_talk + item, &t));
 
-    format_talk_detailed(big_buf, t);
+    format_talk_detailed(big_buf, sizeof(big_buf), &t);
 
     text_box_init(big_buf, &config);
 
@@ -185,59 +220,87 @@ static void nsec_schedule_show_talk_details(uint8_t item)
 
 static menu_item_s generated_menu[50];
 
-static void prep_menu_talks(const struct talk *talks, int num_talks)
+static void prep_menu_talks(void)
 {
     char *p = big_buf;
+    char *end = big_buf + sizeof(big_buf);
+
+    APP_ERROR_CHECK_BOOL(cur_day.num_talks <= ARRAY_SIZE(generated_menu));
+    for (int i = 0; i < cur_day.num_talks; i++) {
+        struct conf_sched_talk t;
 
-    APP_ERROR_CHECK_BOOL(num_talks <= ARRAY_SIZE(generated_menu));
-    for (int i = 0; i < num_talks; i++) {
-        const struct talk *t = &talks[i];
-        int n = sprintf(p, "%d:%02d %s", t->start_h, t->start_m, t->title);
+        APP_ERROR_CHECK(conf_sched_get_talk(cur_day.first_talk + i, &t));
+
+        int n = snprintf(p, end - p, "%d:%02d ", t.start / 60, t.start % 60);
+        APP_ERROR_CHECK_BOOL(n < end - p);
+        n += conf_sched_get_string(t.title, p + n, end - p - n);
         generated_menu[i].label = p;
         generated_menu[i].handler = nsec_schedule_show_talk_details;
         p += n + 1;
-        APP_ERROR_CHECK_BOOL((p - big_buf) < sizeof(big_buf));
+        APP_ERROR_CHECK_BOOL(p < end);
     }
 }
 
 static void nsec_schedule_show_talks(uint8_t item)
 {
-    cur_talks = item == 0 ? talks_16 : talks_17;
-    cur_num_talks = item == 0 ? num_talks_16 : num_talks_17;
+    if (conf_sched_get_day(item, &cur_day) != NRF_SUCCESS) {
+        nsec_schedule_show_missing();
+        return;
+    }
 
-    prep_menu_talks(cur_talks, cur_num_talks);
+    prep_menu_talks();
 
-    menu_init(CONF_POS, CONF_WIDTH, CONF_HEIGHT, cur_num_talks, generated_menu,
-              HOME_MENU_BG_COLOR, DISPLAY_WHITE);
+    menu_init(CONF_POS, CONF_WIDTH, CONF_HEIGHT, cur_day.num_talks,
+              generated_menu, HOME_MENU_BG_COLOR, DISPLAY_WHITE);
 
     schedule_state = SCHEDULE_STATE_TALKS;
 }
 
 static void nsec_schedule_show_speaker_details(uint8_t item)
 {
-    APP_ERROR_CHECK_BOOL(item < num_speakers);
+    struct conf_sched_speaker s;
+
+    APP_ERROR_CHECK_BOOL(item < conf_sched_num_speakers());
     menu_close();
 
-    text_box_init(speakers[item].bio, &config);
+    APP_ERROR_CHECK(conf_sched_get_speaker(item, &s));
+    conf_sched_get_string(s.bio, big_buf, sizeof(big_buf));
+
+    text_box_init(big_buf, &config);
 
     schedule_state = SCHEDULE_STATE_SPEAKER_DETAILS;
 }
 
 static void prep_menu_speakers()
 {
-    APP_ERROR_CHECK_BOOL(num_speakers <= ARRAY_SIZE(generated_menu));
-    for (int i = 0; i < num_speakers; i++) {
-        generated_menu[i].label = speakers[i].name;
+    char *p = big_buf;
+    char *end = big_buf + sizeof(big_buf);
+
+    APP_ERROR_CHECK_BOOL(conf_sched_num_speakers() <=
+                         ARRAY_SIZE(generated_menu));
+    for (int i = 0; i < conf_sched_num_speakers(); i++) {
+        struct conf_sched_speaker s;
+
+        APP_ERROR_CHECK(conf_sched_get_speaker(i, &s));
+
+        generated_menu[i].label = p;
         generated_menu[i].handler = nsec_schedule_show_speaker_details;
+        p += conf_sched_get_string(s.name, p, end - p) + 1;
+        APP_ERROR_CHECK_BOOL(p < end);
     }
 }
 
 void nsec_schedule_show_speakers(uint8_t item)
 {
+    if (conf_sched_num_speakers() == 0) {
+        nsec_schedule_show_missing();
+        return;
+    }
+
     prep_menu_speakers();
 
-    menu_init(CONF_POS, CONF_WIDTH, CONF_HEIGHT, num_speakers, generated_menu,
-              HOME_MENU_BG_COLOR, DISPLAY_WHITE);
+    menu_init(CONF_POS, CONF_WIDTH, CONF_HEIGHT, conf_sched_num_speakers(),
+              generated_menu, HOME_MENU_BG_COLOR, DISPLAY_WHITE);
 
     schedule_state = SCHEDULE_STATE_TALKS;
 }
@@ -277,15 +340,17 @@ static void nsec_schedule_button_handler(button_t button) {
     if(button == BUTTON_BACK) {
         switch (schedule_state) {
         case SCHEDULE_STATE_SPEAKER_DETAILS:
+            prep_menu_speakers();
             nsec_schedule_return_to_speakers();
             break;
         case SCHEDULE_STATE_TALK_DETAILS:
-            prep_menu_talks(cur_talks, cur_num_talks);
+            prep_menu_talks();
             nsec_schedule_return_to_talks();
             break;
         case SCHEDULE_STATE_TALKS:
         case SCHEDULE_STATE_SPEAKERS:
         case SCHEDULE_STATE_EVENTS:
+        case SCHEDULE_STATE_MISSING:
             redraw_home_menu_burger_selected();
             nsec_schedule_show_dates();
             break;
@@ -304,13 +369,3 @@ static void nsec_schedule_button_handler(button_t button) {
         }
     }
 }
-
-// Make sure that all the talk details we can eventually generate fits into the
-// static buffer.
-void nsec_conf_length_check()
-{
-    for (int i = 0; i < num_talks_16; i++) {
-        int n = format_talk_detailed(big_buf, &talks_16[i]);
-        APP_ERROR_CHECK_BOOL(n < sizeof(big_buf));
-    }
-}
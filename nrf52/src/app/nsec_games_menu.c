@@ -10,6 +10,7 @@
 #include "drivers/controls.h"
 #include "drivers/display.h"
 
+#include "app_3d.h"
 #include "application.h"
 #include "game_mines.h"
 #include "game_snake.h"
@@ -37,12 +38,22 @@ void nsec_games_start_mindsweeper_application(uint8_t item)
     application_set(&mines_application);
 }
 
+void nsec_games_open_3d_menu(uint8_t item)
+{
+    menu_close();
+    nsec_controls_suspend_handler(nsec_games_menu_button_handler);
+
+    app_3d_menu_show();
+}
+
 static menu_item_s nsec_games_menu_items[] = {
     {.label = "Cortex viper",
      .handler = nsec_games_start_cortexviper_application},
 
     {.label = "Mindsweeper",
-     .handler = nsec_games_start_mindsweeper_application}};
+     .handler = nsec_games_start_mindsweeper_application},
+
+    {.label = "3D meshes", .handler = nsec_games_open_3d_menu}};
 
 static void draw_games_title(void)
 {
@@ -11,6 +11,7 @@
 
 #include <string.h>
 #include <app_timer.h>
+#include <app_util_platform.h>
 
 #include "ble/abstract_ble_observer.h"
 #include "ble/ble_device.h"
@@ -20,88 +21,148 @@ static const uint32_t colors[15] = {0x00FF00, 0x24FF00, 0x48FF00, 0x6DFF00,
                                     0xFFDA00, 0xFFB600, 0xFF9100, 0xFF6D00,
                                     0xFF4800, 0xFF2400, 0xFF0000};
 
-static struct {
+/*
+ * The badges seen recently live in a pool, indexed by a hash table with linear
+ * probing on their address.  Each one is also linked in the bucket of a timing
+ * wheel for the second at which it expires, so the 1 second tick only looks
+ * at the badges that actually expire.
+ */
+#define NEARBY_TIMEOUT_SEC 60
+#define NEARBY_HASH_SIZE 128 // Power of 2, about twice the pool
+#define NEARBY_WHEEL_SIZE 64 // Power of 2, more than NEARBY_TIMEOUT_SEC
+#define NEARBY_NONE 0xFF
+
+struct nearby_badge {
     uint8_t addr[BLE_GAP_ADDR_LEN];
-    uint8_t timeout_in_sec;
-} _nearby_badges[NSEC_MAX_NEARBY_BADGES_COUNT];
+    int8_t rssi[NSEC_NEARBY_RSSI_HISTORY];
+    uint8_t rssi_idx;
+    uint8_t rssi_count;
+    // Second (modulo 256) at which the badge is forgotten
+    uint8_t expiry;
+    // Links in the wheel bucket, or in the free list for next
+    uint8_t prev, next;
+};
 
-typedef struct
-{
-    uint8_t * p_data;
-    uint16_t  data_len;
-} data_t;
+static struct nearby_badge _nearby_badges[NSEC_MAX_NEARBY_BADGES_COUNT];
+static uint8_t _nearby_hash[NEARBY_HASH_SIZE];
+static uint8_t _nearby_wheel[NEARBY_WHEEL_SIZE];
+static uint8_t _nearby_free;
+static uint8_t _nearby_count;
+static uint8_t _nearby_now;
+
+static uint8_t nearby_hash(const uint8_t addr[]) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint8_t i = 0; i < BLE_GAP_ADDR_LEN; i++) {
+        hash = (hash ^ addr[i]) * 16777619u;
+    }
+    return hash & (NEARBY_HASH_SIZE - 1);
+}
 
-APP_TIMER_DEF(m_nearby_timer);
+// Return the hash slot of ADDR, or the empty slot where it would go.
+static uint8_t nearby_lookup(const uint8_t addr[]) {
+    uint8_t slot = nearby_hash(addr);
 
-static void nsec_nearby_badges_process(uint8_t badge_addr[]) {
-    for(uint8_t i = 0; i < NSEC_MAX_NEARBY_BADGES_COUNT; i++) {
-        if(!memcmp(_nearby_badges[i].addr, badge_addr, BLE_GAP_ADDR_LEN)) {
-            _nearby_badges[i].timeout_in_sec = 60;
-            return;
-        }
+    while (_nearby_hash[slot] != NEARBY_NONE &&
+           memcmp(_nearby_badges[_nearby_hash[slot]].addr, addr,
+                  BLE_GAP_ADDR_LEN)) {
+        slot = (slot + 1) & (NEARBY_HASH_SIZE - 1);
     }
-    // New badge \o/
-    for(uint8_t i = 0; i < NSEC_MAX_NEARBY_BADGES_COUNT; i++) {
-        if(_nearby_badges[i].timeout_in_sec == 0) {
-            memcpy(_nearby_badges[i].addr, badge_addr, BLE_GAP_ADDR_LEN);
-            _nearby_badges[i].timeout_in_sec = 60;
+    return slot;
+}
+
+// Empty SLOT, moving back the following entries so that lookups still find
+// them without tombstones.
+static void nearby_hash_remove(uint8_t slot) {
+    uint8_t next = slot;
+
+    while (true) {
+        next = (next + 1) & (NEARBY_HASH_SIZE - 1);
+        if (_nearby_hash[next] == NEARBY_NONE) {
             break;
         }
+
+        uint8_t home = nearby_hash(_nearby_badges[_nearby_hash[next]].addr);
+        // Can the entry at NEXT be moved to SLOT without going before home?
+        if (((next - home) & (NEARBY_HASH_SIZE - 1)) >=
+            ((next - slot) & (NEARBY_HASH_SIZE - 1))) {
+            _nearby_hash[slot] = _nearby_hash[next];
+            slot = next;
+        }
     }
+    _nearby_hash[slot] = NEARBY_NONE;
 }
 
-static uint32_t adv_report_parse(uint8_t type, data_t * p_advdata, data_t * p_typedata)
-{
-    uint32_t  index = 0;
-    uint8_t * p_data;
-
-    p_data = p_advdata->p_data;
+static void nearby_wheel_unlink(uint8_t idx) {
+    struct nearby_badge *badge = &_nearby_badges[idx];
 
-    while (index < p_advdata->data_len)
-    {
-        uint8_t field_length = p_data[index];
-        uint8_t field_type   = p_data[index + 1];
-
-        if (field_type == type)
-        {
-            p_typedata->p_data   = &p_data[index + 2];
-            p_typedata->data_len = field_length - 1;
-            return NRF_SUCCESS;
-        }
-        index += field_length + 1;
+    if (badge->prev != NEARBY_NONE) {
+        _nearby_badges[badge->prev].next = badge->next;
+    } else {
+        _nearby_wheel[badge->expiry & (NEARBY_WHEEL_SIZE - 1)] = badge->next;
+    }
+    if (badge->next != NEARBY_NONE) {
+        _nearby_badges[badge->next].prev = badge->prev;
     }
-    return NRF_ERROR_NOT_FOUND;
 }
 
-static void on_advertising_report(const ble_gap_evt_adv_report_t* report) {
-    if (getMode_WS2812FX() != FX_MODE_CUSTOM) {
-        return;
+static void nearby_wheel_link(uint8_t idx) {
+    struct nearby_badge *badge = &_nearby_badges[idx];
+    uint8_t *head = &_nearby_wheel[badge->expiry & (NEARBY_WHEEL_SIZE - 1)];
+
+    badge->prev = NEARBY_NONE;
+    badge->next = *head;
+    if (*head != NEARBY_NONE) {
+        _nearby_badges[*head].prev = idx;
     }
+    *head = idx;
+}
 
-    if(report->scan_rsp == 0) {
-        data_t adv_data;
-        data_t dev_name;
-        uint8_t data[32];
-        uint8_t addr[BLE_GAP_ADDR_LEN];
-        char dev_str[32];
+static void nsec_nearby_badges_process(const uint8_t badge_addr[], int8_t rssi) {
+    CRITICAL_REGION_ENTER();
 
-        memcpy(addr, report->peer_addr.addr, BLE_GAP_ADDR_LEN);
-        memcpy(data, report->data, BLE_GAP_ADV_MAX_SIZE);
-        adv_data.p_data = data;
-        adv_data.data_len = report->dlen;
+    uint8_t slot = nearby_lookup(badge_addr);
+    uint8_t idx = _nearby_hash[slot];
 
-        if (adv_report_parse(BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, &adv_data, &dev_name) != NRF_SUCCESS) {
-            if (adv_report_parse(BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME, &adv_data, &dev_name) != NRF_SUCCESS) {
-                return;
-            }
-        }
+    if (idx != NEARBY_NONE) {
+        nearby_wheel_unlink(idx);
+    } else if (_nearby_free != NEARBY_NONE) {
+        // New badge \o/
+        idx = _nearby_free;
+        _nearby_free = _nearby_badges[idx].next;
+        _nearby_hash[slot] = idx;
+        _nearby_count++;
+
+        memcpy(_nearby_badges[idx].addr, badge_addr, BLE_GAP_ADDR_LEN);
+        _nearby_badges[idx].rssi_idx = 0;
+        _nearby_badges[idx].rssi_count = 0;
+    }
+
+    if (idx != NEARBY_NONE) {
+        struct nearby_badge *badge = &_nearby_badges[idx];
 
-        if (strncmp((char*)dev_name.p_data, "NSEC", 4)) {
-                return;
+        badge->rssi[badge->rssi_idx] = rssi;
+        badge->rssi_idx = (badge->rssi_idx + 1) % NSEC_NEARBY_RSSI_HISTORY;
+        if (badge->rssi_count < NSEC_NEARBY_RSSI_HISTORY) {
+            badge->rssi_count++;
         }
 
-        nsec_nearby_badges_process(addr);
+        badge->expiry = _nearby_now + NEARBY_TIMEOUT_SEC;
+        nearby_wheel_link(idx);
     }
+
+    CRITICAL_REGION_EXIT();
+}
+
+APP_TIMER_DEF(m_nearby_timer);
+
+static void on_advertising_report(const struct AdvReport* report) {
+    if (getMode_WS2812FX() != FX_MODE_CUSTOM) {
+        return;
+    }
+
+    nsec_nearby_badges_process(report->report->peer_addr.addr,
+                               report->report->rssi);
 }
 
 static void on_scan_timeout(const ble_gap_evt_timeout_t* timeout_event) {
@@ -112,24 +173,61 @@ static void on_scan_timeout(const ble_gap_evt_timeout_t* timeout_event) {
 static struct BleObserver nearby_badge_observer = {
     &on_advertising_report,
     &on_scan_timeout,
+    {
+        .match = BLE_OBSERVER_FILTER_NO_SCAN_RSP |
+                 BLE_OBSERVER_FILTER_NAME_PREFIX,
+        .name_prefix = "NSEC",
+    },
 };
 
 static void nsec_nearby_each_second(void * context) {
-    for(uint8_t i = 0; i < NSEC_MAX_NEARBY_BADGES_COUNT; i++) {
-        if(_nearby_badges[i].timeout_in_sec > 0) {
-            _nearby_badges[i].timeout_in_sec--;
-        }
+    CRITICAL_REGION_ENTER();
+
+    _nearby_now++;
+
+    uint8_t *head = &_nearby_wheel[_nearby_now & (NEARBY_WHEEL_SIZE - 1)];
+    while (*head != NEARBY_NONE) {
+        uint8_t idx = *head;
+
+        *head = _nearby_badges[idx].next;
+        nearby_hash_remove(nearby_lookup(_nearby_badges[idx].addr));
+
+        _nearby_badges[idx].next = _nearby_free;
+        _nearby_free = idx;
+        _nearby_count--;
     }
+
+    CRITICAL_REGION_EXIT();
 }
 
 uint8_t nsec_nearby_badges_current_count(void) {
-    uint8_t count = 0;
-    for(uint8_t i = 0; i < NSEC_MAX_NEARBY_BADGES_COUNT; i++) {
-        if(_nearby_badges[i].timeout_in_sec > 0) {
-            count++;
+    return _nearby_count;
+}
+
+/*
+ * Average RSSI of the last few advertisements of a nearby badge.  Return false
+ * if the badge isn't nearby.
+ */
+bool nsec_nearby_badges_rssi(const uint8_t addr[], int8_t *rssi) {
+    bool found = false;
+
+    CRITICAL_REGION_ENTER();
+
+    uint8_t idx = _nearby_hash[nearby_lookup(addr)];
+    if (idx != NEARBY_NONE) {
+        const struct nearby_badge *badge = &_nearby_badges[idx];
+        int16_t sum = 0;
+
+        for (uint8_t i = 0; i < badge->rssi_count; i++) {
+            sum += badge->rssi[i];
         }
+        *rssi = sum / badge->rssi_count;
+        found = true;
     }
-    return count;
+
+    CRITICAL_REGION_EXIT();
+
+    return found;
 }
 
 uint16_t nsec_nearby_badges_pattern(void) {
@@ -195,7 +293,14 @@ void nsec_nearby_badges_init(void)
                                     nsec_nearby_each_second);
         APP_ERROR_CHECK(err_code);
 
-        memset(_nearby_badges, 0, sizeof(_nearby_badges));
+        memset(_nearby_hash, NEARBY_NONE, sizeof(_nearby_hash));
+        memset(_nearby_wheel, NEARBY_NONE, sizeof(_nearby_wheel));
+        for (uint8_t i = 0; i < NSEC_MAX_NEARBY_BADGES_COUNT; i++) {
+            _nearby_badges[i].next = i + 1;
+        }
+        _nearby_badges[NSEC_MAX_NEARBY_BADGES_COUNT - 1].next = NEARBY_NONE;
+        _nearby_free = 0;
+        _nearby_count = 0;
         err_code = app_timer_start(m_nearby_timer, APP_TIMER_TICKS(1000), NULL);
         APP_ERROR_CHECK(err_code);
     }
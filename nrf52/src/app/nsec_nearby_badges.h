@@ -7,11 +7,15 @@
 #ifndef nsec_nearby_badges_h
 #define nsec_nearby_badges_h
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define NSEC_MAX_NEARBY_BADGES_COUNT (55)
+#define NSEC_NEARBY_RSSI_HISTORY (4)
 
 void select_nearby_badges_pattern(void);
 void nsec_nearby_badges_init(void);
+uint8_t nsec_nearby_badges_current_count(void);
+bool nsec_nearby_badges_rssi(const uint8_t addr[], int8_t *rssi);
 
 #endif /* nsec_nearby_badges_h */
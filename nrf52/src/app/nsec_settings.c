@@ -120,6 +120,7 @@ static void confirm_factory_reset(uint8_t item)
 
         // Not neccessary but it make it more... serious ???
         nrf_delay_ms(2000);
+        persistency_sync();
         NVIC_SystemReset();
     } else {
         gfx_puts("Okay...");
@@ -24,12 +24,15 @@
 
 // Standard includes.
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
 // Includes from Nordic.
+#include <app_timer.h>
 #include <crc32.h>
 #include <app_util_platform.h>
+#include <nordic_common.h>
 
 // Includes from our code.
 #include <drivers/display.h>
@@ -37,9 +40,32 @@
 #include <drivers/ws2812fx.h>
 #include "nsec_led_settings.h"
 
-#define PERSISTENCY_BASE_ADDRESS 0x07F000
-#define PERSISTENCY_SIZE 4096
-#define PERSISTENCY_REVISION 1
+/*
+ * The settings are kept in a log spread over the last PERSISTENCY_SECTORS
+ * sectors of the external flash.  The active sector starts with a header, then
+ * holds records, each one overwriting a range of bytes of struct persistency.
+ * The first record of a sector is always a full snapshot, so replaying the
+ * active sector alone rebuilds the settings.
+ *
+ * A change appends a record for the bytes that differ from what is in flash.
+ * When the active sector is full, a snapshot is written to the next one, which
+ * becomes active.  Sectors are thus erased in turn, once per few hundreds of
+ * changes.
+ */
+#define PERSISTENCY_BASE_ADDRESS 0x07C000
+#define PERSISTENCY_SECTORS 4
+#define PERSISTENCY_SECTOR_SIZE 4096
+#define PERSISTENCY_REVISION 2
+#define PERSISTENCY_MAGIC 0x4E534543
+
+// Revision 1 kept the settings in a single 4 KiB record, in what is now the
+// last log sector.  It is migrated on the first boot, see migrate_persistency.
+#define PERSISTENCY_V1_ADDRESS 0x07F000
+#define PERSISTENCY_V1_SIZE 4096
+#define PERSISTENCY_V1_REVISION 1
+
+// Changes are written at most this long after the first one.
+#define PERSISTENCY_FLUSH_DELAY 5000 /* ms */
 
 /* Led settings  303 bytes*/
 struct led_settings {
@@ -58,32 +84,375 @@ struct persistency {
     uint8_t display_model;              // 1 byte
     uint8_t screensaver;                // 1 byte
     uint8_t ble_enable;                 // 1 byte
-    uint8_t padding[4096 - 332 - 5];    // 4k - (used memory) - rev - CRC
-    uint8_t revision;
-    uint32_t crc; // 4 bytes
 }__attribute__((packed));
 
-// Static assert to make sure the size of struct persistency is as expected.
-static int persistency_size_static[(sizeof(struct persistency) == 4096) ? 1 : -1] __attribute__((unused));
-
-static uint8_t persistency_bin[4096];
+struct sector_header {
+    uint32_t magic;
+    // The active sector is the valid one with the highest sequence.
+    uint32_t sequence;
+    uint32_t revision;
+};
+
+struct record_header {
+    uint16_t offset;
+    uint16_t len;
+    // CRC of offset, len and the data.
+    uint32_t crc;
+};
+
+// Two records whose ranges are closer than this are merged in a single one.
+#define RECORD_MERGE_GAP sizeof(struct record_header)
+
+// Static assert to make sure a snapshot fits in a sector.
+static int persistency_size_static[(sizeof(struct sector_header) +
+                                    sizeof(struct record_header) +
+                                    sizeof(struct persistency) <=
+                                    PERSISTENCY_SECTOR_SIZE) ? 1 : -1] __attribute__((unused));
+
+static uint8_t persistency_bin[sizeof(struct persistency)];
 static struct persistency *persistency = (struct persistency*)persistency_bin;
 static bool is_loaded = false;
 
+// What the log in flash currently holds.
+static uint8_t persistency_flash[sizeof(struct persistency)];
+// Active sector, its sequence, and where the next record goes in it.
+static int active_sector = PERSISTENCY_SECTORS - 1;
+static uint32_t active_sequence = 0;
+static uint32_t log_offset = PERSISTENCY_SECTOR_SIZE;
+
+// Records of a flush, written to the log in a single go.  Two records are at
+// least RECORD_MERGE_GAP bytes apart, so their headers take less room than the
+// settings themselves.
+static uint8_t log_buffer[2 * sizeof(struct persistency) +
+                          sizeof(struct record_header)];
+static uint16_t log_buffer_len = 0;
+// Header of the sector being started by compact_persistency.
+static struct sector_header active_header;
+// log_buffer and active_header belong to the flash queue until this clears.
+static bool write_pending = false;
+
+APP_TIMER_DEF(m_flush_timer_id);
+// Some settings changed since they were last written.
+static bool is_dirty = false;
+// The flush timer fired, persistency_process has to write them.
+static volatile bool flush_requested = false;
+
+static uint32_t sector_address(int sector)
+{
+    return PERSISTENCY_BASE_ADDRESS + sector * PERSISTENCY_SECTOR_SIZE;
+}
+
+static uint32_t record_crc(const struct record_header *header,
+                           const uint8_t *data)
+{
+    uint32_t crc = crc32_compute((const uint8_t *) header,
+                                 offsetof(struct record_header, crc), NULL);
+
+    return crc32_compute(data, header->len, &crc);
+}
+
+static void flash_checked(ret_code_t result, void *context)
+{
+    APP_ERROR_CHECK(result);
+}
+
+static void write_done(ret_code_t result, void *context)
+{
+    APP_ERROR_CHECK(result);
+    write_pending = false;
+}
+
+// Add a record to log_buffer.  It lands in flash at log_offset once the
+// buffer is written.
+static void stage_record(uint16_t offset, uint16_t len)
+{
+    struct record_header header = {
+        .offset = offset,
+        .len = len,
+    };
+
+    header.crc = record_crc(&header, persistency_bin + offset);
+
+    // If the data doesn't make it, the CRC won't match and the replay stops
+    // there.
+    memcpy(log_buffer + log_buffer_len, &header, sizeof(header));
+    memcpy(log_buffer + log_buffer_len + sizeof(header),
+           persistency_bin + offset, len);
+    log_buffer_len += sizeof(header) + len;
+
+    memcpy(persistency_flash + offset, persistency_bin + offset, len);
+    log_offset += sizeof(header) + len;
+}
+
+// Start a new sector with a snapshot of the current settings.
+static void compact_persistency(void)
+{
+    int sector = (active_sector + 1) % PERSISTENCY_SECTORS;
+    ret_code_t ret;
+
+    active_header.magic = PERSISTENCY_MAGIC;
+    active_header.sequence = active_sequence + 1;
+    active_header.revision = PERSISTENCY_REVISION;
+
+    active_sector = sector;
+    active_sequence = active_header.sequence;
+    log_offset = sizeof(active_header);
+    log_buffer_len = 0;
+    stage_record(0, sizeof(struct persistency));
+
+    // The queue keeps the order: the header goes last, the sector is only
+    // valid once the snapshot is.
+    write_pending = true;
+    ret = flash_erase_async(sector_address(sector), flash_checked, NULL);
+    APP_ERROR_CHECK(ret);
+    ret = flash_write_async(sector_address(sector) + sizeof(active_header),
+                            log_buffer, log_buffer_len, flash_checked, NULL);
+    APP_ERROR_CHECK(ret);
+    ret = flash_write_async(sector_address(sector),
+                            (const uint8_t *) &active_header,
+                            sizeof(active_header), write_done, NULL);
+    APP_ERROR_CHECK(ret);
+}
+
+static void write_persistency(void)
+{
+    uint32_t address = sector_address(active_sector) + log_offset;
+    uint16_t i = 0;
+
+    log_buffer_len = 0;
+
+    while (i < sizeof(struct persistency)) {
+        if (persistency_bin[i] == persistency_flash[i]) {
+            i++;
+            continue;
+        }
+
+        // Extend the range over the next differences, unless they are far.
+        uint16_t start = i;
+        uint16_t end = i + 1;
+        for (uint16_t j = end; j < sizeof(struct persistency) &&
+                               j < end + RECORD_MERGE_GAP; j++) {
+            if (persistency_bin[j] != persistency_flash[j]) {
+                end = j + 1;
+            }
+        }
+
+        uint16_t len = end - start;
+        if (log_offset + sizeof(struct record_header) + len >
+            PERSISTENCY_SECTOR_SIZE) {
+            // The snapshot includes this change and all the following ones.
+            compact_persistency();
+            return;
+        }
+
+        stage_record(start, len);
+        i = end;
+    }
+
+    if (log_buffer_len == 0) {
+        return;
+    }
+
+    write_pending = true;
+    ret_code_t ret = flash_write_async(address, log_buffer, log_buffer_len,
+                                       write_done, NULL);
+    APP_ERROR_CHECK(ret);
+}
+
+static void flush_timer_handler(void *p_context)
+{
+    flush_requested = true;
+}
+
+static void start_flush_timer(void)
+{
+    ret_code_t ret = app_timer_start(
+        m_flush_timer_id, APP_TIMER_TICKS(PERSISTENCY_FLUSH_DELAY), NULL);
+    APP_ERROR_CHECK(ret);
+}
+
+/*
+ * Mark the settings as changed.  They are written by persistency_process once
+ * the flush delay expires, so a burst of changes costs a single write.
+ */
 void update_persistency(void)
 {
-    persistency->crc = crc32_compute(persistency_bin, 4092, NULL);
+    if (is_dirty) {
+        return;
+    }
+
+    is_dirty = true;
+
+    // Before load_persistency, the log isn't replayed yet and writing would
+    // start from a wrong sector and offset.  load_persistency starts the
+    // flush timer instead.
+    if (!is_loaded) {
+        return;
+    }
 
-    ret_code_t ret = flash_erase(PERSISTENCY_BASE_ADDRESS);
+    start_flush_timer();
+}
+
+/*
+ * Write the pending changes right away and wait for the flash, for example
+ * before a reset.
+ */
+void persistency_sync(void)
+{
+    flush_requested = false;
+
+    // Nothing can be written until the log is replayed.
+    if (is_dirty && is_loaded) {
+        app_timer_stop(m_flush_timer_id);
+
+        // log_buffer may still be in use by the previous write.
+        APP_ERROR_CHECK(flash_flush());
+
+        is_dirty = false;
+        write_persistency();
+    }
+
+    APP_ERROR_CHECK(flash_flush());
+}
+
+/*
+ * Queue the pending changes once the flush delay expired.  The flash queue
+ * writes them in the background, a change made meanwhile waits for the
+ * next flush.
+ */
+void persistency_process(void)
+{
+    if (!flush_requested || write_pending) {
+        return;
+    }
+
+    flush_requested = false;
+
+    if (is_dirty) {
+        is_dirty = false;
+        write_persistency();
+    }
+}
+
+#ifndef SOLDERING_TRACK
+// Replay the log of the active sector, return false if there is none.
+static bool replay_persistency(void)
+{
+    struct sector_header header;
+    ret_code_t ret;
+
+    active_sequence = 0;
+
+    for (int sector = 0; sector < PERSISTENCY_SECTORS; sector++) {
+        ret = flash_read(sector_address(sector), (uint8_t *) &header,
+                         sizeof(header));
+        APP_ERROR_CHECK(ret);
+
+        if (header.magic == PERSISTENCY_MAGIC &&
+            header.revision == PERSISTENCY_REVISION &&
+            header.sequence > active_sequence) {
+            active_sector = sector;
+            active_sequence = header.sequence;
+        }
+    }
+
+    if (active_sequence == 0) {
+        return false;
+    }
+
+    log_offset = sizeof(header);
+    while (log_offset + sizeof(struct record_header) <=
+           PERSISTENCY_SECTOR_SIZE) {
+        struct record_header record;
+        uint32_t address = sector_address(active_sector) + log_offset;
+
+        ret = flash_read(address, (uint8_t *) &record, sizeof(record));
+        APP_ERROR_CHECK(ret);
+
+        if (record.offset == 0xFFFF && record.len == 0xFFFF) {
+            // End of the log.
+            return true;
+        }
+
+        if (record.offset + record.len > sizeof(struct persistency) ||
+            log_offset + sizeof(record) + record.len >
+                PERSISTENCY_SECTOR_SIZE) {
+            break;
+        }
+
+        // Read in place, and put back what was there if it's corrupted.
+        ret = flash_read(address + sizeof(record),
+                         persistency_bin + record.offset, record.len);
+        APP_ERROR_CHECK(ret);
+
+        if (record_crc(&record, persistency_bin + record.offset) !=
+            record.crc) {
+            memcpy(persistency_bin + record.offset,
+                   persistency_flash + record.offset, record.len);
+            break;
+        }
+
+        memcpy(persistency_flash + record.offset,
+               persistency_bin + record.offset, record.len);
+        log_offset += sizeof(record) + record.len;
+    }
+
+    // A torn or corrupted record: never append after it, the next change
+    // starts a new sector.
+    log_offset = PERSISTENCY_SECTOR_SIZE;
+
+    return true;
+}
+
+/*
+ * Load the settings of a revision 1 record, return false if there is no valid
+ * one.  Its fields are those of struct persistency, followed by padding, the
+ * revision byte and a CRC of everything before it.  The first snapshot goes
+ * to sector 0, so the record stays intact until the log wraps around.
+ */
+static bool migrate_persistency(void)
+{
+    uint8_t chunk[64];
+    uint8_t revision = 0;
+    uint32_t crc;
+    uint32_t stored_crc;
+    ret_code_t ret;
+
+    ret = flash_read(PERSISTENCY_V1_ADDRESS, persistency_bin,
+                     sizeof(struct persistency));
     APP_ERROR_CHECK(ret);
+    crc = crc32_compute(persistency_bin, sizeof(struct persistency), NULL);
 
-    for (int i = 0; i < PERSISTENCY_SIZE/128; i++) {
-        int offset = i * 128;
-        ret = flash_write_128(PERSISTENCY_BASE_ADDRESS + offset,
-            persistency_bin + offset);
+    // The rest is only needed for the CRC, the last chunk ends on the
+    // revision byte.
+    uint32_t offset = sizeof(struct persistency);
+    while (offset < PERSISTENCY_V1_SIZE - sizeof(stored_crc)) {
+        uint32_t len = MIN(sizeof(chunk),
+                           PERSISTENCY_V1_SIZE - sizeof(stored_crc) - offset);
+
+        ret = flash_read(PERSISTENCY_V1_ADDRESS + offset, chunk, len);
         APP_ERROR_CHECK(ret);
+        crc = crc32_compute(chunk, len, &crc);
+        revision = chunk[len - 1];
+        offset += len;
     }
+
+    ret = flash_read(PERSISTENCY_V1_ADDRESS + offset, (uint8_t *) &stored_crc,
+                     sizeof(stored_crc));
+    APP_ERROR_CHECK(ret);
+
+    // An erased sector fails the CRC check.
+    if (crc != stored_crc || revision != PERSISTENCY_V1_REVISION) {
+        memset(persistency_bin, 0, sizeof(struct persistency));
+        return false;
+    }
+
+    APP_ERROR_CHECK(flash_flush());
+    compact_persistency();
+
+    return true;
 }
+#endif
 
 static void set_default_led_settings(void)
 {
@@ -105,7 +474,7 @@ static void set_default_led_settings(void)
 
 void set_default_persistency(void)
 {
-    memset(persistency_bin, 0, 4096);
+    memset(persistency_bin, 0, sizeof(struct persistency));
 
     // Add here default config for your data
     persistency->zombie_odds_modifier = 0;
@@ -113,7 +482,6 @@ void set_default_persistency(void)
     persistency->display_model = 0;
     persistency->unlocked_pattern_bf = 0;
     persistency->ble_enable = true;
-    persistency->revision = PERSISTENCY_REVISION;
     persistency->screensaver = 2;
 
     snprintf(persistency->identity_name, 16, "Citizen #%02ld",
@@ -121,7 +489,15 @@ void set_default_persistency(void)
 
     set_default_led_settings();
 
-    update_persistency();
+    // Pending changes are overwritten anyway.
+    if (is_loaded) {
+        app_timer_stop(m_flush_timer_id);
+    }
+    is_dirty = false;
+    flush_requested = false;
+
+    APP_ERROR_CHECK(flash_flush());
+    compact_persistency();
 }
 
 /* MODE ZOMBIE */
@@ -340,46 +716,37 @@ bool get_stored_ble_is_enabled(void)
 
 #ifndef SOLDERING_TRACK
 void load_persistency(void) {
-    uint8_t data[128];
-    ret_code_t ret;
-
-    memset(persistency_bin, 0, sizeof(struct persistency));
-
     if (is_loaded) {
         return;
     }
 
-    for (int i = 0; i < PERSISTENCY_SIZE/128; i++) {
-        int offset = i * 128;
-        memset(data, 0, 128);
-        ret = flash_read_128(PERSISTENCY_BASE_ADDRESS + offset, data);
-        APP_ERROR_CHECK(ret);
+    ret_code_t ret = app_timer_create(&m_flush_timer_id,
+                                      APP_TIMER_MODE_SINGLE_SHOT,
+                                      flush_timer_handler);
+    APP_ERROR_CHECK(ret);
 
-        memcpy(persistency_bin + offset, data, 128);
-    }
+    memset(persistency_bin, 0, sizeof(struct persistency));
+    memset(persistency_flash, 0, sizeof(struct persistency));
 
-    if (persistency->crc == 0xFFFFFFFF) {
+    if (!replay_persistency() && !migrate_persistency()) {
         // *probably* an empty persistency
         set_default_persistency();
         is_loaded = true;
         return;
     }
 
-    uint32_t c_crc = crc32_compute(persistency_bin, 4092, NULL);
-    if (c_crc != persistency->crc) {
-        set_default_persistency();
-    }
-
-    if (persistency->revision != PERSISTENCY_REVISION) {
-        set_default_persistency();
-    }
-
     load_led_settings();
     display_set_brightness(persistency->display_brightness);
     display_set_model(persistency->display_model);
 
     is_loaded = true;
 
+    // update_persistency didn't start the flush timer for changes made
+    // before the replay, and won't while is_dirty is set.
+    if (is_dirty) {
+        start_flush_timer();
+    }
+
     return;
 }
 #else
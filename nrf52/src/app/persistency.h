@@ -29,6 +29,8 @@
 
 void load_persistency(void);
 void update_persistency(void);
+void persistency_sync(void);
+void persistency_process(void);
 void set_default_persistency(void);
 
 uint32_t get_persist_zombie_odds_modifier(void);
@@ -13,7 +13,7 @@
 #include <string.h>
 
 
-static void on_advertising_report(const ble_gap_evt_adv_report_t* report);
+static void on_advertising_report(const struct AdvReport* report);
 
 static void on_scan_timeout(const ble_gap_evt_timeout_t* timeout_event);
 
@@ -26,18 +26,14 @@ static uint8_t adv_evt_received = 0;
 static struct BleObserver resistance_propaganda_observer = {
     &on_advertising_report,
     &on_scan_timeout,
+    {
+        .match = BLE_OBSERVER_FILTER_NO_SCAN_RSP | BLE_OBSERVER_FILTER_ADV_TYPE |
+                 BLE_OBSERVER_FILTER_COMPANY_ID,
+        .adv_type = BLE_GAP_ADV_TYPE_ADV_NONCONN_IND,
+        .company_id = 0x1234,
+    },
 };
 
-struct ParsedField {
-    uint8_t data_length;
-    uint8_t type;
-    const uint8_t* data;
-    uint8_t full_field_length;
-};
-
-static void parse_field(const uint8_t* raw_data, struct ParsedField* parsed_field);
-static bool parse_scan_response_data(const uint8_t*, uint8_t, struct ParsedField*, struct ParsedField*, struct ParsedField*);
-
 
 void init_resistance_propaganda_observer(){
 
@@ -47,25 +43,11 @@ struct BleObserver* get_resistance_propaganda_observer(){
     return &resistance_propaganda_observer;
 }
 
-static void on_advertising_report(const ble_gap_evt_adv_report_t* report) {
-    char message[32];
-    if(report->scan_rsp == 0 && report->type == BLE_GAP_ADV_TYPE_ADV_NONCONN_IND){
-        struct ParsedField flags;
-        struct ParsedField manufacturer_specific_data;
-        struct ParsedField complete_local_name;
-        bool success = parse_scan_response_data(report->data, report->dlen, &flags, &manufacturer_specific_data,
-            &complete_local_name);
-        if (success) {
-            if (flags.type == BLE_GAP_AD_TYPE_FLAGS &&
-                    manufacturer_specific_data.type == BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA &&
-                    complete_local_name.type == BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME) {
-
-                uint16_t manufacturer_id = *((uint16_t*)manufacturer_specific_data.data);
-                if(manufacturer_id == 0x1234) {
-                    on_valid_packet_received(report);
-                }
-            }
-        }
+static void on_advertising_report(const struct AdvReport* report) {
+    // The beacon sends exactly the flags, manufacturer data and complete name.
+    if (report->well_formed && report->field_count == 3 && report->flags.data != NULL &&
+            report->name_complete) {
+        on_valid_packet_received(report->report);
     }
 }
 
@@ -87,34 +69,3 @@ static void on_valid_packet_received(const ble_gap_evt_adv_report_t* report){
 static void on_scan_timeout(const ble_gap_evt_timeout_t* timeout_event){
 
 }
-
-static bool parse_scan_response_data(const uint8_t* raw_data, uint8_t data_length, struct ParsedField* flags,
-        struct ParsedField* manufacturer_specific_data, struct ParsedField* complete_local_name) {
-    uint16_t offset = 0;
-    parse_field(raw_data, flags);
-    offset = flags->full_field_length;
-    if(offset >= data_length)
-        return false;
-    parse_field(raw_data + offset, manufacturer_specific_data);
-    offset += manufacturer_specific_data->full_field_length;
-    if(offset >= data_length)
-        return false;
-    parse_field(raw_data + offset, complete_local_name);
-    offset += complete_local_name->full_field_length;
-    if(data_length != offset)
-        return false;
-    return true;
-}
-
-/**
- * BLE advertising data is separated into fields, with the following format:
- *     length of the field, excluding this byte, but including the type (1 byte)
- *     type of the field (1 byte)
- *     data for the field (length - 1 bytes)
- */
-static void parse_field(const uint8_t* raw_data, struct ParsedField* parsed_field){
-    parsed_field->data_length = raw_data[0] - sizeof(parsed_field->type);
-    parsed_field->type = raw_data[1];
-    parsed_field->data = raw_data + 2;
-    parsed_field->full_field_length = raw_data[0] + sizeof(raw_data[0]);
-}
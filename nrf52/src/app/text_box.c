@@ -25,8 +25,13 @@
 // Standard includes.
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+// Nordic includes.
+#include <app_timer.h>
+#include <nordic_common.h>
+
 // Includes from our code.
 #include "drivers/controls.h"
 #include "drivers/display.h"
@@ -37,151 +42,232 @@
 #define MAX_LINE 250
 #define MAX_TEXT_LENGHT 2048
 
+// While UP or DOWN is held, scroll one line every interval after the delay.
+#define TEXT_BOX_REPEAT_DELAY 400
+#define TEXT_BOX_REPEAT_INTERVAL 60
+
 struct text_box {
     struct text_box_config *config;
-    bool is_at_top;
-    bool is_at_bottom;
     bool is_handling_buttons;
     uint16_t columns;
     uint16_t rows;
-    uint16_t line_offset[MAX_LINE];
+    // Line n is text[line_offset[n]] up to text[line_offset[n + 1]].
+    uint16_t line_offset[MAX_LINE + 1];
     uint16_t line_count;
     uint16_t line_index;
+    // Lines to scroll each repeat while a button is held, 0 if none is.
+    int8_t held_direction;
     char text[MAX_TEXT_LENGHT];
 };
 
 static struct text_box text_box;
 
+APP_TIMER_DEF(m_text_box_repeat_timer_id);
+static bool is_timer_created = false;
+// The repeat timer fired, text_box_process has to scroll.
+static volatile bool repeat_requested = false;
+
 static void text_box_button_handler(button_t button);
 static void text_box_show_page(void);
 
+static void text_box_repeat_timer_handler(void *p_context)
+{
+    repeat_requested = true;
+}
+
 void text_box_init(const char *text, struct text_box_config *config)
 {
-    uint32_t len = strlen(text);
+    uint32_t len = MIN(strlen(text), MAX_TEXT_LENGHT - 2);
     uint32_t i;
 
+    if (!is_timer_created) {
+        ret_code_t err_code =
+            app_timer_create(&m_text_box_repeat_timer_id,
+                             APP_TIMER_MODE_SINGLE_SHOT,
+                             text_box_repeat_timer_handler);
+        APP_ERROR_CHECK(err_code);
+        is_timer_created = true;
+    }
+    app_timer_stop(m_text_box_repeat_timer_id);
+    repeat_requested = false;
+
     memset(&text_box, 0, sizeof(text_box));
 
     text_box.is_handling_buttons = true;
-    text_box.is_at_top = true;
     text_box.columns = config->width / TEXT_BASE_WIDTH;
     text_box.rows = (config->height / TEXT_BASE_HEIGHT);
     text_box.config = config;
 
-    strncpy(text_box.text, text, MAX_TEXT_LENGHT);
+    memcpy(text_box.text, text, len);
 
     // If last charactere is not a \n add it
-    if (text_box.text[len - 1] != '\n') {
-        text_box.text[len] = '\n';
-        text_box.text[len + 1] = '\0';
+    if (len == 0 || text_box.text[len - 1] != '\n') {
+        text_box.text[len++] = '\n';
     }
 
+    // Wrap once, scrolling only walks the line offsets.
     word_wrap(text_box.text, text_box.columns);
 
-    // Count the number of lines and assign offset into an array
-    text_box.line_count++;
-    for (i = 0; i <= len; i++) {
+    for (i = 0; i < len && text_box.line_count < MAX_LINE; i++) {
         if (text_box.text[i] == '\n') {
-            text_box.line_offset[text_box.line_count] = i + 1;
             text_box.line_count++;
+            text_box.line_offset[text_box.line_count] = i + 1;
         }
     }
 
-    text_box.is_at_bottom =
-        (text_box.line_count <= text_box.rows) ? true : false;
-
     nsec_controls_add_handler(text_box_button_handler);
 
     text_box_show_page();
 }
 
-static void text_box_show_page(void) {
-    uint8_t i, k;
+static uint16_t text_box_last_index(void)
+{
+    if (text_box.line_count <= text_box.rows) {
+        return 0;
+    }
+
+    return text_box.line_count - text_box.rows;
+}
+
+/*
+ * Draw one row of the box. The line is padded with spaces so the glyph
+ * backgrounds cover whatever was there, nothing has to be cleared first.
+ */
+static void text_box_draw_row(uint16_t row)
+{
     struct text_box_config *config = text_box.config;
+    uint16_t line = text_box.line_index + row;
     char buffer[text_box.columns + 1];
+    uint16_t size = 0;
+
+    if (line < text_box.line_count) {
+        // Leave the \n out, it would move the cursor.
+        size = text_box.line_offset[line + 1] - text_box.line_offset[line] - 1;
+        size = MIN(size, text_box.columns);
+        memcpy(buffer, text_box.text + text_box.line_offset[line], size);
+    }
+
+    memset(buffer + size, ' ', text_box.columns - size);
+    buffer[text_box.columns] = '\0';
+
+    gfx_set_cursor(config->x + 1, config->y + row * TEXT_BASE_HEIGHT);
+    gfx_puts(buffer);
+}
+
+static void text_box_draw_rows(uint16_t first, uint16_t count)
+{
+    struct text_box_config *config = text_box.config;
 
-    gfx_fill_rect(config->x, config->y, config->width, config->height,
-                  config->bg_color);
-    gfx_set_cursor(config->x + 1, config->y);
     gfx_set_text_background_color(config->text_color, config->bg_color);
     bool old_wrap_value = gfx_set_text_wrap(false);
 
-    for (i = 0; i < text_box.rows; i++) {
-        if (text_box.line_index + i + 1 > text_box.line_count) {
-            goto end;
-        }
+    for (uint16_t row = first; row < first + count; row++) {
+        text_box_draw_row(row);
+    }
 
-        int16_t line_end = text_box.line_offset[text_box.line_index + i + 1];
-        int16_t line_start = text_box.line_offset[text_box.line_index + i];
-        int16_t line_size = line_end - line_start;
-        if (line_size < 0) {
-            text_box.is_at_bottom = true;
-            goto end;
-        }
+    gfx_set_text_wrap(old_wrap_value);
+}
 
-        memset(buffer, '\0', text_box.columns + 1);
-        strncpy(buffer,
-                text_box.text + text_box.line_offset[text_box.line_index + i],
-                line_size);
-        gfx_puts(buffer);
-    }
+static void text_box_show_page(void)
+{
+    struct text_box_config *config = text_box.config;
 
-end:
-	gfx_set_text_wrap(old_wrap_value);
+    gfx_fill_rect(config->x, config->y, config->width, config->height,
+                  config->bg_color);
+    text_box_draw_rows(0, text_box.rows);
+    gfx_update();
 }
 
-static void scroll_up(void) {
-    if (text_box.is_at_top) {
-        return;
-    }
+/*
+ * Move the text by a number of lines, positive is towards the end. When the
+ * display can move what is already on screen, only the lines that come into
+ * view are drawn.
+ */
+static bool text_box_scroll(int16_t lines)
+{
+    struct text_box_config *config = text_box.config;
+    int16_t index = text_box.line_index + lines;
 
-    if (text_box.is_at_bottom) {
-        text_box.line_index -= text_box.rows;
+    index = MAX(index, 0);
+    index = MIN(index, text_box_last_index());
+    lines = index - text_box.line_index;
+    if (lines == 0) {
+        return false;
     }
 
-    if (text_box.line_index - text_box.rows < 0) {
-        text_box.line_index = 0;
-        text_box.is_at_top = true;
-        text_box.is_at_bottom = false;
+    text_box.line_index = index;
+
+    if (abs(lines) < text_box.rows &&
+        display_scroll_rect(config->x, config->y, config->width,
+                            text_box.rows * TEXT_BASE_HEIGHT,
+                            lines * TEXT_BASE_HEIGHT)) {
+        if (lines > 0) {
+            text_box_draw_rows(text_box.rows - lines, lines);
+        } else {
+            text_box_draw_rows(0, -lines);
+        }
     } else {
-        text_box.line_index -= text_box.rows;
-        text_box.is_at_bottom = false;
+        text_box_draw_rows(0, text_box.rows);
     }
+    gfx_update();
 
-    text_box_show_page();
+    return true;
+}
+
+static void text_box_hold(int8_t direction)
+{
+    app_timer_stop(m_text_box_repeat_timer_id);
+    repeat_requested = false;
+    text_box.held_direction = 0;
+
+    if (direction != 0 && text_box_scroll(direction)) {
+        text_box.held_direction = direction;
+        app_timer_start(m_text_box_repeat_timer_id,
+                        APP_TIMER_TICKS(TEXT_BOX_REPEAT_DELAY), NULL);
+    }
 }
 
-static void scroll_down(void) {
-    if (text_box.is_at_bottom) {
+/*
+ * Keep scrolling while UP or DOWN is held, from the main loop so the drawing
+ * never happens in the timer interrupt.
+ */
+void text_box_process(void)
+{
+    if (!repeat_requested) {
         return;
     }
+    repeat_requested = false;
 
-    if (text_box.line_index + text_box.rows >= text_box.line_count) {
-        text_box.line_index = text_box.line_count - text_box.rows;
-        text_box.is_at_bottom = true;
+    if (!text_box.is_handling_buttons || text_box.held_direction == 0) {
         return;
-    } else {
-        text_box.line_index += text_box.rows;
-        text_box.is_at_top = false;
     }
 
-    text_box_show_page();
+    if (text_box_scroll(text_box.held_direction)) {
+        app_timer_start(m_text_box_repeat_timer_id,
+                        APP_TIMER_TICKS(TEXT_BOX_REPEAT_INTERVAL), NULL);
+    } else {
+        text_box.held_direction = 0;
+    }
 }
 
-static void text_box_close(void) { text_box.is_handling_buttons = 0; }
+static void text_box_close(void)
+{
+    text_box_hold(0);
+    text_box.is_handling_buttons = 0;
+}
 
 static void text_box_button_handler(button_t button) {
     if (text_box.is_handling_buttons) {
         switch (button) {
         case BUTTON_UP:
-            if (!text_box.is_at_top) {
-                scroll_up();
-            }
+            text_box_hold(-1);
             break;
         case BUTTON_DOWN:
-            if (!text_box.is_at_bottom) {
-                scroll_down();
-            }
+            text_box_hold(1);
+            break;
+        case BUTTON_UP_RELEASE:
+        case BUTTON_DOWN_RELEASE:
+            text_box_hold(0);
             break;
         case BUTTON_BACK:
             text_box_close();
@@ -35,5 +35,6 @@ struct text_box_config {
 };
 
 void text_box_init(const char *text, struct text_box_config *config);
+void text_box_process(void);
 
 #endif
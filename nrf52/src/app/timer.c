@@ -5,6 +5,7 @@
 
 
 #include <app_timer.h>
+#include <app_util_platform.h>
 #include <nrf_drv_clock.h>
 #include <nrf_gpio.h>
 
@@ -17,6 +18,12 @@
 #include "gui.h"
 
 uint64_t heartbeat_timeout_count = 0;
+// Where the heartbeat started counting, in RTC ticks.
+static uint32_t heartbeat_start_ticks = 0;
+
+#define HEARTBEAT_TIMER_TICKS APP_TIMER_TICKS(HEARTBEAT_TIMER_TIMEOUT)
+#define RTC_TICKS_PER_SECOND                                                   \
+    (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
 
 APP_TIMER_DEF(m_heartbeat_timer_id);
 APP_TIMER_DEF(m_status_timer_id);
@@ -101,7 +108,9 @@ void timer_init(void) {
                 heartbeat_timeout_handler);
     APP_ERROR_CHECK(err_code);
 
-    // Start the heartbeat timer
+    // Start the heartbeat timer, the counter is read first so the first
+    // timeout can't be earlier than what get_current_time_millis expects.
+    heartbeat_start_ticks = app_timer_cnt_get();
     err_code = app_timer_start(m_heartbeat_timer_id,
                 APP_TIMER_TICKS(HEARTBEAT_TIMER_TIMEOUT), NULL);
     APP_ERROR_CHECK(err_code);
@@ -127,11 +136,23 @@ void timer_init(void) {
 }
 
 /*
- * Get the elapsed time since startup in milliseconds
+ * Get the elapsed time since startup in milliseconds. The heartbeat extends
+ * the 24 bits RTC counter, the ticks since the last heartbeat are added so
+ * the time is precise to the millisecond instead of the heartbeat period.
  */
 uint64_t get_current_time_millis(void) {
-    return (app_timer_cnt_get() / APP_TIMER_CLOCK_FREQ) +
-           (HEARTBEAT_TIMER_TIMEOUT * heartbeat_timeout_count);
+    uint64_t count;
+    uint32_t ticks;
+
+    CRITICAL_REGION_ENTER();
+    count = heartbeat_timeout_count;
+    ticks = app_timer_cnt_diff_compute(
+        app_timer_cnt_get(),
+        heartbeat_start_ticks + (uint32_t)count * HEARTBEAT_TIMER_TICKS);
+    CRITICAL_REGION_EXIT();
+
+    return (count * HEARTBEAT_TIMER_TICKS + ticks) * 1000 /
+           RTC_TICKS_PER_SECOND;
 }
 
 void start_battery_status_timer(void) {
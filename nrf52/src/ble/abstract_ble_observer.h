@@ -6,11 +6,64 @@
 #ifndef NRF52_ABSTRACT_BLE_OBSERVER_H
 #define NRF52_ABSTRACT_BLE_OBSERVER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <ble_gap.h>
 
+/**
+ * One AD structure of an advertising report, data points inside the report.
+ * A missing field has a NULL data.
+ */
+struct AdvField {
+    const uint8_t* data;
+    uint8_t length;
+};
+
+/**
+ * An advertising report, parsed once by the BLE device before it is handed
+ * to the observers.
+ */
+struct AdvReport {
+    const ble_gap_evt_adv_report_t* report;
+    // Number of AD structures, and whether they all fit in the report.
+    uint8_t field_count;
+    bool well_formed;
+    struct AdvField flags;
+    // Complete local name, or else the shortened one.
+    struct AdvField name;
+    bool name_complete;
+    struct AdvField manufacturer_data;
+    // 0xFFFF if there is no manufacturer data.
+    uint16_t company_id;
+    struct AdvField uuid16;
+    struct AdvField uuid128;
+};
+
+void parse_adv_report(const ble_gap_evt_adv_report_t* report, struct AdvReport* parsed);
+
+/**
+ * Only the reports matching all the criteria set in "match" are passed to an
+ * observer.  With no criteria, it gets them all.
+ */
+#define BLE_OBSERVER_FILTER_NO_SCAN_RSP (1 << 0)
+#define BLE_OBSERVER_FILTER_ADV_TYPE (1 << 1)
+#define BLE_OBSERVER_FILTER_COMPANY_ID (1 << 2)
+#define BLE_OBSERVER_FILTER_NAME_PREFIX (1 << 3)
+
+struct BleObserverFilter {
+    uint8_t match;
+    uint8_t adv_type;
+    uint16_t company_id;
+    const char* name_prefix;
+};
+
+bool ble_observer_filter_match(const struct BleObserverFilter* filter, const struct AdvReport* report);
+
 struct BleObserver {
-    void (*on_advertising_report)(const ble_gap_evt_adv_report_t*);
+    void (*on_advertising_report)(const struct AdvReport*);
     void (*on_scan_timeout)(const ble_gap_evt_timeout_t*);
+    struct BleObserverFilter filter;
 };
 
 #endif //NRF52_ABSTRACT_BLE_OBSERVER_H
@@ -0,0 +1,94 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#include <string.h>
+
+#include "abstract_ble_observer.h"
+
+/**
+ * BLE advertising data is separated into fields, with the following format:
+ *     length of the field, excluding this byte, but including the type (1 byte)
+ *     type of the field (1 byte)
+ *     data for the field (length - 1 bytes)
+ */
+void parse_adv_report(const ble_gap_evt_adv_report_t* report, struct AdvReport* parsed) {
+    uint8_t index = 0;
+
+    memset(parsed, 0, sizeof(*parsed));
+    parsed->report = report;
+    parsed->company_id = 0xFFFF;
+    parsed->well_formed = true;
+
+    while (index < report->dlen) {
+        uint8_t field_length = report->data[index];
+
+        if (field_length == 0 || index + 1 + field_length > report->dlen) {
+            parsed->well_formed = false;
+            break;
+        }
+
+        struct AdvField field = {
+            .data = &report->data[index + 2],
+            .length = field_length - 1,
+        };
+
+        switch (report->data[index + 1]) {
+        case BLE_GAP_AD_TYPE_FLAGS:
+            parsed->flags = field;
+            break;
+        case BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME:
+            parsed->name = field;
+            parsed->name_complete = true;
+            break;
+        case BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME:
+            if (!parsed->name_complete) {
+                parsed->name = field;
+            }
+            break;
+        case BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA:
+            parsed->manufacturer_data = field;
+            if (field.length >= 2) {
+                parsed->company_id = field.data[0] | (field.data[1] << 8);
+            }
+            break;
+        case BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_MORE_AVAILABLE:
+        case BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE:
+            parsed->uuid16 = field;
+            break;
+        case BLE_GAP_AD_TYPE_128BIT_SERVICE_UUID_MORE_AVAILABLE:
+        case BLE_GAP_AD_TYPE_128BIT_SERVICE_UUID_COMPLETE:
+            parsed->uuid128 = field;
+            break;
+        }
+
+        parsed->field_count++;
+        index += field_length + 1;
+    }
+}
+
+bool ble_observer_filter_match(const struct BleObserverFilter* filter, const struct AdvReport* report) {
+    if ((filter->match & BLE_OBSERVER_FILTER_NO_SCAN_RSP) && report->report->scan_rsp) {
+        return false;
+    }
+
+    if ((filter->match & BLE_OBSERVER_FILTER_ADV_TYPE) && report->report->type != filter->adv_type) {
+        return false;
+    }
+
+    if ((filter->match & BLE_OBSERVER_FILTER_COMPANY_ID) && report->company_id != filter->company_id) {
+        return false;
+    }
+
+    if (filter->match & BLE_OBSERVER_FILTER_NAME_PREFIX) {
+        size_t prefix_length = strlen(filter->name_prefix);
+
+        if (report->name.data == NULL || report->name.length < prefix_length ||
+                memcmp(report->name.data, filter->name_prefix, prefix_length)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -5,6 +5,7 @@
 
 #include "beacon.h"
 #include "abstract_advertiser.h"
+#include "ble_device.h"
 
 #include <app_error.h>
 #include <ble_gap.h>
@@ -61,7 +62,7 @@ static void start_broadcasting(){
     configure_advertising_parameters(&adv_params);
 
     APP_ERROR_CHECK(ble_advdata_set(&beacon_config.adv_data, NULL));
-    APP_ERROR_CHECK(sd_ble_gap_adv_start(&adv_params, 0));
+    APP_ERROR_CHECK(sd_ble_gap_adv_start(&adv_params, APP_BLE_CONN_CFG_TAG));
 }
 
 static void stop_broadcasting(){
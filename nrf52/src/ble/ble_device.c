@@ -33,14 +33,20 @@
 #include "abstract_ble_observer.h"
 #include "ble_scan.h"
 #include "drivers/uart.h"
+#include "drivers/cli_uart.h"
 #include "app/pairing_menu.h"
 #include "app/persistency.h"
+#include "app/timer.h"
 
 #define APP_BLE_OBSERVER_PRIO 3
 #define PEER_ADDRESS_SIZE 6
 #define MAX_VENDOR_SERVICE_COUNT 8
 #define LONG_WRITE_MAX_LENGTH 200
 #define MAX_BLE_OBSERVERS 10
+// Go back to the low power connection interval after this long without bulk transfers.
+#define FAST_CONNECTION_IDLE_MS 2000
+// Give up on a connection parameters update the central didn't answer after this long.
+#define CONN_PARAM_UPDATE_TIMEOUT_MS 5000
 NRF_BLE_GATT_DEF(m_gatt);
 
 
@@ -53,6 +59,11 @@ typedef struct{
     struct BleObserver* ble_observers[MAX_BLE_OBSERVERS];
     uint8_t ble_observers_count;
     uint16_t connection_handle;
+    bool fast_connection_wanted;
+    bool fast_connection;
+    bool conn_param_update_pending;
+    uint64_t fast_connection_last_request;
+    uint64_t conn_param_update_start;
 } BleDevice;
 
 typedef struct{
@@ -71,6 +82,7 @@ static bool nsec_ble_connected = false;
 
 static void _nsec_ble_softdevice_init();
 static void gatt_init();
+static void reset_connection_parameters_state();
 //static void add_device_information_service(char * manufacturer_name, char * model, char * serial_number,
 //        char * hw_revision, char * fw_revision, char * sw_revision);
 static void on_characteristic_write_command_event(const ble_gatts_evt_write_t * write_event);
@@ -99,6 +111,7 @@ ret_code_t create_ble_device(char* device_name){
         }
         register_nsec_vendor_specific_uuid();
         ble_device->ble_observers_count = 0;
+        reset_connection_parameters_state();
         gatt_init();
         nsec_ble_is_enabled = get_stored_ble_is_enabled();
         return NRF_SUCCESS;
@@ -141,12 +154,16 @@ static void ble_event_handler(ble_evt_t const * p_ble_evt, void * p_context){
         case BLE_GAP_EVT_CONNECTED:
             nsec_ble_connected = true;
             ble_device->connection_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            reset_connection_parameters_state();
             break;
         case BLE_GAP_EVT_DISCONNECTED:
             if(nsec_ble_is_enabled)
                 ble_start_advertising();
             nsec_ble_connected = false;
             break;
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            ble_device->conn_param_update_pending = false;
+            break;
         case BLE_GATTS_EVT_SYS_ATTR_MISSING: {
             const uint16_t conn = p_ble_evt->evt.gatts_evt.conn_handle;
             APP_ERROR_CHECK(sd_ble_gatts_sys_attr_set(conn, NULL, 0, 0));
@@ -157,9 +174,14 @@ static void ble_event_handler(ble_evt_t const * p_ble_evt, void * p_context){
             if (ble_device->ble_observers_count == 0) {
                 break;
             }
-            const ble_gap_evt_adv_report_t *rp = &p_ble_evt->evt.gap_evt.params.adv_report;
+            // Parse the report once for all the observers.
+            struct AdvReport report;
+            parse_adv_report(&p_ble_evt->evt.gap_evt.params.adv_report, &report);
             for (int c = 0; c < ble_device->ble_observers_count; c++) {
-                ble_device->ble_observers[c]->on_advertising_report(rp);
+                struct BleObserver* observer = ble_device->ble_observers[c];
+                if (ble_observer_filter_match(&observer->filter, &report)) {
+                    observer->on_advertising_report(&report);
+                }
             }
             break;
         }
@@ -238,10 +260,60 @@ uint32_t add_vendor_service(struct VendorService* service){
 
 static void gatt_init(){
     APP_ERROR_CHECK(nrf_ble_gatt_init(&m_gatt, NULL));
+    // Ask for the largest ATT MTU and link layer packets on every connection, so a single write can carry up to
+    // NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3 bytes without being fragmented.
+    APP_ERROR_CHECK(nrf_ble_gatt_att_mtu_periph_set(&m_gatt, NRF_SDH_BLE_GATT_MAX_MTU_SIZE));
+    APP_ERROR_CHECK(nrf_ble_gatt_att_mtu_central_set(&m_gatt, NRF_SDH_BLE_GATT_MAX_MTU_SIZE));
+    APP_ERROR_CHECK(nrf_ble_gatt_data_length_set(&m_gatt, BLE_CONN_HANDLE_INVALID, NRF_SDH_BLE_GAP_DATA_LENGTH));
+}
+
+static void reset_connection_parameters_state(){
+    ble_device->fast_connection_wanted = false;
+    ble_device->fast_connection = false;
+    ble_device->conn_param_update_pending = false;
+}
+
+void ble_device_request_fast_connection(){
+    if(ble_device == NULL)
+        return;
+    ble_device->fast_connection_last_request = get_current_time_millis();
+    ble_device->fast_connection_wanted = true;
+}
+
+void ble_device_process(){
+    if(ble_device == NULL || !nsec_ble_connected)
+        return;
+
+    uint64_t now = get_current_time_millis();
+    if(ble_device->fast_connection_wanted && now - ble_device->fast_connection_last_request > FAST_CONNECTION_IDLE_MS)
+        ble_device->fast_connection_wanted = false;
+
+    if(ble_device->conn_param_update_pending){
+        if(now - ble_device->conn_param_update_start < CONN_PARAM_UPDATE_TIMEOUT_MS)
+            return;
+        ble_device->conn_param_update_pending = false;
+    }
+    if(ble_device->fast_connection_wanted == ble_device->fast_connection)
+        return;
+
+    ble_gap_conn_params_t parameters;
+    get_connection_parameters(ble_device->fast_connection_wanted, &parameters);
+    uint32_t error_code = sd_ble_gap_conn_param_update(ble_device->connection_handle, &parameters);
+    if(error_code == NRF_SUCCESS){
+        ble_device->fast_connection = ble_device->fast_connection_wanted;
+        ble_device->conn_param_update_pending = true;
+        ble_device->conn_param_update_start = now;
+    }
+    else if(error_code != NRF_ERROR_BUSY && error_code != NRF_ERROR_INVALID_STATE){
+        log_error_code("sd_ble_gap_conn_param_update", error_code);
+    }
 }
 
 static void on_characteristic_write_command_event(const ble_gatts_evt_write_t * write_event){
     struct ServiceCharacteristic* characteristic = get_characteristic_from_uuid(write_event->uuid.uuid);
+    if(characteristic != NULL && characteristic->allow_write_command && write_event->op == BLE_GATTS_OP_WRITE_CMD){
+        ble_device_request_fast_connection();
+    }
     if(characteristic != NULL && characteristic->on_write_operation_done != NULL){
         CharacteristicWriteEvent event = {
             .write_offset = write_event->offset,
@@ -414,15 +486,24 @@ static uint16_t get_characteristic_handle_for_queued_writes(){
 
 static void _nsec_ble_softdevice_init() {
     uint32_t ram_start = 0;
-    nrf_sdh_ble_default_cfg_set(BLE_COMMON_CFG_VS_UUID, &ram_start);
+    APP_ERROR_CHECK(nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start));
 
 #if DEBUG_PRINT_RAM_USAGE
-    uint32_t ram_start_copy = 0;
-    nrf_sdh_ble_enable(&ram_start_copy);
-    //TO DO
+    // nrf_sdh_ble_enable replaces ram_start with the RAM start the softdevice needs for this configuration, which is
+    // what the RAM origin in nsec_badge.ld must be set to.
+    uint32_t linked_ram_start = ram_start;
+    ret_code_t error_code = nrf_sdh_ble_enable(&ram_start);
+    NRF_LOG_INFO("Softdevice RAM start: 0x%08x, linked at 0x%08x\r\n", (unsigned) ram_start,
+                 (unsigned) linked_ram_start);
+    APP_ERROR_CHECK(error_code);
 #else
     APP_ERROR_CHECK(nrf_sdh_ble_enable(&ram_start));
 #endif
+    // Let connection events run past NRF_SDH_BLE_GAP_EVENT_LENGTH when the radio is otherwise idle.
+    ble_opt_t option;
+    memset(&option, 0, sizeof(option));
+    option.common_opt.conn_evt_ext.enable = 1;
+    APP_ERROR_CHECK(sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &option));
     // Register a handler for BLE events.
     NRF_SDH_BLE_OBSERVER(m_ble_observer, APP_BLE_OBSERVER_PRIO, ble_event_handler, NULL);
 }
@@ -9,6 +9,9 @@
 #include "abstract_advertiser.h"
 #include "abstract_ble_observer.h"
 
+// Tag of the connection configuration given to the softdevice, the advertisers must use the same one.
+#define APP_BLE_CONN_CFG_TAG 1
+
 ret_code_t create_ble_device(char* device_name);
 
 void destroy_ble_device();
@@ -34,3 +37,9 @@ bool ble_device_toggle_ble();
 bool is_ble_enabled(void);
 
 void ble_device_notify_characteristic(struct ServiceCharacteristic* characteristic, const uint8_t* value);
+
+// Ask the central for a short connection interval, which is relaxed back to the low power one once the requests stop
+// for a while. Write commands to characteristics with allow_write_command call it on their own.
+void ble_device_request_fast_connection();
+
+void ble_device_process();
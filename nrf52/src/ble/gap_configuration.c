@@ -87,15 +87,26 @@ static void set_default_connection_parameters(const char * device_name){
     error_code = sd_ble_gap_appearance_set(BLE_APPEARANCE_UNKNOWN);
     log_error_code("sd_ble_gap_appearance_set", error_code);
 
-    gap_connection_parameters.min_conn_interval = MSEC_TO_UNITS(400, UNIT_1_25_MS);
-    gap_connection_parameters.max_conn_interval = MSEC_TO_UNITS(650, UNIT_1_25_MS);
-    gap_connection_parameters.slave_latency = 0;
-    gap_connection_parameters.conn_sup_timeout = MSEC_TO_UNITS(4000, UNIT_10_MS);
+    get_connection_parameters(false, &gap_connection_parameters);
 
     error_code = sd_ble_gap_ppcp_set(&gap_connection_parameters);
     log_error_code("sd_ble_gap_ppcp_set", error_code);
 }
 
+void get_connection_parameters(bool fast, ble_gap_conn_params_t* connection_parameters){
+    if(fast){
+        // Short interval for bulk transfers, several packets fit in each connection event.
+        connection_parameters->min_conn_interval = MSEC_TO_UNITS(7.5, UNIT_1_25_MS);
+        connection_parameters->max_conn_interval = MSEC_TO_UNITS(15, UNIT_1_25_MS);
+    }
+    else{
+        connection_parameters->min_conn_interval = MSEC_TO_UNITS(400, UNIT_1_25_MS);
+        connection_parameters->max_conn_interval = MSEC_TO_UNITS(650, UNIT_1_25_MS);
+    }
+    connection_parameters->slave_latency = 0;
+    connection_parameters->conn_sup_timeout = MSEC_TO_UNITS(4000, UNIT_10_MS);
+}
+
 static void set_default_advertising_data(ble_uuid_t* uuid){
     ble_advdata_t advdata;
 
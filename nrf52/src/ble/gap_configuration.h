@@ -11,3 +11,6 @@
 void set_default_gap_parameters(const char* device_name, ble_gap_adv_params_t* advertising_parameters);
 
 void set_default_advertised_service(struct VendorService*);
+
+// Low power parameters by default, or a short interval for bulk transfers.
+void get_connection_parameters(bool fast, ble_gap_conn_params_t* connection_parameters);
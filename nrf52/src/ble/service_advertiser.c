@@ -89,6 +89,7 @@ static void start_advertising(){
     advertising_params.evt_handler = event_handler;
 
     APP_ERROR_CHECK(ble_advertising_init(&advertising_module, &advertising_params));
+    ble_advertising_conn_cfg_tag_set(&advertising_module, APP_BLE_CONN_CFG_TAG);
     APP_ERROR_CHECK(ble_advertising_start(&advertising_module, BLE_ADV_MODE_FAST));
 }
 
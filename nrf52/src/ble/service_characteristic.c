@@ -29,6 +29,7 @@ void create_characteristic(struct ServiceCharacteristic* characteristic, uint16_
     characteristic->user_descriptor = NULL;
     characteristic->data_type = 0;
     characteristic->allow_notify = false;
+    characteristic->allow_write_command = false;
 }
 
 void set_characteristic_permission(struct ServiceCharacteristic* characteristic, ReadPermission read_perm,
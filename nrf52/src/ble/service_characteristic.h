@@ -67,6 +67,9 @@ struct ServiceCharacteristic {
     const char* user_descriptor;
     uint8_t data_type;
     bool allow_notify;
+    // Also accept write commands (i.e. write without response). They are never authorized: the soft device updates
+    // the value and on_write_operation_done is called. Meant for bulk transfers, see ble_device_request_fast_connection.
+    bool allow_write_command;
 };
 
 
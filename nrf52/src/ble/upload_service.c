@@ -0,0 +1,91 @@
+//  Copyright (c) 2019
+//
+//  License: MIT (see LICENSE for details)
+
+#include "upload_service.h"
+#include <stdint.h>
+#include <string.h>
+
+#include <crc32.h>
+#include <sdk_config.h>
+
+#include "ble/ble_device.h"
+#include "ble/service_characteristic.h"
+#include "ble/vendor_service.h"
+#include "uuid.h"
+
+/*
+ * Bulk upload sink.  The client streams chunks of up to an ATT MTU worth of
+ * data to the data characteristic with write commands, which don't wait for a
+ * response and ask for the fast connection interval.  Nothing is kept: the
+ * badge only counts the bytes and runs a CRC32 over them, which the client
+ * reads back from the status characteristic to check the transfer.  Writing
+ * 0 to the status characteristic starts a new transfer.
+ */
+
+#define UPLOAD_CHUNK_SIZE (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+
+struct upload_status {
+    uint32_t length;
+    uint32_t crc;
+} __attribute__((packed));
+
+static struct VendorService upload_ble_service;
+static struct ServiceCharacteristic data_characteristic;
+static struct ServiceCharacteristic status_characteristic;
+
+static uint16_t service_uuid = 0x0021;
+static uint16_t data_char_uuid = 0x0121;
+static uint16_t status_char_uuid = 0x0221;
+
+static struct upload_status status;
+
+static void on_data_written(CharacteristicWriteEvent *event)
+{
+    if (event->data_length == 0) {
+        return;
+    }
+
+    status.crc = crc32_compute(event->data_buffer, event->data_length,
+                               status.length == 0 ? NULL : &status.crc);
+    status.length += event->data_length;
+    set_characteristic_value(&status_characteristic, (uint8_t *) &status);
+}
+
+static uint16_t on_status_write(CharacteristicWriteEvent *event)
+{
+    if (event->data_length != 1) {
+        return BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+    }
+
+    if (event->data_buffer[0] != 0) {
+        return BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED;
+    }
+
+    memset(&status, 0, sizeof(status));
+    set_characteristic_value(&status_characteristic, (uint8_t *) &status);
+    return BLE_GATT_STATUS_SUCCESS;
+}
+
+void init_upload_service(void)
+{
+    ble_uuid_t uuid = {.uuid = service_uuid, .type = TYPE_NSEC_UUID};
+    create_vendor_service(&upload_ble_service, &uuid);
+    add_vendor_service(&upload_ble_service);
+
+    create_characteristic(&data_characteristic, UPLOAD_CHUNK_SIZE, DENY_READ,
+                          WRITE_REQUEST, data_char_uuid);
+    data_characteristic.user_descriptor = "Upload data";
+    data_characteristic.allow_write_command = true;
+    add_characteristic_to_vendor_service(&upload_ble_service,
+                                         &data_characteristic);
+    add_write_operation_done_handler(&data_characteristic, on_data_written);
+
+    create_characteristic(&status_characteristic, sizeof(status), AUTO_READ,
+                          AUTH_WRITE_REQUEST, status_char_uuid);
+    status_characteristic.user_descriptor = "Upload length and CRC32";
+    add_characteristic_to_vendor_service(&upload_ble_service,
+                                         &status_characteristic);
+    add_write_request_handler(&status_characteristic, on_status_write);
+    set_characteristic_value(&status_characteristic, (uint8_t *) &status);
+}
@@ -0,0 +1,10 @@
+//  Copyright (c) 2019
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef upload_service_h
+#define upload_service_h
+
+void init_upload_service(void);
+
+#endif /* upload_service_h */
@@ -59,7 +59,7 @@ static void configure_characteristic_metadata(struct ServiceCharacteristic* char
     bzero(char_metadata, sizeof(ble_gatts_char_md_t));
     char_metadata->char_props.read = characteristic->read_mode != DENY_READ;
     char_metadata->char_props.write = characteristic->write_mode != DENY_WRITE;
-    char_metadata->char_props.write_wo_resp = 0; // deactivate for now.
+    char_metadata->char_props.write_wo_resp = characteristic->allow_write_command;
     char_metadata->char_props.notify = characteristic->allow_notify;
     if(characteristic->data_type != 0){
         set_characteristic_presentation_format(format, characteristic->data_type);
@@ -107,7 +107,8 @@ static void set_default_metadata_for_attribute(struct ServiceCharacteristic* cha
                                                ble_gatts_attr_md_t* attribute_metadata){
     bzero(attribute_metadata, sizeof(*attribute_metadata));
     attribute_metadata->vloc = BLE_GATTS_VLOC_STACK;
-    attribute_metadata->vlen = 0;
+    // Bulk writes don't always fill the whole value.
+    attribute_metadata->vlen = characteristic->allow_write_command;
     configure_permission(characteristic, attribute_metadata);
 }
 
@@ -25,6 +25,7 @@ as well as Adafruit raw 1.8" TFT display
 #include "app/gfx_effect.h"
 #include "bitmap.h"
 #include "boards.h"
+#include "bitmap_reader.h"
 #include "flash.h"
 #include <app_util_platform.h>
 #include <nrf.h>
@@ -34,9 +35,6 @@ as well as Adafruit raw 1.8" TFT display
 #include <stdlib.h>
 #include <string.h>
 
-// This increase the bss section by 25k !!!!
-//#define USE_DOUBLE_BUFFERING
-
 //*****************************************************************************
 //
 // Local Defines
@@ -78,11 +76,32 @@ static uint8_t _model = ST7735_MODEL_GREEN;
 static bool is_init = false;
 static st7735_config_t st7735_config;
 
+#define BYTES_PER_PIXEL 2
+
+#ifdef ST7735_FRAMEBUFFER
+// The whole screen is kept in RAM (25600 bytes) and drawing only touches this
+// copy. Pixels are stored in the byte order the panel expects so that the
+// dirty rectangle can be sent as-is by st7735_update().
+static uint16_t framebuffer[ST7735_WIDTH * ST7735_HEIGHT];
+static bool fb_dirty = false;
+static int16_t fb_dirty_x0, fb_dirty_y0, fb_dirty_x1, fb_dirty_y1;
+
+// The framebuffer is sent as-is, the strips are not needed.
+#define BUFFER_SIZE 4
+#else
 // Using a complete double buffer is a little bit too intense on the memory
 // we will use a buffer that can contain 25% of the screen. 6400 bytes
-#define BYTES_PER_PIXEL 2
 #define BUFFER_SIZE (ST7735_HEIGHT * ST7735_WIDTH * BYTES_PER_PIXEL) / 4
-static uint8_t buffer[BUFFER_SIZE] = {0};
+#endif
+static uint8_t buffer[BUFFER_SIZE] __attribute__((aligned(4))) = {0};
+
+// The buffer is split in two strips, one is filled while the other one is
+// being sent to the LCD by EasyDMA.
+#define STRIP_SIZE (BUFFER_SIZE / 2)
+static uint8_t strip_idx = 0;
+
+// CASET/RASET parameters, kept apart from the strips which can be in flight.
+static uint8_t window[4] = {0};
 
 //*****************************************************************************
 //
@@ -167,6 +186,46 @@ void st7735_set_model(uint8_t model)
 //*****************************************************************************
 static nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(CONF_OLED_SPI_INST);
 
+#if CONF_OLED_SPI_INST == 2
+#define SPI_IRQ SPIM2_SPIS2_SPI2_IRQn
+#define SPI_IRQ_HANDLER SPIM2_SPIS2_SPI2_IRQHandler
+#else
+#error "Add the interrupt of this SPI instance."
+#endif
+
+// Defined by nrf_drv_spi.
+void SPI_IRQ_HANDLER(void);
+
+static volatile bool spi_busy = false;
+static const uint8_t *spi_tx_data;
+static uint16_t spi_tx_len;
+
+static void spi_send_next_packet(void)
+{
+    const uint8_t packet_len = MIN(spi_tx_len, UINT8_MAX);
+    const uint8_t *p_tx_data = spi_tx_data;
+
+    spi_tx_data += packet_len;
+    spi_tx_len -= packet_len;
+
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&st7735_config.spi, p_tx_data,
+                                         packet_len, NULL, 0));
+}
+
+/*
+ * EasyDMA moves at most 255 bytes per transfer, chain the next packet from
+ * the completion interrupt until the whole span is on the wire.
+ */
+static void spi_event_handler(nrf_drv_spi_evt_t const *p_event,
+                              void *p_context)
+{
+    if (spi_tx_len > 0) {
+        spi_send_next_packet();
+    } else {
+        spi_busy = false;
+    }
+}
+
 static void spi_init(nrf_drv_spi_frequency_t spi_config_frequency)
 {
     nrf_drv_spi_config_t spi_config;
@@ -178,30 +237,81 @@ static void spi_init(nrf_drv_spi_frequency_t spi_config_frequency)
     spi_config.ss_pin = st7735_config.cs_pin;
     spi_config.bit_order = NRF_DRV_SPI_BIT_ORDER_MSB_FIRST;
     spi_config.mode = NRF_DRV_SPI_MODE_0;
-    spi_config.irq_priority = APP_IRQ_PRIORITY_LOW;
+    // The completion interrupt must preempt whatever waits for a transfer.
+    // Drawing from the SoftDevice event handlers is covered by this priority,
+    // st7735_wait() handles the contexts it can't preempt, like app_timer
+    // handlers and the error handler.
+    spi_config.irq_priority = APP_IRQ_PRIORITY_HIGH;
     spi_config.orc = 0xFF;
 
-    APP_ERROR_CHECK(
-        nrf_drv_spi_init(&st7735_config.spi, &spi_config, NULL, NULL));
+    APP_ERROR_CHECK(nrf_drv_spi_init(&st7735_config.spi, &spi_config,
+                                     spi_event_handler, NULL));
+}
+
+/*
+ * Wait until the transfer in flight, if any, is done.
+ */
+static void st7735_wait(void)
+{
+    // At the SPI interrupt priority or above, the completion interrupt stays
+    // pending until we return: run the driver's handler by hand to chain the
+    // packets.
+    if (current_int_priority_get() <= APP_IRQ_PRIORITY_HIGH) {
+        while (spi_busy) {
+            if (NVIC_GetPendingIRQ(SPI_IRQ)) {
+                NVIC_ClearPendingIRQ(SPI_IRQ);
+                SPI_IRQ_HANDLER();
+            }
+        }
+        return;
+    }
+
+    while (spi_busy) {
+        __WFE();
+    }
 }
 
 static void spi_uninit(void)
 {
+    st7735_wait();
     nrf_drv_spi_uninit(&st7735_config.spi);
 }
 
+/*
+ * Start sending bytes of data to the LCD and return right away. The data must
+ * be in RAM and stay untouched until the next transfer is started or
+ * st7735_wait() returns.
+ */
+static void st7735_data_len_async(const uint8_t *p_tx_data, uint16_t len)
+{
+    st7735_wait();
+
+    if (len == 0) {
+        return;
+    }
+
+    spi_tx_data = p_tx_data;
+    spi_tx_len = len;
+    spi_busy = true;
+    spi_send_next_packet();
+}
+
 /*
  * Send bytes of data to the LCD.
  */
 static void st7735_data_len(const uint8_t *p_tx_data, uint16_t len)
 {
-    while (len > 0) {
-        const uint8_t packet_len = MIN(len, UINT8_MAX);
-        APP_ERROR_CHECK(nrf_drv_spi_transfer(&st7735_config.spi, p_tx_data,
-                                             packet_len, NULL, 0));
-        len -= packet_len;
-        p_tx_data += packet_len;
-    }
+    st7735_data_len_async(p_tx_data, len);
+    st7735_wait();
+}
+
+/*
+ * Return the strip which is not on the wire, ready to be filled.
+ */
+static uint8_t *st7735_next_strip(void)
+{
+    strip_idx ^= 1;
+    return &buffer[strip_idx * STRIP_SIZE];
 }
 
 /*
@@ -217,6 +327,7 @@ static void st7735_data(uint8_t data)
  */
 static void st7735_command(uint8_t command)
 {
+    st7735_wait();
     nrf_gpio_pin_write(st7735_config.dc_pin, COMMAND);
     st7735_data_len(&command, 1);
     nrf_gpio_pin_write(st7735_config.dc_pin, DATA);
@@ -509,6 +620,9 @@ void st7735_init(void)
 
     /* Initialize the framebuffer, content is random after reset */
     st7735_fill_screen(ST7735_BLACK);
+#ifdef ST7735_FRAMEBUFFER
+    st7735_update();
+#endif
 
     /* And finally, start displaying */
     st7735_display_on();
@@ -529,94 +643,200 @@ uint16_t swap_colour(uint16_t x)
 
 void st7735_set_addr_window(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
 {
-    buffer[0] = 0x00;
-    buffer[2] = 0x00;
-
     st7735_command(ST7735_CASET);
 
-    buffer[1] = x0 + colstart;
-    buffer[3] = x1 + colstart;
-    st7735_data_len(buffer, 4);
+    window[0] = 0x00;
+    window[1] = x0 + colstart;
+    window[2] = 0x00;
+    window[3] = x1 + colstart;
+    st7735_data_len(window, 4);
 
     st7735_command(ST7735_RASET);
 
-    buffer[1] = y0 + rowstart;
-    buffer[3] = y1 + rowstart;
-    st7735_data_len(buffer, 4);
+    window[1] = y0 + rowstart;
+    window[3] = y1 + rowstart;
+    st7735_data_len(window, 4);
 
     st7735_command(ST7735_RAMWR);
 }
 
 void st7735_push_colour(uint16_t colour)
 {
-    buffer[0] = colour >> 8;
-    buffer[1] = colour;
-    st7735_data_len(buffer, 2);
+    uint8_t data[2] = {colour >> 8, colour};
+
+    st7735_data_len(data, 2);
 }
 
-void st7735_draw_pixel(int16_t x, int16_t y, uint16_t colour)
+#ifdef ST7735_FRAMEBUFFER
+//*****************************************************************************
+//
+// Framebuffer
+//
+//*****************************************************************************
+
+static inline uint16_t fb_colour(uint16_t colour)
 {
-    if ((x < 0) || (x >= width) || (y < 0) || (y >= height)) {
+    return (colour >> 8) | (colour << 8);
+}
+
+static void fb_mark_dirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+    if (!fb_dirty) {
+        fb_dirty_x0 = x0;
+        fb_dirty_y0 = y0;
+        fb_dirty_x1 = x1;
+        fb_dirty_y1 = y1;
+        fb_dirty = true;
         return;
     }
 
-    st7735_set_addr_window(x, y, x + 1, y + 1);
-    st7735_push_colour(colour);
+    fb_dirty_x0 = MIN(fb_dirty_x0, x0);
+    fb_dirty_y0 = MIN(fb_dirty_y0, y0);
+    fb_dirty_x1 = MAX(fb_dirty_x1, x1);
+    fb_dirty_y1 = MAX(fb_dirty_y1, y1);
 }
 
-void st7735_draw_fast_vline(int16_t x, int16_t y, int16_t h, uint16_t colour)
+/*
+ * Clip a rectangle to the screen, return false if nothing is left to draw.
+ */
+static bool fb_clip(int16_t *x, int16_t *y, int16_t *w, int16_t *h)
 {
+    const int16_t screen_w = width;
+    const int16_t screen_h = height;
 
-    uint32_t i = 0;
-    uint8_t hi, lo;
+    if (*x < 0) {
+        *w += *x;
+        *x = 0;
+    }
+
+    if (*y < 0) {
+        *h += *y;
+        *y = 0;
+    }
+
+    if (*x + *w > screen_w) {
+        *w = screen_w - *x;
+    }
+
+    if (*y + *h > screen_h) {
+        *h = screen_h - *y;
+    }
+
+    return (*w > 0) && (*h > 0);
+}
+
+static void fb_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                         uint16_t colour)
+{
+    uint16_t value = fb_colour(colour);
 
-    // Rudimentary clipping
-    if ((x >= width) || (y >= height)) {
+    if (!fb_clip(&x, &y, &w, &h)) {
         return;
     }
 
-    if ((y + h - 1) >= height) {
-        h = height - y;
+    st7735_wait();
+
+    for (int16_t j = y; j < y + h; j++) {
+        uint16_t *p = &framebuffer[j * width + x];
+
+        for (int16_t i = w; i > 0; i--) {
+            *p++ = value;
+        }
+    }
+
+    fb_mark_dirty(x, y, x + w - 1, y + h - 1);
+}
+
+/*
+ * Move the content of a rectangle up by dy rows, down if dy is negative.
+ *
+ * The panel has a vertical scroll (VSCRDEF/VSCSAD) but it runs along its
+ * 160 pixel side, which is the horizontal axis once rotated to landscape.
+ * Without MISO the GRAM can't be read back either, so the rows are moved in
+ * the framebuffer and go out with the next update.
+ */
+void st7735_scroll_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                        int16_t dy)
+{
+    if (!fb_clip(&x, &y, &w, &h) || dy == 0 || abs(dy) >= h) {
+        return;
     }
 
-    hi = colour >> 8;
-    lo = colour;
+    st7735_wait();
 
-    st7735_set_addr_window(x, y, x, y + h - 1);
+    for (int16_t n = 0; n < h - abs(dy); n++) {
+        const int16_t row = dy > 0 ? y + n : y + h - 1 - n;
 
-    while (h--) {
-        buffer[i++] = hi;
-        buffer[i++] = lo;
+        memcpy(&framebuffer[row * width + x],
+               &framebuffer[(row + dy) * width + x], w * BYTES_PER_PIXEL);
     }
 
-    st7735_data_len(buffer, i);
+    fb_mark_dirty(x, y, x + w - 1, y + h - 1);
 }
 
-void st7735_draw_fast_hline(int16_t x, int16_t y, int16_t w, uint16_t colour)
+/*
+ * Push the dirty rectangle to the panel. The address window is set once, the
+ * controller wraps to the next row by itself so every row can follow without
+ * any other command. When the rectangle spans the whole width the rows are
+ * contiguous in RAM and go out as a single burst.
+ *
+ * The last rows are still being sent when this returns, so every framebuffer
+ * write first waits for the transfer to be done.
+ */
+void st7735_update(void)
 {
-    uint32_t i = 0;
-    uint8_t hi, lo;
+    int16_t w, h;
 
-    // Rudimentary clipping
-    if ((x >= width) || (y >= height)) {
+    if (!fb_dirty) {
         return;
     }
 
-    if ((x + w - 1) >= width) {
-        w = width - x;
-    }
+    w = fb_dirty_x1 - fb_dirty_x0 + 1;
+    h = fb_dirty_y1 - fb_dirty_y0 + 1;
 
-    hi = colour >> 8;
-    lo = colour;
+    st7735_set_addr_window(fb_dirty_x0, fb_dirty_y0, fb_dirty_x1, fb_dirty_y1);
 
-    st7735_set_addr_window(x, y, x + w - 1, y);
+    if (w == width) {
+        st7735_data_len_async(
+            (const uint8_t *)&framebuffer[fb_dirty_y0 * width],
+            w * h * BYTES_PER_PIXEL);
+    } else {
+        for (int16_t y = fb_dirty_y0; y <= fb_dirty_y1; y++) {
+            st7735_data_len_async(
+                (const uint8_t *)&framebuffer[y * width + fb_dirty_x0],
+                w * BYTES_PER_PIXEL);
+        }
+    }
 
-    while (w--) {
-        buffer[i++] = hi;
-        buffer[i++] = lo;
+    fb_dirty = false;
+}
+#endif
+
+void st7735_draw_pixel(int16_t x, int16_t y, uint16_t colour)
+{
+    if ((x < 0) || (x >= width) || (y < 0) || (y >= height)) {
+        return;
     }
 
-    st7735_data_len(buffer, i);
+#ifdef ST7735_FRAMEBUFFER
+    st7735_wait();
+    framebuffer[y * width + x] = fb_colour(colour);
+    fb_mark_dirty(x, y, x, y);
+    return;
+#endif
+
+    st7735_set_addr_window(x, y, x + 1, y + 1);
+    st7735_push_colour(colour);
+}
+
+void st7735_draw_fast_vline(int16_t x, int16_t y, int16_t h, uint16_t colour)
+{
+    st7735_fill_rect(x, y, 1, h, colour);
+}
+
+void st7735_draw_fast_hline(int16_t x, int16_t y, int16_t w, uint16_t colour)
+{
+    st7735_fill_rect(x, y, w, 1, colour);
 }
 
 void st7735_fill_screen_black(void)
@@ -634,13 +854,47 @@ void st7735_fill_screen(uint16_t colour)
     st7735_fill_rect(0, 0, width, height, colour);
 }
 
+/*
+ * Send N_PIXELS pixels of the same colour to the current window. One strip is
+ * filled once and sent as many times as needed.
+ */
+static void st7735_fill_window(uint32_t n_pixels, uint16_t colour)
+{
+    uint8_t *strip = st7735_next_strip();
+    uint32_t len = MIN(n_pixels * BYTES_PER_PIXEL, STRIP_SIZE);
+    uint32_t remaining = n_pixels * BYTES_PER_PIXEL;
+
+    for (uint32_t i = 0; i < len; i += 2) {
+        strip[i] = colour >> 8;
+        strip[i + 1] = colour;
+    }
+
+    while (remaining > 0) {
+        uint32_t chunk = MIN(remaining, len);
+        st7735_data_len_async(strip, chunk);
+        remaining -= chunk;
+    }
+}
+
 void st7735_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h,
                       uint16_t colour)
 {
-    uint32_t i = 0;
-    uint8_t hi, lo;
+#ifdef ST7735_FRAMEBUFFER
+    fb_fill_rect(x, y, w, h, colour);
+    return;
+#endif
 
-    if ((x >= width) || (y >= height)) {
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+
+    if ((x >= width) || (y >= height) || (w <= 0) || (h <= 0)) {
         return;
     }
 
@@ -652,23 +906,8 @@ void st7735_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h,
         h = height - y;
     }
 
-    hi = colour >> 8;
-    lo = colour;
     st7735_set_addr_window(x, y, x + w - 1, y + h - 1);
-
-    for (y = h; y > 0; y--) {
-        for (x = w; x > 0; x--) {
-            buffer[i++] = hi;
-            buffer[i++] = lo;
-            // Here its possible to overflow the buffer size
-            if (i == BUFFER_SIZE) {
-                st7735_data_len(buffer, i);
-                i = 0;
-            }
-        }
-    }
-
-    st7735_data_len(buffer, i);
+    st7735_fill_window((uint32_t)w * h, colour);
 }
 
 // Pass 8-bit (each) R,G,B, get back 16-bit packed colour
@@ -682,80 +921,201 @@ void st7735_draw_16bit_bitmap(int16_t x, int16_t y, const uint8_t *bitmap,
 {
     uint16_t i, j;
     uint8_t hi, lo;
+    uint8_t *strip;
     i = j = 0;
 
+#ifdef ST7735_FRAMEBUFFER
+    const uint16_t bg = fb_colour(bg_color);
+    int16_t cx = x, cy = y, cw = w, ch = h;
+
+    if (!fb_clip(&cx, &cy, &cw, &ch)) {
+        return;
+    }
+
+    st7735_wait();
+
+    for (int16_t py = cy; py < cy + ch; py++) {
+        const uint8_t *src = &bitmap[((py - y) * w + (cx - x)) * 2];
+        uint16_t *dst = &framebuffer[py * width + cx];
+
+        for (int16_t n = cw; n > 0; n--, src += 2) {
+            if ((src[0] == 0) && (src[1] == 0)) {
+                *dst++ = bg;
+            } else {
+                *dst++ = src[0] | (src[1] << 8);
+            }
+        }
+    }
+
+    fb_mark_dirty(cx, cy, cx + cw - 1, cy + ch - 1);
+    return;
+#endif
+
     st7735_set_addr_window(x, y, x + w - 1, y + h - 1);
 
     hi = bg_color >> 8;
     lo = bg_color;
 
+    strip = st7735_next_strip();
     for (y = h; y > 0; y--) {
         for (x = w; x > 0; x--) {
             if ((bitmap[j] == 0) && (bitmap[j + 1] == 0)) {
-                buffer[i++] = hi;
-                buffer[i++] = lo;
+                strip[i++] = hi;
+                strip[i++] = lo;
                 j += 2;
             } else {
-                buffer[i++] = bitmap[j++];
-                buffer[i++] = bitmap[j++];
+                strip[i++] = bitmap[j++];
+                strip[i++] = bitmap[j++];
             }
-            // Here its possible to overflow the buffer size
-            if (i == BUFFER_SIZE) {
-                st7735_data_len(buffer, i);
+            // Send the full strip and fill the other one meanwhile
+            if (i == STRIP_SIZE) {
+                st7735_data_len_async(strip, i);
+                strip = st7735_next_strip();
                 i = 0;
             }
         }
     }
 
-    st7735_data_len(buffer, i);
+    st7735_data_len_async(strip, i);
+}
+
+/*
+ * Replace the transparent (0x0000) pixels of an image in the panel byte order
+ * with BG, also in the panel byte order. The pixels are checked two at a time.
+ */
+static void st7735_replace_transparent(uint8_t *data, uint32_t len, uint16_t bg)
+{
+    // Framebuffer rows can start on a half word
+    if ((len >= 2) && ((uintptr_t)data & 2)) {
+        uint16_t *first = (uint16_t *)data;
+        if (*first == 0) {
+            *first = bg;
+        }
+        data += 2;
+        len -= 2;
+    }
+
+    uint32_t *words = (uint32_t *)data;
+    uint32_t n_words = len / 4;
+
+    for (uint32_t i = 0; i < n_words; i++) {
+        uint32_t value = words[i];
+
+        if ((value & 0xFFFF) && (value >> 16)) {
+            continue;
+        }
+
+        if (!(value & 0xFFFF)) {
+            value |= bg;
+        }
+        if (!(value >> 16)) {
+            value |= (uint32_t)bg << 16;
+        }
+        words[i] = value;
+    }
+
+    if (len % 4) {
+        uint16_t *last = (uint16_t *)&words[n_words];
+        if (*last == 0) {
+            *last = bg;
+        }
+    }
 }
 
 // Draw an image from the external flash.
-// TODO: this was duplicated from st7735_draw_16bit_bitmap, maybe it could
-// share some code with it.
 void st7735_draw_16bit_ext_bitmap(int16_t x, int16_t y,
                                   const struct bitmap_ext *bitmap_ext,
                                   uint16_t bg_color)
 {
-    static uint8_t flash_buffer[128];
-    uint16_t output_idx = 0;
     uint32_t w = bitmap_ext->width;
     uint32_t h = bitmap_ext->height;
+    // Background colour in the panel byte order
+    uint16_t bg = (bg_color >> 8) | (bg_color << 8);
+    struct bitmap_reader reader;
 
-    st7735_set_addr_window(x, y, x + w - 1, y + h - 1);
+#ifdef ST7735_FRAMEBUFFER
+    int16_t cx = x, cy = y, cw = w, ch = h;
+
+    if (!fb_clip(&cx, &cy, &cw, &ch)) {
+        return;
+    }
+#endif
 
-    uint8_t bg_hi = bg_color >> 8;
-    uint8_t bg_lo = bg_color;
+    if (bitmap_reader_open(&reader, bitmap_ext) != NRF_SUCCESS) {
+        return;
+    }
 
-    uint8_t flash_buffer_idx = 128;
-    uint32_t flash_addr = bitmap_ext->flash_data->offset;
+#ifdef ST7735_FRAMEBUFFER
+    st7735_wait();
 
-    for (y = h; y > 0; y--) {
-        for (x = w; x > 0; x--) {
-            if (flash_buffer_idx >= 128) {
-                flash_read_128(flash_addr, flash_buffer);
-                flash_addr += 128;
-                flash_buffer_idx = 0;
-            }
+    if ((x >= 0) && (x + (int16_t)w <= width) && (y >= 0) &&
+        (y + (int16_t)h <= height)) {
+        // The pixels come in the framebuffer byte order, stream each row right
+        // where it belongs.
+        for (uint32_t j = 0; j < h; j++) {
+            uint16_t *row = &framebuffer[(y + j) * width + x];
 
-            if ((flash_buffer[flash_buffer_idx] == 0) &&
-                (flash_buffer[flash_buffer_idx + 1] == 0)) {
-                buffer[output_idx++] = bg_hi;
-                buffer[output_idx++] = bg_lo;
-                flash_buffer_idx += 2;
-            } else {
-                buffer[output_idx++] = flash_buffer[flash_buffer_idx++];
-                buffer[output_idx++] = flash_buffer[flash_buffer_idx++];
+            bitmap_reader_read(&reader, (uint8_t *)row, w);
+            if (bg) {
+                st7735_replace_transparent((uint8_t *)row,
+                                           w * BYTES_PER_PIXEL, bg);
             }
-            // Here its possible to overflow the buffer size
-            if (output_idx == BUFFER_SIZE) {
-                st7735_data_len(buffer, output_idx);
-                output_idx = 0;
+        }
+    } else {
+        static uint8_t flash_buffer[256];
+        uint16_t flash_buffer_idx = sizeof(flash_buffer);
+
+        for (uint32_t j = 0; j < h; j++) {
+            for (uint32_t i = 0; i < w; i++) {
+                int16_t px = x + i;
+                int16_t py = y + j;
+                uint16_t value;
+
+                if (flash_buffer_idx >= sizeof(flash_buffer)) {
+                    bitmap_reader_read(&reader, flash_buffer,
+                                       sizeof(flash_buffer) / BYTES_PER_PIXEL);
+                    flash_buffer_idx = 0;
+                }
+
+                value = flash_buffer[flash_buffer_idx] |
+                        (flash_buffer[flash_buffer_idx + 1] << 8);
+                flash_buffer_idx += 2;
+
+                if ((px < 0) || (px >= width) || (py < 0) ||
+                    (py >= height)) {
+                    continue;
+                }
+
+                framebuffer[py * width + px] = value ? value : bg;
             }
         }
     }
 
-    st7735_data_len(buffer, output_idx);
+    bitmap_reader_close(&reader);
+
+    fb_mark_dirty(cx, cy, cx + cw - 1, cy + ch - 1);
+    return;
+#endif
+
+    st7735_set_addr_window(x, y, x + w - 1, y + h - 1);
+
+    // The image is read straight into one strip while the previous one is
+    // being sent to the LCD, both buses run at the same time.
+    uint32_t remaining = w * h * BYTES_PER_PIXEL;
+    while (remaining > 0) {
+        uint8_t *strip = st7735_next_strip();
+        uint32_t len = MIN(remaining, STRIP_SIZE);
+
+        bitmap_reader_read(&reader, strip, len / BYTES_PER_PIXEL);
+        if (bg) {
+            st7735_replace_transparent(strip, len, bg);
+        }
+
+        st7735_data_len_async(strip, len);
+        remaining -= len;
+    }
+
+    bitmap_reader_close(&reader);
 }
 
 void st7735_set_rotation(uint8_t m)
@@ -785,6 +1145,10 @@ void st7735_set_rotation(uint8_t m)
         break;
     }
 
+#ifdef ST7735_FRAMEBUFFER
+    fb_mark_dirty(0, 0, width - 1, height - 1);
+#endif
+
     gfx_set_rotation(m);
 }
 
@@ -160,5 +160,10 @@ void st7735_partial_on(void);
 void st7735_slow_down(void);
 void st7735_speed_up(void);
 void st7735_set_model(uint8_t model);
+#ifdef ST7735_FRAMEBUFFER
+void st7735_scroll_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                        int16_t dy);
+void st7735_update(void);
+#endif
 
 #endif
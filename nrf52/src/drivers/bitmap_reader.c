@@ -0,0 +1,128 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#include <string.h>
+
+#include <app_util.h>
+
+#include "app/external_flash.h"
+#include "bitmap_reader.h"
+
+ret_code_t bitmap_reader_open(struct bitmap_reader *reader,
+                              const struct bitmap_ext *bitmap)
+{
+    reader->encoding = bitmap->encoding;
+    reader->buf_idx = 0;
+    reader->buf_len = 0;
+    reader->packet_left = 0;
+
+    return flash_stream_open(&reader->stream, bitmap->flash_data->offset);
+}
+
+static ret_code_t bitmap_reader_next_byte(struct bitmap_reader *reader,
+                                          uint8_t *byte)
+{
+    if (reader->buf_idx == reader->buf_len) {
+        // The stream may run past the end of the image, that's harmless.
+        ret_code_t ret =
+            flash_stream_read(&reader->stream, reader->buf, sizeof(reader->buf));
+        if (ret != NRF_SUCCESS) {
+            return ret;
+        }
+
+        reader->buf_idx = 0;
+        reader->buf_len = sizeof(reader->buf);
+    }
+
+    *byte = reader->buf[reader->buf_idx++];
+
+    return NRF_SUCCESS;
+}
+
+static ret_code_t bitmap_reader_read_rle(struct bitmap_reader *reader,
+                                         uint8_t *pixels, uint32_t n_pixels)
+{
+    ret_code_t ret;
+
+    while (n_pixels > 0) {
+        if (reader->packet_left == 0) {
+            uint8_t header;
+
+            ret = bitmap_reader_next_byte(reader, &header);
+            if (ret != NRF_SUCCESS) {
+                return ret;
+            }
+
+            reader->packet_run = header & 0x80;
+            reader->packet_left = (header & 0x7f) + 1;
+
+            if (reader->packet_run) {
+                ret = bitmap_reader_next_byte(reader, &reader->run_colour[0]);
+                if (ret == NRF_SUCCESS) {
+                    ret = bitmap_reader_next_byte(reader,
+                                                  &reader->run_colour[1]);
+                }
+                if (ret != NRF_SUCCESS) {
+                    return ret;
+                }
+            }
+        }
+
+        uint32_t count = MIN(n_pixels, reader->packet_left);
+
+        if (reader->packet_run) {
+            for (uint32_t i = 0; i < count; i++) {
+                *pixels++ = reader->run_colour[0];
+                *pixels++ = reader->run_colour[1];
+            }
+        } else {
+            uint32_t len = count * 2;
+
+            while (len > 0) {
+                uint32_t avail = reader->buf_len - reader->buf_idx;
+
+                if (avail == 0) {
+                    ret = bitmap_reader_next_byte(reader, pixels);
+                    if (ret != NRF_SUCCESS) {
+                        return ret;
+                    }
+                    pixels++;
+                    len--;
+                    continue;
+                }
+
+                avail = MIN(avail, len);
+                memcpy(pixels, &reader->buf[reader->buf_idx], avail);
+                reader->buf_idx += avail;
+                pixels += avail;
+                len -= avail;
+            }
+        }
+
+        reader->packet_left -= count;
+        n_pixels -= count;
+    }
+
+    return NRF_SUCCESS;
+}
+
+/*
+ * Read the next N_PIXELS pixels of the image, in the RGB565 big endian order
+ * the displays expect.
+ */
+ret_code_t bitmap_reader_read(struct bitmap_reader *reader, uint8_t *pixels,
+                              uint32_t n_pixels)
+{
+    if (reader->encoding == image_encoding_565rle) {
+        return bitmap_reader_read_rle(reader, pixels, n_pixels);
+    }
+
+    return flash_stream_read(&reader->stream, pixels, n_pixels * 2);
+}
+
+void bitmap_reader_close(struct bitmap_reader *reader)
+{
+    flash_stream_close(&reader->stream);
+}
@@ -0,0 +1,39 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef BITMAP_READER_H
+#define BITMAP_READER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <bitmap.h>
+#include <sdk_errors.h>
+
+#include "flash.h"
+
+// Sequential reader for the pixels of an external flash image, whatever its
+// encoding.  It holds the flash stream open until bitmap_reader_close.
+
+struct bitmap_reader {
+    struct flash_stream stream;
+    enum image_encoding encoding;
+
+    // RLE state
+    uint8_t buf[128];
+    uint16_t buf_idx, buf_len;
+    // Pixels left in the current packet, and whether it is a run
+    uint8_t packet_left;
+    bool packet_run;
+    uint8_t run_colour[2];
+};
+
+ret_code_t bitmap_reader_open(struct bitmap_reader *reader,
+                              const struct bitmap_ext *bitmap);
+ret_code_t bitmap_reader_read(struct bitmap_reader *reader, uint8_t *pixels,
+                              uint32_t n_pixels);
+void bitmap_reader_close(struct bitmap_reader *reader);
+
+#endif // BITMAP_READER_H
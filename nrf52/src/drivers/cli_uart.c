@@ -22,26 +22,94 @@
 
 #include "cli_uart.h"
 
+#include <app_error.h>
 #include <nrf_cli.h>
-#include <nrf_cli_uart.h>
 
-#include <boards.h>
+#include "uart.h"
 
-NRF_CLI_UART_DEF(m_cli_uart_transport, 0, 512, 512);
-NRF_CLI_DEF(m_cli_uart, "nsec> ", &m_cli_uart_transport.transport, '\r', 4);
+/* The CLI transport, on top of the uart driver.  The driver buffers both
+   ways, so long outputs are queued instead of waited for.  */
+
+static nrf_cli_transport_handler_t transport_handler;
+static void *transport_context;
+
+static void cli_uart_event_handler(enum uart_event event, void *context) {
+    transport_handler(event == UART_EVENT_RX_READY
+                          ? NRF_CLI_TRANSPORT_EVT_RX_RDY
+                          : NRF_CLI_TRANSPORT_EVT_TX_RDY,
+                      transport_context);
+}
+
+static ret_code_t cli_uart_transport_init(nrf_cli_transport_t const *p_transport,
+                                          void const *p_config,
+                                          nrf_cli_transport_handler_t evt_handler,
+                                          void *p_context) {
+    transport_handler = evt_handler;
+    transport_context = p_context;
+
+    ret_code_t ret = uart_init();
+    if (ret != NRF_SUCCESS) {
+        return ret;
+    }
+
+    uart_set_event_handler(cli_uart_event_handler, NULL);
+
+    return NRF_SUCCESS;
+}
+
+static ret_code_t
+cli_uart_transport_uninit(nrf_cli_transport_t const *p_transport) {
+    uart_set_event_handler(NULL, NULL);
+
+    return NRF_SUCCESS;
+}
+
+/* BLOCKING is requested when the CLI can't rely on interrupts anymore, to
+   print the last logs on a fault.  */
+static ret_code_t cli_uart_transport_enable(nrf_cli_transport_t const *p_transport,
+                                            bool blocking) {
+    uart_set_polling(blocking);
+
+    return NRF_SUCCESS;
+}
+
+static ret_code_t cli_uart_transport_write(nrf_cli_transport_t const *p_transport,
+                                           const void *p_data, size_t length,
+                                           size_t *p_cnt) {
+    *p_cnt = uart_write(p_data, length);
+
+    return NRF_SUCCESS;
+}
+
+static ret_code_t cli_uart_transport_read(nrf_cli_transport_t const *p_transport,
+                                          void *p_data, size_t length,
+                                          size_t *p_cnt) {
+    *p_cnt = uart_read_available(p_data, length);
+
+    return NRF_SUCCESS;
+}
+
+static const nrf_cli_transport_api_t cli_uart_transport_api = {
+    .init = cli_uart_transport_init,
+    .uninit = cli_uart_transport_uninit,
+    .enable = cli_uart_transport_enable,
+    .write = cli_uart_transport_write,
+    .read = cli_uart_transport_read,
+};
+
+static const nrf_cli_transport_t m_cli_uart_transport = {
+    .p_api = &cli_uart_transport_api,
+};
+
+NRF_CLI_DEF(m_cli_uart, "nsec> ", &m_cli_uart_transport, '\r', 4);
 
 const nrf_cli_t *const p_cli_uart = &m_cli_uart;
 
-/* Initialize Nordic's CLI module, using the UART transport. */
+/* Initialize Nordic's CLI module, using the uart driver as transport.  */
 
 void cli_uart_init(void) {
-    nrf_drv_uart_config_t uart_config = NRF_DRV_UART_DEFAULT_CONFIG;
-
-    uart_config.pseltxd = PIN_nRF_TXD;
-    uart_config.pselrxd = PIN_nRF_RXD;
-    uart_config.hwfc = NRF_UART_HWFC_DISABLED;
     ret_code_t ret =
-        nrf_cli_init(&m_cli_uart, &uart_config, /*use_colors=*/true,
+        nrf_cli_init(&m_cli_uart, NULL, /*use_colors=*/true,
                      /*log_backend=*/false, NRF_LOG_SEVERITY_INFO);
 
     APP_ERROR_CHECK(ret);
@@ -31,11 +31,17 @@ struct display_ops {
     void (*fill_screen_white)(void);
     void (*draw_fast_hline)(int16_t x, int16_t y, int16_t w, uint16_t color);
     void (*draw_fast_vline)(int16_t x, int16_t y, int16_t h, uint16_t color);
+    void (*fill_rect)(int16_t x, int16_t y, int16_t w, int16_t h,
+                      uint16_t color);
+    void (*draw_bitmap)(int16_t x, int16_t y, const uint8_t *bitmap,
+                        int16_t w, int16_t h, uint16_t color, uint16_t bg);
     void (*draw_16bit_bitmap)(int16_t x, int16_t y, const uint8_t *bitmap,
                               int16_t w, int16_t h, uint16_t bg_color);
     void (*draw_16bit_ext_bitmap)(int16_t x, int16_t y,
                                   const struct bitmap_ext *bitmap,
                                   uint16_t bg_color);
+    void (*scroll_rect)(int16_t x, int16_t y, int16_t w, int16_t h,
+                        int16_t dy);
     void (*set_brightness)(uint8_t brightness);
     void (*update)(void);
     void (*slow_down)(void);
@@ -51,10 +57,21 @@ static struct display_ops st7735_ops = {&st7735_init,
                                         &st7735_fill_screen_white,
                                         &st7735_draw_fast_hline,
                                         &st7735_draw_fast_vline,
+                                        &st7735_fill_rect,
+                                        NULL,
                                         &st7735_draw_16bit_bitmap,
                                         &st7735_draw_16bit_ext_bitmap,
+#ifdef ST7735_FRAMEBUFFER
+                                        &st7735_scroll_rect,
+#else
+                                        NULL,
+#endif
                                         &st7735_set_brightness,
+#ifdef ST7735_FRAMEBUFFER
+                                        &st7735_update,
+#else
                                         NULL,
+#endif
                                         &st7735_slow_down,
                                         &st7735_speed_up,
                                         &st7735_set_model};
@@ -69,8 +86,11 @@ static struct display_ops ssd1306_ops = {&ssd1306_init,
                                          &ssd1306_fill_screen_white,
                                          &ssd1306_draw_fast_hline,
                                          &ssd1306_draw_fast_vline,
+                                         &ssd1306_fill_rect,
+                                         &ssd1306_draw_bitmap,
                                          NULL,
                                          NULL,
+                                         &ssd1306_scroll_rect,
                                          NULL,
                                          &ssd1306_update,
                                          NULL,
@@ -99,6 +119,36 @@ void display_draw_fast_vline(int16_t x, int16_t y, int16_t w, uint16_t color) {
     ops->draw_fast_vline(x, y, w, color);
 }
 
+void display_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                       uint16_t color) {
+    if (ops->fill_rect) {
+        ops->fill_rect(x, y, w, h, color);
+    } else {
+        for (int16_t i = x; i < x + w; i++) {
+            ops->draw_fast_vline(i, y, h, color);
+        }
+    }
+}
+
+void display_draw_bitmap(int16_t x, int16_t y, const uint8_t *bitmap,
+                         int16_t w, int16_t h, uint16_t color, uint16_t bg) {
+    if (ops->draw_bitmap) {
+        ops->draw_bitmap(x, y, bitmap, w, h, color, bg);
+    } else {
+        int16_t byte_width = (w + 7) / 8;
+
+        for (int16_t j = 0; j < h; j++) {
+            for (int16_t i = 0; i < w; i++) {
+                if (bitmap[j * byte_width + i / 8] & (128 >> (i & 7))) {
+                    ops->draw_pixel(x + i, y + j, color);
+                } else {
+                    ops->draw_pixel(x + i, y + j, bg);
+                }
+            }
+        }
+    }
+}
+
 void display_draw_16bit_bitmap(int16_t x, int16_t y, const uint8_t *bitmap,
                                int16_t w, int16_t h, uint16_t bg_color) {
     if (ops->draw_16bit_bitmap) {
@@ -114,6 +164,22 @@ void display_draw_16bit_ext_bitmap(int16_t x, int16_t y,
     }
 }
 
+/*
+ * Move the content of a rectangle up by dy rows (down if dy is negative).
+ * The rows left behind keep their old content, the caller draws them.
+ * Returns false if the display can't move pixels, everything has to be
+ * redrawn then.
+ */
+bool display_scroll_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                         int16_t dy) {
+    if (!ops->scroll_rect) {
+        return false;
+    }
+
+    ops->scroll_rect(x, y, w, h, dy);
+    return true;
+}
+
 void display_set_brightness(uint8_t brightness) {
     if (ops->set_brightness) {
         ops->set_brightness(brightness);
@@ -24,6 +24,7 @@
 #define _DISPLAY_H
 
 #include <nrf.h>
+#include <stdbool.h>
 
 struct bitmap_ext;
 
@@ -78,11 +79,17 @@ void display_fill_screen_black(void);
 void display_fill_screen_white(void);
 void display_draw_fast_hline(int16_t x, int16_t y, int16_t w, uint16_t color);
 void display_draw_fast_vline(int16_t x, int16_t y, int16_t w, uint16_t color);
+void display_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                       uint16_t color);
+void display_draw_bitmap(int16_t x, int16_t y, const uint8_t *bitmap,
+                         int16_t w, int16_t h, uint16_t color, uint16_t bg);
 void display_draw_16bit_bitmap(int16_t x, int16_t y, const uint8_t *bitmap,
                                int16_t w, int16_t h, uint16_t bg_color);
 void display_draw_16bit_ext_bitmap(int16_t x, int16_t y,
                                    const struct bitmap_ext *bitmap_ext,
                                    uint16_t bg_color);
+bool display_scroll_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                         int16_t dy);
 void display_update(void);
 void display_set_brightness(uint8_t brightness);
 void display_slow_down(void);
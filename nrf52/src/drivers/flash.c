@@ -20,12 +20,14 @@
  * SOFTWARE.
  */
 
-#include <string.h>
-
+#include <app_timer.h>
+#include <app_util.h>
 #include <app_util_platform.h>
 #include <nrf_drv_spi.h>
+#include <nrf_gpio.h>
 
 #include "boards.h"
+#include "flash.h"
 
 #define SPI_DEFAULT_CONFIG_IRQ_PRIORITY APP_IRQ_PRIORITY_LOW
 
@@ -37,8 +39,65 @@
 
 #define READ_STATUS_REGISTER_1_BUSY 0x1
 
+/* Programming is done by chunks of at most this size, aligned on it.  The
+   chip pages are at least this big.  */
+#define FLASH_PAGE_SIZE 128
+
+#define FLASH_SECTOR_SIZE 4096
+
+/* EasyDMA can't move more than this in a single transfer.  */
+#define SPI_MAX_TRANSFER UINT8_MAX
+
+/* How often the busy bit is polled.  A 4 KiB erase takes tens of
+   milliseconds, programming a page less than one.  */
+#define FLASH_ERASE_POLL_MS 5
+#define FLASH_PROGRAM_POLL_MS 1
+
+/* Operations waiting for the chip, see flash_erase_async.  */
+#define FLASH_QUEUE_SIZE 8
+
 static const nrf_drv_spi_t m_spi_master_0 = NRF_DRV_SPI_INSTANCE(0);
 
+/* Set when a stream holds the chip selected.  */
+static bool stream_open = false;
+/* Set while the chip is selected, in the middle of a command.  */
+static volatile bool chip_selected = false;
+
+enum flash_op_type {
+    FLASH_OP_ERASE,
+    FLASH_OP_WRITE,
+};
+
+/* A queued erase or write.  ADDRESS, DATA and LEN advance as the pages are
+   programmed, the operation is complete once LEN is 0.  */
+struct flash_op {
+    enum flash_op_type type;
+    uint32_t address;
+    const uint8_t *data;
+    size_t len;
+    flash_callback_t callback;
+    void *context;
+};
+
+static struct flash_op queue[FLASH_QUEUE_SIZE];
+static uint8_t queue_head = 0;
+static uint8_t queue_count = 0;
+
+/* The chip is erasing or programming for the operation at the head of the
+   queue.  */
+static volatile bool chip_busy = false;
+/* Result of the last step of the operation at the head of the queue.  */
+static ret_code_t step_result = NRF_SUCCESS;
+
+APP_TIMER_DEF(m_poll_timer_id);
+/* The poll timer fired, flash_process has to check the busy bit.  */
+static volatile bool poll_requested = false;
+static uint32_t poll_ticks;
+
+static void poll_timer_handler(void *p_context) {
+    poll_requested = true;
+}
+
 /* Initialize the external flash module.  */
 
 void flash_init() {
@@ -48,16 +107,94 @@ void flash_init() {
     config.mosi_pin = PIN_FLASH_MOSI;
     config.miso_pin = PIN_FLASH_MISO;
     config.sck_pin = PIN_FLASH_CLK;
-    config.ss_pin = PIN_FLASH_CS;
+
+    /* The chip select is driven by hand so that a single read command can
+       span as many transfers as needed.  */
+    config.ss_pin = NRF_DRV_SPI_PIN_NOT_USED;
+    nrf_gpio_pin_set(PIN_FLASH_CS);
+    nrf_gpio_cfg_output(PIN_FLASH_CS);
 
     APP_ERROR_CHECK(nrf_drv_spi_init(&m_spi_master_0, &config, NULL, NULL));
+
+    APP_ERROR_CHECK(app_timer_create(&m_poll_timer_id,
+                                     APP_TIMER_MODE_SINGLE_SHOT,
+                                     poll_timer_handler));
+}
+
+static void flash_select() {
+    chip_selected = true;
+    nrf_gpio_pin_clear(PIN_FLASH_CS);
+}
+
+static void flash_deselect() {
+    nrf_gpio_pin_set(PIN_FLASH_CS);
+    chip_selected = false;
+}
+
+/* Return whether a command or an erase/program step is in progress.  Code
+   that interrupted the flash driver, like the error handler, must not use the
+   flash then: the driver isn't reentrant and the chip is mid-command.  */
+
+bool flash_is_busy() {
+    return chip_selected || chip_busy;
+}
+
+/* Send a complete command, with the chip selected for its whole duration.  */
+
+static ret_code_t flash_command(const uint8_t *tx, uint8_t tx_len, uint8_t *rx,
+                                uint8_t rx_len) {
+    if (stream_open)
+        return NRF_ERROR_BUSY;
+
+    flash_select();
+    ret_code_t ret =
+        nrf_drv_spi_transfer(&m_spi_master_0, tx, tx_len, rx, rx_len);
+    flash_deselect();
+
+    return ret;
+}
+
+/* Clock LEN bytes out of the selected chip straight into DATA.  */
+
+static ret_code_t flash_receive(uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t chunk = MIN(len, SPI_MAX_TRANSFER);
+
+        /* A 1-byte SPIM reception clocks an extra byte (nRF52832 anomaly
+           58), which would be lost from the stream.  Never leave a single
+           byte for the last transfer, and go through a bounce buffer when
+           only one byte is wanted.  */
+        if (len - chunk == 1)
+            chunk--;
+
+        if (chunk == 1) {
+            uint8_t bounce[2];
+            ret_code_t ret =
+                nrf_drv_spi_transfer(&m_spi_master_0, NULL, 0, bounce, 2);
+            if (ret != NRF_SUCCESS)
+                return ret;
+
+            *data = bounce[0];
+            return NRF_SUCCESS;
+        }
+
+        ret_code_t ret =
+            nrf_drv_spi_transfer(&m_spi_master_0, NULL, 0, data, chunk);
+        if (ret != NRF_SUCCESS)
+            return ret;
+
+        data += chunk;
+        len -= chunk;
+    }
+
+    return NRF_SUCCESS;
 }
 
 static ret_code_t flash_read_status_register_1(uint8_t *value) {
     uint8_t tx = READ_STATUS_REGISTER_1_COMMAND;
     uint8_t rx[2];
 
-    ret_code_t ret = nrf_drv_spi_transfer(&m_spi_master_0, &tx, 1, rx, 2);
+    ret_code_t ret = flash_command(&tx, 1, rx, 2);
     if (ret != NRF_SUCCESS)
         return ret;
 
@@ -80,73 +217,371 @@ static ret_code_t flash_wait_for_completion() {
     }
 }
 
-/* Read 128 bytes of flash.  */
+static ret_code_t write_enable() {
+    uint8_t tx = WRITE_ENABLE_COMMAND;
+
+    return flash_command(&tx, 1, NULL, 0);
+}
+
+/* Send the command erasing the 4096-bytes block containing ADDRESS.  */
+
+static ret_code_t flash_start_erase(uint32_t address) {
+    ret_code_t ret = write_enable();
+    if (ret != NRF_SUCCESS)
+        return ret;
 
-ret_code_t flash_read_128(int address, uint8_t *data) {
     uint8_t tx[4];
-    tx[0] = FLASH_READ_COMMAND;
+    tx[0] = FLASH_ERASE_4K_COMMAND;
     tx[1] = (address >> 16) & 0xff;
     tx[2] = (address >> 8) & 0xff;
     tx[3] = address & 0xff;
 
-    uint8_t rx[sizeof(tx) + 128];
-    ret_code_t ret =
-        nrf_drv_spi_transfer(&m_spi_master_0, tx, sizeof(tx), rx, sizeof(rx));
-    if (ret != NRF_SUCCESS) {
+    return flash_command(tx, sizeof(tx), NULL, 0);
+}
+
+/* Send the command programming LEN bytes at ADDRESS, which must not cross a
+   page.  */
+
+static ret_code_t flash_start_program(uint32_t address, const uint8_t *data,
+                                      size_t len) {
+    ret_code_t ret = write_enable();
+    if (ret != NRF_SUCCESS)
         return ret;
+
+    uint8_t tx[4];
+    tx[0] = FLASH_WRITE_COMMAND;
+    tx[1] = (address >> 16) & 0xff;
+    tx[2] = (address >> 8) & 0xff;
+    tx[3] = address & 0xff;
+
+    flash_select();
+    ret = nrf_drv_spi_transfer(&m_spi_master_0, tx, sizeof(tx), NULL, 0);
+    if (ret == NRF_SUCCESS)
+        ret = nrf_drv_spi_transfer(&m_spi_master_0, data, len, NULL, 0);
+    flash_deselect();
+
+    return ret;
+}
+
+/* Start the next step of OP: the erase, or programming up to the end of the
+   current page.  */
+
+static void flash_start_step(struct flash_op *op) {
+    if (op->type == FLASH_OP_ERASE) {
+        step_result = flash_start_erase(op->address);
+        op->len = 0;
+        poll_ticks = APP_TIMER_TICKS(FLASH_ERASE_POLL_MS);
+    } else {
+        /* A program command wraps around at the end of a page.  */
+        size_t chunk =
+            MIN(op->len, FLASH_PAGE_SIZE - op->address % FLASH_PAGE_SIZE);
+
+        step_result = flash_start_program(op->address, op->data, chunk);
+        op->address += chunk;
+        op->data += chunk;
+        op->len -= chunk;
+        poll_ticks = APP_TIMER_TICKS(FLASH_PROGRAM_POLL_MS);
+    }
+
+    if (step_result != NRF_SUCCESS)
+        return;
+
+    chip_busy = true;
+    APP_ERROR_CHECK(app_timer_start(m_poll_timer_id, poll_ticks, NULL));
+}
+
+/* Wait for the chip to finish the step in progress, if any.  */
+
+static void flash_settle() {
+    if (!chip_busy)
+        return;
+
+    app_timer_stop(m_poll_timer_id);
+    poll_requested = false;
+
+    step_result = flash_wait_for_completion();
+    chip_busy = false;
+}
+
+/* Return whether a queued operation still has to change a byte in
+   [ADDRESS, ADDRESS + LEN).  */
+
+static bool queue_overlaps(uint32_t address, size_t len) {
+    for (uint8_t i = 0; i < queue_count; i++) {
+        const struct flash_op *op =
+            &queue[(queue_head + i) % FLASH_QUEUE_SIZE];
+        uint32_t start = op->address;
+        uint32_t end = op->address + op->len;
+
+        if (op->type == FLASH_OP_ERASE) {
+            start -= start % FLASH_SECTOR_SIZE;
+            end = start + FLASH_SECTOR_SIZE;
+        } else if (op->len == 0) {
+            continue;
+        }
+
+        if (address < end && start < address + len)
+            return true;
     }
 
-    memcpy(data, rx + sizeof(tx), 128);
+    return false;
+}
+
+/* Pop the operation at the head of the queue and report its result.  */
+
+static void flash_complete_head() {
+    struct flash_op op = queue[queue_head];
+    ret_code_t result = step_result;
+
+    queue_head = (queue_head + 1) % FLASH_QUEUE_SIZE;
+    queue_count--;
+    step_result = NRF_SUCCESS;
+
+    if (op.callback)
+        op.callback(result, op.context);
+}
+
+/* Move the queue forward until the chip is busy or there is nothing left to
+   do.  Callbacks may queue more operations.  */
+
+static void flash_run() {
+    while (!chip_busy && !stream_open && queue_count > 0) {
+        struct flash_op *op = &queue[queue_head];
+
+        if (op->len == 0 || step_result != NRF_SUCCESS)
+            flash_complete_head();
+        else
+            flash_start_step(op);
+    }
+}
+
+static ret_code_t flash_enqueue(enum flash_op_type type, uint32_t address,
+                                const uint8_t *data, size_t len,
+                                flash_callback_t callback, void *context) {
+    if (queue_count == FLASH_QUEUE_SIZE)
+        return NRF_ERROR_NO_MEM;
+
+    struct flash_op *op =
+        &queue[(queue_head + queue_count) % FLASH_QUEUE_SIZE];
+    op->type = type;
+    op->address = address;
+    op->data = data;
+    op->len = len;
+    op->callback = callback;
+    op->context = context;
+    queue_count++;
+
+    flash_run();
 
     return NRF_SUCCESS;
 }
 
-static ret_code_t write_enable() {
-    uint8_t tx = WRITE_ENABLE_COMMAND;
+/* Queue the erase of the 4096-bytes block containing ADDRESS.  CALLBACK, if
+   not NULL, is called with the result from flash_process, or from whatever
+   flash function has to wait for the erase.  */
 
-    return nrf_drv_spi_transfer(&m_spi_master_0, &tx, 1, NULL, 0);
+ret_code_t flash_erase_async(uint32_t address, flash_callback_t callback,
+                             void *context) {
+    /* The length only marks the operation as pending.  */
+    return flash_enqueue(FLASH_OP_ERASE, address, NULL, FLASH_SECTOR_SIZE,
+                         callback, context);
 }
 
-/* Erase the 4096-bytes block of data containing ADDRESS.  */
+/* Queue a write of LEN bytes at ADDRESS, which needs to have been erased.
+   DATA must be in RAM, and stay untouched until CALLBACK is called.  */
 
-ret_code_t flash_erase(int address) {
-    ret_code_t ret = write_enable();
-    if (ret != NRF_SUCCESS)
-        return ret;
+ret_code_t flash_write_async(uint32_t address, const uint8_t *data,
+                             size_t len, flash_callback_t callback,
+                             void *context) {
+    return flash_enqueue(FLASH_OP_WRITE, address, data, len, callback,
+                         context);
+}
+
+/* Wait for all the queued operations to complete.  */
+
+ret_code_t flash_flush() {
+    if (stream_open)
+        return NRF_ERROR_BUSY;
+
+    while (queue_count > 0) {
+        flash_settle();
+        flash_run();
+    }
+
+    return NRF_SUCCESS;
+}
+
+/* Check the busy bit when the poll timer asks for it, and start the next
+   step once the chip is done.  Called from the main loop.  */
+
+void flash_process() {
+    if (!chip_busy || !poll_requested)
+        return;
+
+    poll_requested = false;
+
+    /* A stream holds the chip select, try again later.  */
+    uint8_t status = READ_STATUS_REGISTER_1_BUSY;
+    ret_code_t ret = NRF_SUCCESS;
+    if (!stream_open)
+        ret = flash_read_status_register_1(&status);
+
+    if (ret == NRF_SUCCESS && (status & READ_STATUS_REGISTER_1_BUSY)) {
+        APP_ERROR_CHECK(app_timer_start(m_poll_timer_id, poll_ticks, NULL));
+        return;
+    }
+
+    step_result = ret;
+    chip_busy = false;
+
+    flash_run();
+}
+
+/* Start a streaming read at ADDRESS.  The chip stays selected until
+   flash_stream_close, and the flash keeps incrementing the address on its
+   side, so each flash_stream_read only costs the data itself.
+
+   The chip can't be read while it erases or programs, so this first waits
+   for the step in progress.  The rest of the queue waits for the stream to
+   be closed.  */
+
+ret_code_t flash_stream_open(struct flash_stream *stream, uint32_t address) {
+    if (stream_open)
+        return NRF_ERROR_BUSY;
+
+    flash_settle();
 
     uint8_t tx[4];
-    tx[0] = FLASH_ERASE_4K_COMMAND;
+    tx[0] = FLASH_READ_COMMAND;
     tx[1] = (address >> 16) & 0xff;
     tx[2] = (address >> 8) & 0xff;
     tx[3] = address & 0xff;
-    ret = nrf_drv_spi_transfer(&m_spi_master_0, tx, sizeof(tx), NULL, 0);
-    if (ret != NRF_SUCCESS)
+
+    flash_select();
+    ret_code_t ret =
+        nrf_drv_spi_transfer(&m_spi_master_0, tx, sizeof(tx), NULL, 0);
+    if (ret != NRF_SUCCESS) {
+        flash_deselect();
         return ret;
+    }
 
-    return flash_wait_for_completion();
+    stream_open = true;
+    stream->address = address;
+
+    return NRF_SUCCESS;
 }
 
-/* Write 128 bytes of flash.  The address must be a multiple of 128.  */
+/* Read the next LEN bytes of the stream.  */
 
-ret_code_t flash_write_128(int address, const uint8_t *data) {
-    if (address % 128 != 0) {
-        return NRF_ERROR_INVALID_PARAM;
+ret_code_t flash_stream_read(struct flash_stream *stream, uint8_t *data,
+                             size_t len) {
+    if (!stream_open)
+        return NRF_ERROR_INVALID_STATE;
+
+    /* Queued data has to land before it is read back.  */
+    if (queue_overlaps(stream->address, len)) {
+        flash_stream_close(stream);
+
+        ret_code_t ret = flash_flush();
+        if (ret == NRF_SUCCESS)
+            ret = flash_stream_open(stream, stream->address);
+        if (ret != NRF_SUCCESS)
+            return ret;
     }
 
-    ret_code_t ret = write_enable();
+    ret_code_t ret = flash_receive(data, len);
     if (ret != NRF_SUCCESS)
         return ret;
 
-    uint8_t tx[1 + 3 + 128];
-    tx[0] = FLASH_WRITE_COMMAND;
-    tx[1] = (address >> 16) & 0xff;
-    tx[2] = (address >> 8) & 0xff;
-    tx[3] = address & 0xff;
-    memcpy(tx + 4, data, 128);
+    stream->address += len;
 
-    ret = nrf_drv_spi_transfer(&m_spi_master_0, tx, sizeof(tx), NULL, 0);
+    /* A 1-byte read clocked one byte too many out of the chip, restart the
+       read command where the stream really is.  */
+    if (len == 1) {
+        flash_deselect();
+        stream_open = false;
+
+        return flash_stream_open(stream, stream->address);
+    }
+
+    return NRF_SUCCESS;
+}
+
+void flash_stream_close(struct flash_stream *stream) {
+    flash_deselect();
+    stream_open = false;
+
+    flash_run();
+}
+
+/* Read LEN bytes of flash at ADDRESS, with a single read command.  */
+
+ret_code_t flash_read(uint32_t address, uint8_t *data, size_t len) {
+    struct flash_stream stream;
+
+    ret_code_t ret = flash_stream_open(&stream, address);
     if (ret != NRF_SUCCESS)
         return ret;
 
-    return flash_wait_for_completion();
+    ret = flash_stream_read(&stream, data, len);
+    flash_stream_close(&stream);
+
+    return ret;
+}
+
+/* Read 128 bytes of flash.  */
+
+ret_code_t flash_read_128(int address, uint8_t *data) {
+    return flash_read(address, data, 128);
+}
+
+static void flash_sync_callback(ret_code_t result, void *context) {
+    *(ret_code_t *) context = result;
+}
+
+/* Erase the 4096-bytes block of data containing ADDRESS, and wait for it.  */
+
+ret_code_t flash_erase(int address) {
+    ret_code_t result = NRF_SUCCESS;
+    ret_code_t ret =
+        flash_erase_async(address, flash_sync_callback, &result);
+    if (ret == NRF_ERROR_NO_MEM) {
+        ret = flash_flush();
+        if (ret == NRF_SUCCESS)
+            ret = flash_erase_async(address, flash_sync_callback, &result);
+    }
+    if (ret == NRF_SUCCESS)
+        ret = flash_flush();
+
+    return ret != NRF_SUCCESS ? ret : result;
+}
+
+/* Write LEN bytes of flash at ADDRESS, which needs to have been erased, and
+   wait for it.  DATA must be in RAM, EasyDMA can't read from the internal
+   flash.  */
+
+ret_code_t flash_write(uint32_t address, const uint8_t *data, size_t len) {
+    ret_code_t result = NRF_SUCCESS;
+    ret_code_t ret =
+        flash_write_async(address, data, len, flash_sync_callback, &result);
+    if (ret == NRF_ERROR_NO_MEM) {
+        ret = flash_flush();
+        if (ret == NRF_SUCCESS)
+            ret = flash_write_async(address, data, len, flash_sync_callback,
+                                    &result);
+    }
+    if (ret == NRF_SUCCESS)
+        ret = flash_flush();
+
+    return ret != NRF_SUCCESS ? ret : result;
+}
+
+/* Write 128 bytes of flash.  The address must be a multiple of 128.  */
+
+ret_code_t flash_write_128(int address, const uint8_t *data) {
+    if (address % 128 != 0) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    return flash_write(address, data, 128);
 }
@@ -24,10 +24,38 @@
 #define SRC_DRIVERS_FLASH_H
 
 #include <sdk_errors.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A sequential read of the flash, see flash_stream_open.  Only one stream can
+   be open at a time, and no other flash operation can happen meanwhile.  */
+struct flash_stream {
+    /* Address of the next byte to be read.  */
+    uint32_t address;
+};
+
+/* Called when a queued erase or write is complete.  */
+typedef void (*flash_callback_t)(ret_code_t result, void *context);
 
 void flash_init();
+void flash_process();
+ret_code_t flash_erase_async(uint32_t address, flash_callback_t callback,
+                             void *context);
+ret_code_t flash_write_async(uint32_t address, const uint8_t *data,
+                             size_t len, flash_callback_t callback,
+                             void *context);
+ret_code_t flash_flush();
+bool flash_is_busy();
 ret_code_t flash_erase(int address);
+ret_code_t flash_read(uint32_t address, uint8_t *data, size_t len);
 ret_code_t flash_read_128(int address, uint8_t *data);
+ret_code_t flash_write(uint32_t address, const uint8_t *data, size_t len);
 ret_code_t flash_write_128(int address, const uint8_t *data);
 
+ret_code_t flash_stream_open(struct flash_stream *stream, uint32_t address);
+ret_code_t flash_stream_read(struct flash_stream *stream, uint8_t *data,
+                             size_t len);
+void flash_stream_close(struct flash_stream *stream);
+
 #endif // SRC_DRIVERS_FLASH_H
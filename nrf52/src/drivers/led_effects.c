@@ -7,8 +7,9 @@
 #include "boards.h"
 #include "nrf.h"
 #include "nrf_gpio.h"
-#include "nrf_pwm.h"
+#include <app_util_platform.h>
 #include <nrf_delay.h>
+#include <nrf_drv_pwm.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,19 @@
 void show_with_PWM(void);
 void show_with_DWT(void);
 
+// One PWM period per bit, followed by enough low periods (>= 50us) for the
+// LEDs to latch the new colours.
+#define PWM_RESET_LENGTH 40
+#define PWM_SEQUENCE_LENGTH (NEOPIXEL_COUNT * 3 * 8 + PWM_RESET_LENGTH)
+
+#if NEOPIXEL_COUNT > 32
+#error "dirty_pixels has a single bit per pixel"
+#endif
+
+// All the pixels marked dirty, shifted down so 32 pixels don't shift by the
+// full width of the type.
+#define ALL_PIXELS_DIRTY (UINT32_MAX >> (32 - NEOPIXEL_COUNT))
+
 struct Nsec_pixels {
     uint16_t numBytes;
     uint8_t brightness;
@@ -27,55 +41,163 @@ struct Nsec_pixels {
 
 struct Nsec_pixels *nsec_pixels;
 
-uint32_t mapConnect[] = {PIN_NEOPIXEL, NRF_PWM_PIN_NOT_CONNECTED,
-                         NRF_PWM_PIN_NOT_CONNECTED, NRF_PWM_PIN_NOT_CONNECTED};
+static struct Nsec_pixels nsec_pixels_data;
+static uint8_t nsec_pixels_bytes[NEOPIXEL_COUNT * 3];
+
+// The PWM sequence is kept between frames, only the pixels changed since the
+// last show are encoded again.
+static uint16_t pwm_sequence[PWM_SEQUENCE_LENGTH];
+static uint32_t dirty_pixels;
+
+// Gamma 2.2, any colour that isn't off keeps at least the lowest level
+// unless the brightness is 0.
+static const uint8_t gamma_table[256] = {
+      0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+      1,   2,   2,   2,   2,   2,   2,   2,   3,   3,   3,   3,
+      3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,
+     11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,
+     16,  16,  17,  17,  18,  18,  19,  19,  20,  20,  21,  22,
+     22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,
+     39,  39,  40,  41,  42,  43,  43,  44,  45,  46,  47,  48,
+     49,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,
+     60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,
+     87,  88,  89,  90,  91,  93,  94,  95,  97,  98,  99, 100,
+    102, 103, 105, 106, 107, 109, 110, 111, 113, 114, 116, 117,
+    119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154,
+    156, 158, 159, 161, 163, 165, 166, 168, 170, 172, 173, 175,
+    177, 179, 181, 182, 184, 186, 188, 190, 192, 194, 196, 197,
+    199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246,
+    248, 251, 253, 255,
+};
+
+// Gamma and brightness together, what each channel value is sent as. The
+// pixels keep the colours as set, the table is applied while encoding.
+static uint8_t level_table[256];
+
+static void build_level_table(uint8_t brightness) {
+    level_table[0] = 0;
+    for (uint16_t v = 1; v < 256; v++) {
+        uint8_t level = (gamma_table[v] * (brightness + 1)) >> 8;
 
-uint32_t mapDisconnect[] = {
-    NRF_PWM_PIN_NOT_CONNECTED, NRF_PWM_PIN_NOT_CONNECTED,
-    NRF_PWM_PIN_NOT_CONNECTED, NRF_PWM_PIN_NOT_CONNECTED};
+        level_table[v] = (level || brightness == 0) ? level : 1;
+    }
+}
+
+static nrf_drv_pwm_t m_pwm0 = NRF_DRV_PWM_INSTANCE(0);
+
+static nrf_pwm_sequence_t const pwm_seq = {.values.p_common = pwm_sequence,
+                                           .length = PWM_SEQUENCE_LENGTH,
+                                           .repeats = 0,
+                                           .end_delay = 0};
+
+static void pwm_init(void) {
+    nrf_drv_pwm_config_t const config = {
+        .output_pins =
+            {
+                PIN_NEOPIXEL,             // channel 0
+                NRF_DRV_PWM_PIN_NOT_USED, // channel 1
+                NRF_DRV_PWM_PIN_NOT_USED, // channel 2
+                NRF_DRV_PWM_PIN_NOT_USED, // channel 3
+            },
+        .irq_priority = APP_IRQ_PRIORITY_LOWEST,
+        .base_clock = NRF_PWM_CLK_16MHz,
+        .count_mode = NRF_PWM_MODE_UP,
+        .top_value = CTOPVAL,
+        .load_mode = NRF_PWM_LOAD_COMMON,
+        .step_mode = NRF_PWM_STEP_AUTO};
+
+    // The error handler initializes the LEDs again, keep the running driver.
+    // No handler: the end of a frame is polled with nrf_drv_pwm_is_stopped.
+    ret_code_t err_code = nrf_drv_pwm_init(&m_pwm0, &config, NULL);
+    if (err_code != NRF_ERROR_INVALID_STATE) {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/*
+ * Wait for the previous frame to be fully sent. This polls the STOPPED event
+ * so it also works when called from a context preempting the PWM interrupt.
+ */
+static void pwm_wait(void) {
+    while (!nrf_drv_pwm_is_stopped(&m_pwm0))
+        ;
+}
+
+static void encode_pixel(uint16_t n) {
+    uint8_t *pix = &nsec_pixels->pixels[n * 3];
+    uint16_t *p = &pwm_sequence[n * 3 * 8];
+
+    for (uint8_t i = 0; i < 3; i++) {
+        uint8_t level = level_table[pix[i]];
+
+        for (uint8_t mask = 0x80; mask > 0; mask >>= 1) {
+            *p++ = (level & mask) ? MAGIC_T1H : MAGIC_T0H;
+        }
+    }
+}
 
 void nsec_neoPixel_init() {
-    nsec_pixels = malloc(sizeof(struct Nsec_pixels));
+    nsec_pixels = &nsec_pixels_data;
 
+    // 0 is full brightness, see nsec_neoPixel_set_brightness
     nsec_pixels->brightness = 0;
+    build_level_table(255);
 
     // Magic number comming from Adafruit library
     nsec_pixels->rOffset = (NEO_GRB >> 4) & 0b11;
     nsec_pixels->gOffset = (NEO_GRB >> 2) & 0b11;
     nsec_pixels->bOffset = NEO_GRB & 0b11;
 
-    // Allocate three bytes for each pixels (3 led by pixel)
+    // Three bytes for each pixels (3 led by pixel)
     nsec_pixels->numBytes = NEOPIXEL_COUNT * 3;
-    nsec_pixels->pixels = (uint8_t *)malloc(nsec_pixels->numBytes);
+    nsec_pixels->pixels = nsec_pixels_bytes;
 
     memset(nsec_pixels->pixels, 0, nsec_pixels->numBytes);
 
-    // Configure pin
+    // Every pixel is encoded on the first show, the reset tail never changes
+    for (uint16_t i = NEOPIXEL_COUNT * 3 * 8; i < PWM_SEQUENCE_LENGTH; i++) {
+        pwm_sequence[i] = 0 | (0x8000);
+    }
+    dirty_pixels = ALL_PIXELS_DIRTY;
+
+    // Configure pin, it stays low whenever the PWM is stopped
     nrf_gpio_cfg_output(PIN_NEOPIXEL);
     nrf_gpio_pin_clear(PIN_NEOPIXEL);
 
+    pwm_init();
+
     return;
 }
 
+/*
+ * Return whether the previous frame is still being sent, in which case
+ * nsec_neoPixel_show() would wait for it.
+ */
+bool nsec_neoPixel_is_busy(void) {
+    return !nrf_drv_pwm_is_stopped(&m_pwm0);
+}
+
 void nsec_neoPixel_clear(void) {
     memset(nsec_pixels->pixels, 0, nsec_pixels->numBytes);
+    dirty_pixels = ALL_PIXELS_DIRTY;
 }
 
 // Set the n pixel color
 void nsec_neoPixel_set_pixel_color(uint16_t n, uint8_t r, uint8_t g,
                                    uint8_t b) {
     if (n < NEOPIXEL_COUNT) {
-        if (nsec_pixels->brightness) {
-            r = (r * nsec_pixels->brightness) >> 8;
-            g = (g * nsec_pixels->brightness) >> 8;
-            b = (b * nsec_pixels->brightness) >> 8;
-        }
-
         uint8_t *p;
         p = &nsec_pixels->pixels[n * 3];
         p[nsec_pixels->rOffset] = r;
         p[nsec_pixels->gOffset] = g;
         p[nsec_pixels->bOffset] = b;
+        dirty_pixels |= 1UL << n;
     }
 }
 
@@ -95,43 +217,21 @@ uint32_t nsec_neoPixel_get_pixel_color(uint16_t n) {
 
     uint8_t *pixel;
     pixel = &nsec_pixels->pixels[n * 3];
-    if (nsec_pixels->brightness) {
-        return (((uint32_t)(pixel[nsec_pixels->rOffset] << 8) /
-                 nsec_pixels->brightness)
-                << 16) |
-               (((uint32_t)(pixel[nsec_pixels->gOffset] << 8) /
-                 nsec_pixels->brightness)
-                << 8) |
-               ((uint32_t)(pixel[nsec_pixels->bOffset] << 8) /
-                nsec_pixels->brightness);
-    } else {
-        return ((uint32_t)pixel[nsec_pixels->rOffset] << 16) |
-               ((uint32_t)pixel[nsec_pixels->gOffset] << 8) |
-               (uint32_t)pixel[nsec_pixels->bOffset];
-    }
+    return ((uint32_t)pixel[nsec_pixels->rOffset] << 16) |
+           ((uint32_t)pixel[nsec_pixels->gOffset] << 8) |
+           (uint32_t)pixel[nsec_pixels->bOffset];
 }
 
+/*
+ * The colours are left alone, only the level table is built again and every
+ * pixel is encoded with it on the next show.
+ */
 void nsec_neoPixel_set_brightness(uint8_t b) {
     uint8_t newBrightness = b + 1;
     if (newBrightness != nsec_pixels->brightness) {
-        uint8_t pixel;
-        uint8_t *ptr = nsec_pixels->pixels;
-        uint8_t oldBrighness = nsec_pixels->brightness - 1;
-        uint16_t scale;
-
-        if (oldBrighness == 0) {
-            scale = 0;
-        } else if (b == 255) {
-            scale = 65535;
-        } else {
-            scale = (((uint16_t)newBrightness << 8) - 1) / oldBrighness;
-        }
-
-        for (uint16_t i = 0; i < nsec_pixels->numBytes; i++) {
-            pixel = *ptr;
-            *ptr++ = (pixel * scale) >> 8;
-        }
+        build_level_table(b);
         nsec_pixels->brightness = newBrightness;
+        dirty_pixels = ALL_PIXELS_DIRTY;
     }
 }
 
@@ -146,64 +246,22 @@ void nsec_neoPixel_show(void) {
 
     show_with_PWM();
     // show_with_DWT();
-
-    nrf_delay_us(50);
 }
 
+/*
+ * Start sending the frame and return right away. The PWM stops once the LEDs
+ * latched the colours, see nsec_neoPixel_is_busy().
+ */
 void show_with_PWM(void) {
-    // todo Implement the canshow
-    uint32_t pattern_size =
-        nsec_pixels->numBytes * 8 * sizeof(uint16_t) + 2 * sizeof(uint16_t);
-    uint16_t *pixels_pattern = NULL;
-
-    pixels_pattern = (uint16_t *)malloc(pattern_size);
-    if (pixels_pattern != NULL && nsec_pixels->pixels != NULL) {
-        uint16_t pos = 0;
-
-        for (uint16_t n = 0; n < nsec_pixels->numBytes; n++) {
-            uint8_t pix = nsec_pixels->pixels[n];
+    pwm_wait();
 
-            for (uint8_t mask = 0x80, i = 0; mask > 0; mask >>= 1, i++) {
-                pixels_pattern[pos] = (pix & mask) ? MAGIC_T1H : MAGIC_T0H;
-                pos++;
-            }
+    for (uint16_t n = 0; dirty_pixels != 0; n++, dirty_pixels >>= 1) {
+        if (dirty_pixels & 1) {
+            encode_pixel(n);
         }
-        // Zero padding to indicate the end of que sequence
-        pixels_pattern[++pos] = 0 | (0x8000);
-        pixels_pattern[++pos] = 0 | (0x8000);
-    } else {
-        return;
     }
 
-    nrf_pwm_configure(NRF_PWM0, NRF_PWM_CLK_16MHz, NRF_PWM_MODE_UP, CTOPVAL);
-    nrf_pwm_loop_set(NRF_PWM0, 0);
-    nrf_pwm_decoder_set(NRF_PWM0, NRF_PWM_LOAD_COMMON, NRF_PWM_STEP_AUTO);
-
-    // Configure the sequence
-    nrf_pwm_seq_ptr_set(NRF_PWM0, 0, pixels_pattern);
-    nrf_pwm_seq_cnt_set(NRF_PWM0, 0, pattern_size / sizeof(uint16_t));
-    nrf_pwm_seq_refresh_set(NRF_PWM0, 0, 0);
-    nrf_pwm_seq_end_delay_set(NRF_PWM0, 0, 0);
-    nrf_pwm_pins_set(NRF_PWM0, mapConnect);
-
-    // Enable the PWM
-    nrf_pwm_enable(NRF_PWM0);
-
-    // Start the sequence
-    nrf_pwm_event_clear(NRF_PWM0, NRF_PWM_EVENT_SEQEND0);
-    nrf_pwm_task_trigger(NRF_PWM0, NRF_PWM_TASK_SEQSTART0);
-
-    while (!nrf_pwm_event_check(NRF_PWM0, NRF_PWM_EVENT_SEQEND0))
-        ;
-
-    nrf_pwm_event_clear(NRF_PWM0, NRF_PWM_EVENT_SEQEND0);
-
-    // Disable the PWM
-    nrf_pwm_disable(NRF_PWM0);
-
-    nrf_pwm_pins_set(NRF_PWM0, mapDisconnect);
-
-    free(pixels_pattern);
+    nrf_drv_pwm_simple_playback(&m_pwm0, &pwm_seq, 1, NRF_DRV_PWM_FLAG_STOP);
 }
 
 void show_with_DWT(void) {
@@ -216,7 +274,7 @@ void show_with_DWT(void) {
         uint32_t cycle = 0;
 
         for (uint16_t n = 0; n < nsec_pixels->numBytes; n++) {
-            uint8_t pix = *p++;
+            uint8_t pix = level_table[*p++];
 
             for (uint8_t mask = 0x80; mask; mask >>= 1) {
                 while (DWT->CYCCNT - cycle < CYCLES_800)
@@ -6,6 +6,7 @@
 #ifndef neoPixel_h
 #define neoPixel_h
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
@@ -17,9 +18,12 @@
 #define CYCLES_800_T1H 41 // ~0.76 us
 #define CYCLES_800 71     // ~1.25 us
 
+#ifndef NEOPIXEL_COUNT
 #define NEOPIXEL_COUNT 15
+#endif
 
 void nsec_neoPixel_init(void);
+bool nsec_neoPixel_is_busy(void);
 void nsec_neoPixel_clear(void);
 void nsec_neoPixel_set_pixel_color(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
 void nsec_neoPixel_set_pixel_color_packed(uint16_t n, uint32_t c);
@@ -36,7 +36,9 @@ redistribution
 // TODO TO REMOVE WHEN GFX WILL BE DONE MOVING TO gfx_effect
 #include "app/gfx_effect.h"
 
-static uint8_t gfx_rotation = 0;
+// The panel is only used in its native orientation. With a constant rotation
+// the compiler drops the coordinate remapping from every drawing call.
+#define SSD1306_ROTATION 0
 uint8_t ssd1306_vccstate = SSD1306_SWITCHCAPVCC;
 
 typedef enum {
@@ -52,7 +54,7 @@ static nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(CONF_OLED_SPI_INST);
 static void spi_init() {
     nrf_drv_spi_config_t spi_config;
 
-    spi_config.frequency = NRF_DRV_SPI_FREQ_1M;
+    spi_config.frequency = NRF_DRV_SPI_FREQ_8M;
     spi_config.sck_pin = PIN_OLED_CLK;
     spi_config.miso_pin = NRF_DRV_SPI_PIN_NOT_USED;
     spi_config.mosi_pin = PIN_OLED_DATA;
@@ -79,9 +81,57 @@ static void spi_master_tx(const uint8_t *p_tx_data, uint16_t len) {
  * SSD1306 stuff
  */
 
+#define SSD1306_PAGES (SSD1306_LCDHEIGHT / 8)
+
 // the memory buffer for the LCD
 static uint8_t buffer[SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 8] = {0};
 
+// Columns of each page changed since the last update, a page is clean when
+// dirty_x0 > dirty_x1.
+static uint8_t dirty_x0[SSD1306_PAGES];
+static uint8_t dirty_x1[SSD1306_PAGES];
+
+static void ssd1306_mark_dirty(uint8_t x0, uint8_t x1, uint8_t page0,
+                               uint8_t page1) {
+    for (uint8_t page = page0; page <= page1; page++) {
+        if (dirty_x0[page] > dirty_x1[page]) {
+            dirty_x0[page] = x0;
+            dirty_x1[page] = x1;
+        } else {
+            dirty_x0[page] = MIN(dirty_x0[page], x0);
+            dirty_x1[page] = MAX(dirty_x1[page], x1);
+        }
+    }
+}
+
+static void ssd1306_mark_all_dirty(void) {
+    ssd1306_mark_dirty(0, SSD1306_LCDWIDTH - 1, 0, SSD1306_PAGES - 1);
+}
+
+// read back a pixel of the buffer, with the same rotation as draw_pixel
+static bool ssd1306_get_pixel(int16_t x, int16_t y) {
+    if ((x < 0) || (x >= SSD1306_LCDWIDTH) || (y < 0) ||
+        (y >= SSD1306_LCDHEIGHT))
+        return false;
+
+    switch (SSD1306_ROTATION) {
+    case 1:
+        swap(x, y);
+        x = SSD1306_LCDWIDTH - x - 1;
+        break;
+    case 2:
+        x = SSD1306_LCDWIDTH - x - 1;
+        y = SSD1306_LCDHEIGHT - y - 1;
+        break;
+    case 3:
+        swap(x, y);
+        y = SSD1306_LCDHEIGHT - y - 1;
+        break;
+    }
+
+    return buffer[x + (y / 8) * SSD1306_LCDWIDTH] & (1 << (y & 7));
+}
+
 // the most basic function, set a single pixel
 void ssd1306_draw_pixel(int16_t x, int16_t y, uint16_t color) {
     if ((x < 0) || (x >= SSD1306_LCDWIDTH) || (y < 0) ||
@@ -89,7 +139,7 @@ void ssd1306_draw_pixel(int16_t x, int16_t y, uint16_t color) {
         return;
 
     // check rotation, move pixel around if necessary
-    switch (gfx_rotation) {
+    switch (SSD1306_ROTATION) {
     case 1:
         swap(x, y);
         x = SSD1306_LCDWIDTH - x - 1;
@@ -104,6 +154,8 @@ void ssd1306_draw_pixel(int16_t x, int16_t y, uint16_t color) {
         break;
     }
 
+    ssd1306_mark_dirty(x, x, y / 8, y / 8);
+
     // x is which column
     switch (color) {
     case SSD1306_WHITE:
@@ -121,6 +173,9 @@ void ssd1306_draw_pixel(int16_t x, int16_t y, uint16_t color) {
 void ssd1306_init(void) {
     spi_init();
 
+    // Whatever is in the panel RAM doesn't match the buffer yet.
+    ssd1306_mark_all_dirty();
+
     nrf_gpio_cfg_output(PIN_OLED_RESET);
     nrf_gpio_cfg_output(PIN_OLED_DC_MODE);
 
@@ -352,35 +407,52 @@ void ssd1306_dim(bool dim) {
     ssd1306_command(contrast);
 }
 
+/*
+ * Send the columns that changed since the last update. Consecutive pages with
+ * the same dirty columns share a single address window.
+ */
 void ssd1306_update(void) {
-    ssd1306_command(SSD1306_COLUMNADDR);
-    ssd1306_command(0);                    // Column start address (0 = reset)
-    ssd1306_command(SSD1306_LCDWIDTH - 1); // Column end address (127 = reset)
-
-    ssd1306_command(SSD1306_PAGEADDR);
-    ssd1306_command(0); // Page start address (0 = reset)
-#if SSD1306_LCDHEIGHT == 64
-    ssd1306_command(7); // Page end address
-#endif
-#if SSD1306_LCDHEIGHT == 32
-    ssd1306_command(3); // Page end address
-#endif
-#if SSD1306_LCDHEIGHT == 16
-    ssd1306_command(1); // Page end address
-#endif
+    uint8_t page = 0;
+
+    while (page < SSD1306_PAGES) {
+        const uint8_t x0 = dirty_x0[page];
+        const uint8_t x1 = dirty_x1[page];
+        const uint8_t first = page;
+
+        if (x0 > x1) {
+            page++;
+            continue;
+        }
+
+        do {
+            dirty_x0[page] = UINT8_MAX;
+            dirty_x1[page] = 0;
+            page++;
+        } while (page < SSD1306_PAGES && dirty_x0[page] == x0 &&
+                 dirty_x1[page] == x1);
+
+        const uint8_t window[] = {SSD1306_COLUMNADDR, x0, x1,
+                                  SSD1306_PAGEADDR, first, page - 1};
 
-    nrf_gpio_pin_write(PIN_OLED_DC_MODE, DATA);
-    spi_master_tx(buffer, SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8);
+        nrf_gpio_pin_write(PIN_OLED_DC_MODE, COMMAND);
+        spi_master_tx(window, sizeof(window));
+
+        nrf_gpio_pin_write(PIN_OLED_DC_MODE, DATA);
+        for (uint8_t p = first; p < page; p++) {
+            spi_master_tx(&buffer[p * SSD1306_LCDWIDTH + x0], x1 - x0 + 1);
+        }
+    }
 }
 
 // clear everything
 void ssd1306_clear_display(void) {
     memset(buffer, 0, (SSD1306_LCDWIDTH * SSD1306_LCDHEIGHT / 8));
+    ssd1306_mark_all_dirty();
 }
 
 void ssd1306_draw_fast_hline(int16_t x, int16_t y, int16_t w, uint16_t color) {
     bool bSwap = false;
-    switch (gfx_rotation) {
+    switch (SSD1306_ROTATION) {
     case 0:
         // 0 degree rotation, do nothing
         break;
@@ -436,6 +508,8 @@ void ssd1306_draw_fast_hline_internal(int16_t x, int16_t y, int16_t w,
         return;
     }
 
+    ssd1306_mark_dirty(x, x + w - 1, y / 8, y / 8);
+
     // set up the pointer for  movement through the buffer
     register uint8_t *pBuf = buffer;
     // adjust the buffer pointer for the current row
@@ -467,7 +541,7 @@ void ssd1306_draw_fast_hline_internal(int16_t x, int16_t y, int16_t w,
 
 void ssd1306_draw_fast_vline(int16_t x, int16_t y, int16_t h, uint16_t color) {
     bool bSwap = false;
-    switch (gfx_rotation) {
+    switch (SSD1306_ROTATION) {
     case 0:
         break;
     case 1:
@@ -525,6 +599,8 @@ void ssd1306_draw_fast_vline_internal(int16_t x, int16_t __y, int16_t __h,
         return;
     }
 
+    ssd1306_mark_dirty(x, x, __y / 8, (__y + __h - 1) / 8);
+
     // this display doesn't need ints for coordinates, use local byte registers
     // for faster juggling
     register uint8_t y = __y;
@@ -634,6 +710,202 @@ void ssd1306_draw_fast_vline_internal(int16_t x, int16_t __y, int16_t __h,
     }
 }
 
-void ssd1306_fill_screen_black(void) { memset(buffer, 0x00, sizeof(buffer)); }
+void ssd1306_fill_screen_black(void) {
+    memset(buffer, 0x00, sizeof(buffer));
+    ssd1306_mark_all_dirty();
+}
+
+void ssd1306_fill_screen_white(void) {
+    memset(buffer, 0xFF, sizeof(buffer));
+    ssd1306_mark_all_dirty();
+}
 
-void ssd1306_fill_screen_white(void) { memset(buffer, 0xFF, sizeof(buffer)); }
+static void ssd1306_apply_mask(uint8_t *p, int16_t n, uint8_t mask,
+                               uint16_t color) {
+    switch (color) {
+    case SSD1306_WHITE:
+        while (n--) {
+            *p++ |= mask;
+        }
+        break;
+    case SSD1306_BLACK:
+        mask = ~mask;
+        while (n--) {
+            *p++ &= mask;
+        }
+        break;
+    case SSD1306_INVERSE:
+        while (n--) {
+            *p++ ^= mask;
+        }
+        break;
+    }
+}
+
+/*
+ * Fill a rectangle a page at a time, 8 rows of a column are a single byte.
+ */
+void ssd1306_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                       uint16_t color) {
+    if (SSD1306_ROTATION != 0) {
+        for (int16_t i = x; i < x + w; i++) {
+            ssd1306_draw_fast_vline(i, y, h, color);
+        }
+        return;
+    }
+
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+    if (x + w > SSD1306_LCDWIDTH) {
+        w = SSD1306_LCDWIDTH - x;
+    }
+    if (y + h > SSD1306_LCDHEIGHT) {
+        h = SSD1306_LCDHEIGHT - y;
+    }
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    ssd1306_mark_dirty(x, x + w - 1, y / 8, (y + h - 1) / 8);
+
+    for (int16_t row = y; row < y + h;) {
+        const uint8_t shift = row & 7;
+        const uint8_t n = MIN(8 - shift, y + h - row);
+        const uint8_t mask = (0xFF >> (8 - n)) << shift;
+
+        ssd1306_apply_mask(&buffer[(row / 8) * SSD1306_LCDWIDTH + x], w, mask,
+                           color);
+        row += n;
+    }
+}
+
+/*
+ * Draw a 1-bit bitmap, rows of MSB first bytes, with opaque background.
+ * The bits of up to 8 rows are gathered into each buffer byte instead of
+ * going through ssd1306_draw_pixel.
+ */
+void ssd1306_draw_bitmap(int16_t x, int16_t y, const uint8_t *bitmap,
+                         int16_t w, int16_t h, uint16_t color, uint16_t bg) {
+    const int16_t byte_width = (w + 7) / 8;
+
+    if (SSD1306_ROTATION != 0 || x < 0 || y < 0 ||
+        x + w > SSD1306_LCDWIDTH || y + h > SSD1306_LCDHEIGHT ||
+        color == SSD1306_INVERSE || bg == SSD1306_INVERSE) {
+        for (int16_t j = 0; j < h; j++) {
+            for (int16_t i = 0; i < w; i++) {
+                bool set = bitmap[j * byte_width + i / 8] & (128 >> (i & 7));
+                ssd1306_draw_pixel(x + i, y + j, set ? color : bg);
+            }
+        }
+        return;
+    }
+
+    if (color == bg) {
+        ssd1306_fill_rect(x, y, w, h, color);
+        return;
+    }
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    ssd1306_mark_dirty(x, x + w - 1, y / 8, (y + h - 1) / 8);
+
+    for (int16_t j = 0; j < h;) {
+        const uint8_t shift = (y + j) & 7;
+        const uint8_t n = MIN(8 - shift, h - j);
+        const uint8_t mask = (0xFF >> (8 - n)) << shift;
+        uint8_t *p = &buffer[((y + j) / 8) * SSD1306_LCDWIDTH + x];
+
+        for (int16_t i = 0; i < w; i++) {
+            const uint8_t *src = &bitmap[j * byte_width + i / 8];
+            const uint8_t bit = 128 >> (i & 7);
+            uint8_t bits = 0;
+
+            for (uint8_t k = 0; k < n; k++, src += byte_width) {
+                if (*src & bit) {
+                    bits |= 1 << k;
+                }
+            }
+            bits <<= shift;
+
+            // Set bits take the colour, the others the background.
+            if (color == SSD1306_BLACK) {
+                bits = ~bits & mask;
+            }
+            p[i] = (p[i] & ~mask) | bits;
+        }
+        j += n;
+    }
+}
+
+/*
+ * Move the content of a rectangle up by dy rows, down if dy is negative.
+ * A column of the panel fits in 64 bits, so each column of the rectangle is
+ * shifted as a whole and only the pages it covers are sent again.
+ */
+void ssd1306_scroll_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                         int16_t dy) {
+    if (SSD1306_ROTATION != 0) {
+        // Copy the pixels one by one, in the order that doesn't overwrite
+        // the rows still to be moved.
+        for (int16_t n = 0; n < h - abs(dy); n++) {
+            const int16_t row = dy > 0 ? y + n : y + h - 1 - n;
+
+            for (int16_t i = x; i < x + w; i++) {
+                ssd1306_draw_pixel(i, row,
+                                   ssd1306_get_pixel(i, row + dy)
+                                       ? SSD1306_WHITE
+                                       : SSD1306_BLACK);
+            }
+        }
+        return;
+    }
+
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+    if (x + w > SSD1306_LCDWIDTH) {
+        w = SSD1306_LCDWIDTH - x;
+    }
+    if (y + h > SSD1306_LCDHEIGHT) {
+        h = SSD1306_LCDHEIGHT - y;
+    }
+    if (w <= 0 || h <= 0 || dy == 0 || abs(dy) >= h) {
+        return;
+    }
+
+    const uint8_t page0 = y / 8;
+    const uint8_t page1 = (y + h - 1) / 8;
+    const uint64_t mask = (h == 64 ? UINT64_MAX : ((1ULL << h) - 1)) << y;
+
+    ssd1306_mark_dirty(x, x + w - 1, page0, page1);
+
+    for (int16_t i = x; i < x + w; i++) {
+        uint64_t column = 0;
+
+        for (uint8_t page = page0; page <= page1; page++) {
+            column |= (uint64_t)buffer[page * SSD1306_LCDWIDTH + i]
+                      << (page * 8);
+        }
+
+        // Bit n is row n, moving up is a shift towards bit 0.
+        uint64_t moved = dy > 0 ? column >> dy : column << -dy;
+        column = (column & ~mask) | (moved & mask);
+
+        for (uint8_t page = page0; page <= page1; page++) {
+            buffer[page * SSD1306_LCDWIDTH + i] = column >> (page * 8);
+        }
+    }
+}
@@ -140,6 +140,12 @@ void ssd1306_draw_fast_hline_internal(int16_t x, int16_t y, int16_t w,
 void ssd1306_draw_fast_vline(int16_t x, int16_t y, int16_t h, uint16_t color);
 void ssd1306_draw_fast_vline_internal(int16_t x, int16_t __y, int16_t __h,
                                       uint16_t color);
+void ssd1306_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                       uint16_t color);
+void ssd1306_draw_bitmap(int16_t x, int16_t y, const uint8_t *bitmap,
+                         int16_t w, int16_t h, uint16_t color, uint16_t bg);
+void ssd1306_scroll_rect(int16_t x, int16_t y, int16_t w, int16_t h,
+                         int16_t dy);
 void ssd1306_fill_screen_black(void);
 void ssd1306_fill_screen_white(void);
 
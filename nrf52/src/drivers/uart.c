@@ -22,43 +22,453 @@
 
 #include "uart.h"
 #include "boards.h"
+#include <app_error.h>
+#include <app_timer.h>
 #include <app_util_platform.h>
 #include <nordic_common.h>
-#include <nrf_drv_uart.h>
+#include <nrf_drv_common.h>
+#include <nrf_gpio.h>
+#include <nrf_uarte.h>
+#include <sdk_common.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
-#define UART_DEFAULT_CONFIG_HWFC NRF_UART_HWFC_DISABLED
-#define UART_DEFAULT_CONFIG_PARITY NRF_UART_PARITY_EXCLUDED
-#define UART_DEFAULT_CONFIG_BAUDRATE NRF_UART_BAUDRATE_115200
-#define UART_DEFAULT_CONFIG_IRQ_PRIORITY APP_IRQ_PRIORITY_LOW
+/* Set to 1 in sdk_config.h to use the CTS/RTS lines.  */
+#ifndef UART_CONFIG_HWFC
+#define UART_CONFIG_HWFC 0
+#endif
 
-static nrf_drv_uart_t instance = NRF_DRV_UART_INSTANCE(0);
+#define UART_IRQ_PRIORITY APP_IRQ_PRIORITY_LOW
+
+/* Received bytes wait here until they are read, bytes to send until the
+   UARTE has taken them.  Must be powers of 2.  */
+#define UART_RX_RING_SIZE 1024
+#define UART_TX_RING_SIZE 1024
+
+/* EasyDMA receives in one chunk while the next one is queued.  */
+#define UART_RX_CHUNK_SIZE 64
+
+/* Room the ring must have to start receiving in a chunk: it, the next one,
+   and the few bytes a flush of the RX FIFO may add.  */
+#define UART_RX_ROOM (2 * UART_RX_CHUNK_SIZE + 8)
+
+/* EasyDMA can't move more than this in a single transfer.  */
+#define UART_MAX_TRANSFER UINT8_MAX
+
+/* A chunk that isn't full is handed over once the line has been quiet for
+   this long.  */
+#define UART_RX_TIMEOUT_MS 1
+
+#define UART_PRINTF_BUFFER_SIZE 128
+
+enum rx_state {
+    /* Receiving in rx_chunks[rx_chunk].  */
+    RX_RUNNING,
+    /* The ring can't take another chunk, the UARTE holds what comes in its
+       FIFO (and raises RTS).  */
+    RX_PAUSED,
+    /* STOPRX was triggered to get a partial chunk, waiting for RXTO.  */
+    RX_STOPPING,
+    /* FLUSHRX was triggered to get what is left in the FIFO.  */
+    RX_FLUSHING,
+};
+
+enum tx_state {
+    TX_IDLE,
+    TX_SENDING,
+    /* STOPTX was triggered, waiting for TXSTOPPED.  */
+    TX_STOPPING,
+};
+
+static NRF_UARTE_Type *const uarte = NRF_UARTE0;
+static bool initialized = false;
+
+APP_TIMER_DEF(m_rx_timer_id);
+
+/* rx_head, tx_tail and the state are only written by the interrupt handler,
+   rx_tail and tx_head by the thread.  */
+static uint8_t rx_ring[UART_RX_RING_SIZE];
+static volatile uint16_t rx_head = 0;
+static volatile uint16_t rx_tail = 0;
+static uint8_t rx_chunks[2][UART_RX_CHUNK_SIZE];
+/* The chunk the next ENDRX is for.  */
+static uint8_t rx_chunk = 0;
+/* The other chunk is set up to follow through the ENDRX_STARTRX short.  */
+static bool rx_next_queued = false;
+static volatile enum rx_state rx_state = RX_PAUSED;
+/* The RXDRDY interrupt is enabled, waiting for a first byte to start the
+   timeout.  */
+static bool rx_watching = false;
+/* Set by the timer when the line went quiet.  */
+static volatile bool rx_idle = false;
+static volatile uint32_t rx_errors = 0;
+
+static uint8_t tx_ring[UART_TX_RING_SIZE];
+static volatile uint16_t tx_head = 0;
+static volatile uint16_t tx_tail = 0;
+static volatile enum tx_state tx_state = TX_IDLE;
+
+/* The interrupt is disabled, waiting loops run the handler themselves.  */
+static bool polling = false;
+
+static uart_event_handler_t event_handler = NULL;
+static void *event_context = NULL;
+
+static void uart_irq_handler(void);
+
+static uint16_t rx_free(void) {
+    return UART_RX_RING_SIZE - (uint16_t)(rx_head - rx_tail);
+}
+
+static void notify(enum uart_event event) {
+    if (event_handler) {
+        event_handler(event, event_context);
+    }
+}
+
+/* Have the interrupt handler look at the state.  */
+static void kick(void) {
+    if (polling) {
+        uart_irq_handler();
+    } else {
+        NVIC_SetPendingIRQ(UARTE0_UART0_IRQn);
+    }
+}
+
+/* Called in busy loops, so they make progress without the interrupt.  */
+static void service(void) {
+    if (polling) {
+        uart_irq_handler();
+    }
+}
+
+static void rx_start(void) {
+    nrf_uarte_rx_buffer_set(uarte, rx_chunks[rx_chunk], UART_RX_CHUNK_SIZE);
+    rx_next_queued = false;
+    rx_state = RX_RUNNING;
+    nrf_uarte_task_trigger(uarte, NRF_UARTE_TASK_STARTRX);
+}
+
+/* Move what EasyDMA put in the current chunk to the ring.  */
+static void rx_store(void) {
+    const uint8_t *chunk = rx_chunks[rx_chunk];
+    size_t amount = nrf_uarte_rx_amount_get(uarte);
+
+    for (size_t i = 0; i < amount; i++) {
+        if (rx_free() == 0) {
+            rx_errors |= NRF_UARTE_ERROR_OVERRUN_MASK;
+            break;
+        }
+
+        rx_ring[rx_head % UART_RX_RING_SIZE] = chunk[i];
+        rx_head++;
+    }
+
+    rx_chunk ^= 1;
+
+    if (amount > 0) {
+        notify(UART_EVENT_RX_READY);
+    }
+}
+
+static void rx_timer_handler(void *p_context) {
+    if (nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_RXDRDY)) {
+        // Still receiving, check again later.
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_RXDRDY);
+        APP_ERROR_CHECK(app_timer_start(
+            m_rx_timer_id, APP_TIMER_TICKS(UART_RX_TIMEOUT_MS), NULL));
+    } else {
+        rx_idle = true;
+        NVIC_SetPendingIRQ(UARTE0_UART0_IRQn);
+    }
+}
+
+static void tx_start(void) {
+    uint16_t start = tx_tail % UART_TX_RING_SIZE;
+    size_t len = MIN((uint16_t)(tx_head - tx_tail),
+                     UART_TX_RING_SIZE - start);
+
+    nrf_uarte_tx_buffer_set(uarte, &tx_ring[start],
+                            MIN(len, UART_MAX_TRANSFER));
+    tx_state = TX_SENDING;
+    nrf_uarte_task_trigger(uarte, NRF_UARTE_TASK_STARTTX);
+}
+
+static void uart_irq_handler(void) {
+    if (nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_ERROR)) {
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_ERROR);
+        rx_errors |= nrf_uarte_errorsrc_get_and_clear(uarte);
+    }
+
+    if (nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_ENDRX)) {
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_ENDRX);
+        rx_store();
+
+        switch (rx_state) {
+        case RX_RUNNING:
+            // The short already started the next chunk, if there was one.
+            if (!rx_next_queued) {
+                rx_state = RX_PAUSED;
+            }
+            rx_next_queued = false;
+            break;
+
+        case RX_FLUSHING:
+            if (rx_free() >= UART_RX_ROOM) {
+                rx_start();
+            } else {
+                rx_state = RX_PAUSED;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_RXTO)) {
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_RXTO);
+        rx_state = RX_FLUSHING;
+        nrf_uarte_rx_buffer_set(uarte, rx_chunks[rx_chunk],
+                                UART_RX_CHUNK_SIZE);
+        nrf_uarte_task_trigger(uarte, NRF_UARTE_TASK_FLUSHRX);
+    }
+
+    if (nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_RXSTARTED)) {
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_RXSTARTED);
+
+        // The pointer is latched, queue the other chunk if the ring has room
+        // for both.
+        if (rx_state == RX_RUNNING && rx_free() >= UART_RX_ROOM) {
+            nrf_uarte_rx_buffer_set(uarte, rx_chunks[rx_chunk ^ 1],
+                                    UART_RX_CHUNK_SIZE);
+            nrf_uarte_shorts_enable(uarte, NRF_UARTE_SHORT_ENDRX_STARTRX);
+            rx_next_queued = true;
+        } else {
+            nrf_uarte_shorts_disable(uarte, NRF_UARTE_SHORT_ENDRX_STARTRX);
+        }
+    }
+
+    if (rx_state == RX_PAUSED && rx_free() >= UART_RX_ROOM) {
+        rx_start();
+    }
+
+    // Stop the receiver to get the partial chunk, the FIFO is flushed on
+    // RXTO.  If paused, wait for reception to restart first.
+    if (rx_idle && rx_state != RX_PAUSED) {
+        rx_idle = false;
+
+        if (rx_state == RX_RUNNING) {
+            nrf_uarte_shorts_disable(uarte, NRF_UARTE_SHORT_ENDRX_STARTRX);
+            rx_next_queued = false;
+            rx_state = RX_STOPPING;
+            nrf_uarte_task_trigger(uarte, NRF_UARTE_TASK_STOPRX);
+        }
+
+        rx_watching = true;
+        nrf_uarte_int_enable(uarte, NRF_UARTE_INT_RXDRDY_MASK);
+    }
+
+    if (rx_watching && nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_RXDRDY)) {
+        // Something is coming in, watch for the end of it.
+        rx_watching = false;
+        nrf_uarte_int_disable(uarte, NRF_UARTE_INT_RXDRDY_MASK);
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_RXDRDY);
+        APP_ERROR_CHECK(app_timer_start(
+            m_rx_timer_id, APP_TIMER_TICKS(UART_RX_TIMEOUT_MS), NULL));
+    }
+
+    if (nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_ENDTX)) {
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_ENDTX);
+
+        if (tx_state == TX_SENDING) {
+            tx_tail += nrf_uarte_tx_amount_get(uarte);
+
+            if (tx_head != tx_tail) {
+                tx_start();
+            } else {
+                tx_state = TX_STOPPING;
+                nrf_uarte_task_trigger(uarte, NRF_UARTE_TASK_STOPTX);
+            }
+
+            notify(UART_EVENT_TX_READY);
+        }
+    }
+
+    if (nrf_uarte_event_check(uarte, NRF_UARTE_EVENT_TXSTOPPED)) {
+        nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_TXSTOPPED);
+        tx_state = TX_IDLE;
+    }
+
+    if (tx_state == TX_IDLE && tx_head != tx_tail) {
+        tx_start();
+    }
+}
+
+void UARTE0_UART0_IRQHandler(void) {
+    uart_irq_handler();
+}
 
 /*
- * Initialize the uart in blocking mode, send function will return once the
- * transfer is complete.
+ * Initialize the uart, using the UARTE and EasyDMA.  Reception goes on in the
+ * background: bytes are put in a ring buffer as they arrive, so they are not
+ * lost while the main loop is busy.  Bytes to send are queued in another ring
+ * buffer, and sent from the interrupt handler.
+ *
+ * Calling it again does nothing, the CLI and flash mode share the uart.
  */
 ret_code_t uart_init() {
-    nrf_drv_uart_config_t config = NRF_DRV_UART_DEFAULT_CONFIG;
-    config.pseltxd = PIN_nRF_TXD;
-    config.pselrxd = PIN_nRF_RXD;
-    config.pselcts = PIN_nRF_CTS;
-    config.pselrts = PIN_nRF_RTS;
-
-    ret_code_t ret = nrf_drv_uart_init(&instance, &config, NULL);
-    if (ret != NRF_SUCCESS)
+    if (initialized) {
+        return NRF_SUCCESS;
+    }
+
+    ret_code_t ret = app_timer_create(&m_rx_timer_id,
+                                      APP_TIMER_MODE_SINGLE_SHOT,
+                                      rx_timer_handler);
+    if (ret != NRF_SUCCESS) {
         return ret;
+    }
+
+    nrf_gpio_pin_set(PIN_nRF_TXD);
+    nrf_gpio_cfg_output(PIN_nRF_TXD);
+    nrf_gpio_cfg_input(PIN_nRF_RXD, NRF_GPIO_PIN_NOPULL);
+    nrf_uarte_txrx_pins_set(uarte, PIN_nRF_TXD, PIN_nRF_RXD);
+
+#if UART_CONFIG_HWFC
+    nrf_gpio_pin_set(PIN_nRF_RTS);
+    nrf_gpio_cfg_output(PIN_nRF_RTS);
+    nrf_gpio_cfg_input(PIN_nRF_CTS, NRF_GPIO_PIN_NOPULL);
+    nrf_uarte_hwfc_pins_set(uarte, PIN_nRF_RTS, PIN_nRF_CTS);
+    nrf_uarte_configure(uarte, NRF_UARTE_PARITY_EXCLUDED,
+                        NRF_UARTE_HWFC_ENABLED);
+#else
+    nrf_uarte_configure(uarte, NRF_UARTE_PARITY_EXCLUDED,
+                        NRF_UARTE_HWFC_DISABLED);
+#endif
+
+    nrf_uarte_baudrate_set(uarte, NRF_UARTE_BAUDRATE_115200);
+
+    nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_ERROR);
+    nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_ENDRX);
+    nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_RXTO);
+    nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_RXSTARTED);
+    nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_RXDRDY);
+    nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_ENDTX);
+    nrf_uarte_event_clear(uarte, NRF_UARTE_EVENT_TXSTOPPED);
+    nrf_uarte_int_enable(uarte, NRF_UARTE_INT_ERROR_MASK |
+                                    NRF_UARTE_INT_ENDRX_MASK |
+                                    NRF_UARTE_INT_RXTO_MASK |
+                                    NRF_UARTE_INT_RXSTARTED_MASK |
+                                    NRF_UARTE_INT_RXDRDY_MASK |
+                                    NRF_UARTE_INT_ENDTX_MASK |
+                                    NRF_UARTE_INT_TXSTOPPED_MASK);
+    rx_watching = true;
+
+    nrf_uarte_enable(uarte);
+    rx_start();
+
+    nrf_drv_common_irq_enable(UARTE0_UART0_IRQn, UART_IRQ_PRIORITY);
+    initialized = true;
+
+    return NRF_SUCCESS;
+}
+
+/* HANDLER is called from the interrupt handler when bytes were received, or
+   when room was made to send more.  */
+
+void uart_set_event_handler(uart_event_handler_t handler, void *context) {
+    CRITICAL_REGION_ENTER();
+    event_handler = handler;
+    event_context = context;
+    CRITICAL_REGION_EXIT();
+}
+
+/* When ENABLE, stop using the interrupt: the send and read functions drive
+   the UARTE themselves.  For when interrupts can't be relied on, e.g. to
+   print a last message on a fault.  */
+
+void uart_set_polling(bool enable) {
+    if (enable) {
+        NVIC_DisableIRQ(UARTE0_UART0_IRQn);
+        polling = true;
+    } else {
+        polling = false;
+        NVIC_EnableIRQ(UARTE0_UART0_IRQn);
+    }
+}
+
+/* Switch to BAUD bits per second, once what was queued so far is out.  */
+
+ret_code_t uart_set_baudrate(uint32_t baud) {
+    nrf_uarte_baudrate_t baudrate;
+
+    switch (baud) {
+    case 115200:
+        baudrate = NRF_UARTE_BAUDRATE_115200;
+        break;
+    case 230400:
+        baudrate = NRF_UARTE_BAUDRATE_230400;
+        break;
+    case 460800:
+        baudrate = NRF_UARTE_BAUDRATE_460800;
+        break;
+    case 921600:
+        baudrate = NRF_UARTE_BAUDRATE_921600;
+        break;
+    case 1000000:
+        baudrate = NRF_UARTE_BAUDRATE_1000000;
+        break;
+    default:
+        return NRF_ERROR_INVALID_PARAM;
+    }
 
-    nrf_drv_uart_rx_enable(&instance);
+    uart_flush();
+    nrf_uarte_baudrate_set(uarte, baudrate);
 
     return NRF_SUCCESS;
 }
 
-/* Write the LEN bytes pointed to by DATA to the UART.  */
+/* Queue up to LEN bytes of DATA without waiting, return how many.  */
+
+size_t uart_write(const uint8_t *data, size_t len) {
+    service();
+
+    uint16_t head = tx_head;
+    size_t n = MIN(len, UART_TX_RING_SIZE - (uint16_t)(head - tx_tail));
+
+    for (size_t i = 0; i < n; i++) {
+        tx_ring[(uint16_t)(head + i) % UART_TX_RING_SIZE] = data[i];
+    }
+
+    tx_head = head + n;
+
+    if (n > 0) {
+        kick();
+    }
+
+    return n;
+}
+
+/* Queue the LEN bytes pointed to by DATA, waiting for room if necessary.  */
 
 ret_code_t uart_send(const uint8_t *data, size_t len) {
-    return nrf_drv_uart_tx(&instance, data, len);
+    while (len > 0) {
+        size_t n = uart_write(data, len);
+
+        data += n;
+        len -= n;
+    }
+
+    return NRF_SUCCESS;
+}
+
+/* Wait until everything queued has been sent.  */
+
+void uart_flush(void) {
+    while (tx_head != tx_tail || tx_state != TX_IDLE) {
+        service();
+    }
 }
 
 /* Send the null-terminated string pointed to by STR.  */
@@ -67,23 +477,80 @@ ret_code_t uart_puts(const char *str) {
     return uart_send((const uint8_t *)str, strlen(str));
 }
 
-/* For the string printf-style and send it.  */
+/* Format the string printf-style and send it.  It is truncated to
+   UART_PRINTF_BUFFER_SIZE - 1 characters.  */
 
 ret_code_t uart_printf(const char *fmt, ...) {
-    static char str[100];
+    char str[UART_PRINTF_BUFFER_SIZE];
     va_list args;
     va_start(args, fmt);
-    int len = vsprintf(str, fmt, args);
-    ret_code_t ret = uart_send((uint8_t *)str, len);
+    int len = vsnprintf(str, sizeof(str), fmt, args);
     va_end(args);
-    return ret;
+
+    if (len < 0) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    return uart_send((uint8_t *)str, MIN((size_t)len, sizeof(str) - 1));
+}
+
+/* Reading made room in the ring, reception may resume.  */
+
+static void rx_consumed(void) {
+    if (rx_state == RX_PAUSED) {
+        kick();
+    }
+}
+
+/* Read one byte (blocking if necessary), place it in *OUT.  Fail if a
+ * reception error happened since the last uart_clear_errors.  */
+
+ret_code_t uart_read(uint8_t *out) {
+    while (rx_head == rx_tail) {
+        if (rx_errors)
+            return NRF_ERROR_INTERNAL;
+
+        service();
+    }
+
+    if (rx_errors)
+        return NRF_ERROR_INTERNAL;
+
+    *out = rx_ring[rx_tail % UART_RX_RING_SIZE];
+    rx_tail++;
+    rx_consumed();
+
+    return NRF_SUCCESS;
+}
+
+/* Copy up to LEN received bytes to DATA without waiting, return how many.  */
+
+size_t uart_read_available(uint8_t *data, size_t len) {
+    size_t n = 0;
+
+    service();
+
+    while (n < len && rx_tail != rx_head) {
+        data[n++] = rx_ring[rx_tail % UART_RX_RING_SIZE];
+        rx_tail++;
+    }
+
+    if (n > 0) {
+        rx_consumed();
+    }
+
+    return n;
 }
 
-/* Read one byte from the UART rx fifo (blocking if necessary), place it in
- * *OUT.  Return true on success, false otherwise.  */
+/* Return the reception errors since the last call, and clear them.  */
 
-bool uart_read(uint8_t *out) { return nrf_drv_uart_rx(&instance, out, 1); }
+uint32_t uart_clear_errors() {
+    uint32_t errors;
 
-/* Clear the UART errors flags.  */
+    CRITICAL_REGION_ENTER();
+    errors = rx_errors;
+    rx_errors = 0;
+    CRITICAL_REGION_EXIT();
 
-void uart_clear_errors() { nrf_drv_uart_errorsrc_get(&instance); }
+    return errors;
+}
@@ -26,12 +26,26 @@
 #include <sdk_errors.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+enum uart_event {
+    UART_EVENT_RX_READY,
+    UART_EVENT_TX_READY,
+};
+
+typedef void (*uart_event_handler_t)(enum uart_event event, void *context);
 
 ret_code_t uart_init();
+void uart_set_event_handler(uart_event_handler_t handler, void *context);
+void uart_set_polling(bool enable);
+ret_code_t uart_set_baudrate(uint32_t baud);
+size_t uart_write(const uint8_t *data, size_t len);
 ret_code_t uart_send(const uint8_t *data, size_t len);
+void uart_flush(void);
 ret_code_t uart_puts(const char *str);
 ret_code_t uart_printf(const char *fmt, ...);
-bool uart_read(uint8_t *out);
-void uart_clear_errors();
+ret_code_t uart_read(uint8_t *out);
+size_t uart_read_available(uint8_t *data, size_t len);
+uint32_t uart_clear_errors();
 
 #endif /* SRC_DRIVERS_UART_H_ */
@@ -56,7 +56,7 @@
 #include "app/timer.h"
 #include "app/utils.h"
 #include "led_effects.h"
-#include <arm_math.h>
+#include <app_timer.h>
 #include <nrf.h>
 #include <nrf_delay.h>
 #include <stdlib.h>
@@ -263,7 +263,21 @@ uint32_t SPEED_MAX = 65535;
 #define SEGMENT_RUNTIME fx->segment_runtimes[fx->segment_index]
 #define SEGMENT_LENGTH (SEGMENT.stop - SEGMENT.start + 1)
 #define RESET_RUNTIME                                                          \
-    memset(fx->segment_runtimes, 0, sizeof(fx->segment_runtimes))
+    do {                                                                       \
+        memset(fx->segment_runtimes, 0, sizeof(fx->segment_runtimes));        \
+        frame_due = true;                                                      \
+    } while (0)
+
+// Frames are due at the earliest next_time of the segments, a single shot
+// timer is armed for it instead of comparing the time on every loop.
+#define MS_TO_TIMER_TICKS(ms)                                                  \
+    ((uint32_t)(((uint64_t)(ms) * APP_TIMER_CLOCK_FREQ + 999) /              \
+                (1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))))
+
+APP_TIMER_DEF(m_frame_timer_id);
+static bool is_frame_timer_created = false;
+// The frame timer fired, service_WS2812FX has to render the due segments.
+static volatile bool frame_due = false;
 
 // segment runtime parameters
 typedef struct Segment_runtime { // 16 bytes
@@ -286,12 +300,44 @@ typedef struct WS2812FX {
 
 ws2812fx *fx;
 
+static void frame_timer_handler(void *p_context) { frame_due = true; }
+
+/*
+ * Arm the frame timer for the segment that is due first. Without the timer,
+ * like when the error handler runs before timer_init, every call renders.
+ */
+static void schedule_next_frame(uint64_t now) {
+    unsigned long next_time = fx->segment_runtimes[0].next_time;
+
+    for (uint8_t i = 1; i < fx->num_segments; i++) {
+        next_time = min(next_time, fx->segment_runtimes[i].next_time);
+    }
+
+    if (!is_frame_timer_created) {
+        frame_due = true;
+        return;
+    }
+
+    uint32_t ticks = APP_TIMER_MIN_TIMEOUT_TICKS;
+    if (next_time > now) {
+        ticks = max(MS_TO_TIMER_TICKS(next_time - now),
+                    APP_TIMER_MIN_TIMEOUT_TICKS);
+    }
+
+    // If the timer can't be armed, like when the app_timer op queue is full,
+    // render on the next call rather than freezing the animation. The error
+    // handler drives the LEDs too, so this doesn't use APP_ERROR_CHECK.
+    if (app_timer_stop(m_frame_timer_id) != NRF_SUCCESS ||
+        app_timer_start(m_frame_timer_id, ticks, NULL) != NRF_SUCCESS) {
+        frame_due = true;
+    }
+}
+
 void init_WS2812FX() {
     static bool init = false;
     if (init) {
         return;
     }
-    RESET_RUNTIME;
     fx = malloc(sizeof(ws2812fx));
     if (fx == NULL) {
         return;
@@ -315,26 +361,51 @@ void init_WS2812FX() {
     nsec_neoPixel_init();
     setBrightness_WS2812FX(fx->brightness);
     nsec_neoPixel_show();
+
+    is_frame_timer_created =
+        app_timer_create(&m_frame_timer_id, APP_TIMER_MODE_SINGLE_SHOT,
+                         frame_timer_handler) == NRF_SUCCESS;
+    init = true;
 }
 
+/*
+ * Render and show the segments that are due. Nothing is done until the frame
+ * timer fires or an effect is triggered, then the timer is armed again for
+ * the next deadline. While the previous frame is still on the wire the due
+ * frame waits for a later call, rather than spinning in nsec_neoPixel_show().
+ */
 void service_WS2812FX() {
-    if (fx->running || fx->triggered) {
-        uint64_t now = get_current_time_millis();
-        bool doShow = false;
-        for (uint8_t i = 0; i < fx->num_segments; i++) {
-            fx->segment_index = i;
-            if (now > SEGMENT_RUNTIME.next_time || fx->triggered) {
-                doShow = true;
-                uint16_t delay = mode[SEGMENT.mode]();
-                SEGMENT_RUNTIME.next_time = now + max((int)delay, SPEED_MIN);
-                SEGMENT_RUNTIME.counter_mode_call++;
-            }
-        }
-        if (doShow) {
-            nrf_delay_ms(1);
-            nsec_neoPixel_show();
+    if (!fx->running && !fx->triggered) {
+        return;
+    }
+
+    if (!frame_due && !fx->triggered) {
+        return;
+    }
+
+    if (nsec_neoPixel_is_busy()) {
+        return;
+    }
+    frame_due = false;
+
+    uint64_t now = get_current_time_millis();
+    bool doShow = false;
+    for (uint8_t i = 0; i < fx->num_segments; i++) {
+        fx->segment_index = i;
+        if (now >= SEGMENT_RUNTIME.next_time || fx->triggered) {
+            doShow = true;
+            uint16_t delay = mode[SEGMENT.mode]();
+            SEGMENT_RUNTIME.next_time = now + max((int)delay, SPEED_MIN);
+            SEGMENT_RUNTIME.counter_mode_call++;
         }
-        fx->triggered = false;
+    }
+    if (doShow) {
+        nsec_neoPixel_show();
+    }
+    fx->triggered = false;
+
+    if (fx->running) {
+        schedule_next_frame(now);
     }
 }
 
@@ -345,6 +416,9 @@ void start_WS2812FX() {
 
 void stop_WS2812FX() {
     fx->running = false;
+    if (is_frame_timer_created) {
+        app_timer_stop(m_frame_timer_id);
+    }
     strip_off_WS2812FX();
 }
 
@@ -489,7 +563,6 @@ void setBrightness_WS2812FX(uint8_t b) {
     fx->brightness = constrain(b, BRIGHTNESS_MIN, BRIGHTNESS_MAX);
     nsec_neoPixel_set_brightness(fx->brightness);
     nsec_neoPixel_show();
-    nrf_delay_ms(1);
 }
 
 void increaseBrightness_WS2812FX(uint8_t s) {
@@ -623,6 +696,42 @@ uint32_t color_wheel(uint8_t pos) {
     }
 }
 
+/*
+ * Scale each channel of a colour by level / 256, in fixed point.
+ */
+static uint32_t color_scale(uint32_t color, uint16_t level) {
+    uint32_t rb = ((color & 0xFF00FF) * level >> 8) & 0xFF00FF;
+    uint32_t g = ((color & 0x00FF00) * level >> 8) & 0x00FF00;
+
+    return rb | g;
+}
+
+// One turn of a sine, offset and scaled to 0..255.
+static const uint8_t sine_table[256] = {
+    128, 131, 134, 137, 140, 143, 146, 149, 152, 155, 158, 162,
+    165, 167, 170, 173, 176, 179, 182, 185, 188, 190, 193, 196,
+    198, 201, 203, 206, 208, 211, 213, 215, 218, 220, 222, 224,
+    226, 228, 230, 232, 234, 235, 237, 238, 240, 241, 243, 244,
+    245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254,
+    254, 255, 255, 255, 255, 255, 255, 255, 254, 254, 254, 253,
+    253, 252, 251, 250, 250, 249, 248, 246, 245, 244, 243, 241,
+    240, 238, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+    218, 215, 213, 211, 208, 206, 203, 201, 198, 196, 193, 190,
+    188, 185, 182, 179, 176, 173, 170, 167, 165, 162, 158, 155,
+    152, 149, 146, 143, 140, 137, 134, 131, 128, 124, 121, 118,
+    115, 112, 109, 106, 103, 100,  97,  93,  90,  88,  85,  82,
+     79,  76,  73,  70,  67,  65,  62,  59,  57,  54,  52,  49,
+     47,  44,  42,  40,  37,  35,  33,  31,  29,  27,  25,  23,
+     21,  20,  18,  17,  15,  14,  12,  11,  10,   9,   7,   6,
+      5,   5,   4,   3,   2,   2,   1,   1,   1,   0,   0,   0,
+      0,   0,   0,   0,   1,   1,   1,   2,   2,   3,   4,   5,
+      5,   6,   7,   9,  10,  11,  12,  14,  15,  17,  18,  20,
+     21,  23,  25,  27,  29,  31,  33,  35,  37,  40,  42,  44,
+     47,  49,  52,  54,  57,  59,  62,  65,  67,  70,  73,  76,
+     79,  82,  85,  88,  90,  93,  97, 100, 103, 106, 109, 112,
+    115, 118, 121, 124,
+};
+
 /*
  * Returns a new, random wheel index with a minimum distance of 42 from pos.
  */
@@ -866,16 +975,10 @@ uint16_t mode_breath(void) {
             (sizeof(breath_brightness_steps) / sizeof(uint8_t));
     }
 
-    int lum =
-        map(breath_brightness, 0, 255, 0,
-            fx->brightness); // keep luminosity below brightness set by user
-    // uint8_t w = (SEGMENT.colors[0] >> 24 & 0xFF) * lum / _brightness; //
-    // modify RGBW colors with brightness info
-    uint8_t r = (SEGMENT.colors[0] >> 16 & 0xFF) * lum / fx->brightness;
-    uint8_t g = (SEGMENT.colors[0] >> 8 & 0xFF) * lum / fx->brightness;
-    uint8_t b = (SEGMENT.colors[0] & 0xFF) * lum / fx->brightness;
+    // The brightness set by the user is applied when the LEDs are shown.
+    uint32_t color = color_scale(SEGMENT.colors[0], breath_brightness + 1);
     for (uint16_t i = SEGMENT.start; i <= SEGMENT.stop; i++) {
-        nsec_neoPixel_set_pixel_color(i, r, g, b);
+        nsec_neoPixel_set_pixel_color_packed(i, color);
     }
 
     SEGMENT_RUNTIME.aux_param = breath_brightness;
@@ -888,15 +991,15 @@ uint16_t mode_breath(void) {
 uint16_t mode_fade(void) {
     int lum = SEGMENT_RUNTIME.counter_mode_step - 31;
     lum = 63 - (abs(lum) * 2);
-    lum = map(lum, 0, 64, min(25, (int)fx->brightness), fx->brightness);
-
-    // uint8_t w = (SEGMENT.colors[0] >> 24 & 0xFF) * lum / _brightness; //
-    // modify RGBW colors with brightness info
-    uint8_t r = (SEGMENT.colors[0] >> 16 & 0xFF) * lum / fx->brightness;
-    uint8_t g = (SEGMENT.colors[0] >> 8 & 0xFF) * lum / fx->brightness;
-    uint8_t b = (SEGMENT.colors[0] & 0xFF) * lum / fx->brightness;
+    // Down to 25 out of the user brightness, which is applied at show time.
+    int lowest = 256;
+    if (fx->brightness) {
+        lowest = min(25, (int)fx->brightness) * 256 / fx->brightness;
+    }
+    uint32_t color =
+        color_scale(SEGMENT.colors[0], map(lum, 0, 64, lowest, 256));
     for (uint16_t i = SEGMENT.start; i <= SEGMENT.stop; i++) {
-        nsec_neoPixel_set_pixel_color(i, r, g, b);
+        nsec_neoPixel_set_pixel_color_packed(i, color);
     }
 
     SEGMENT_RUNTIME.counter_mode_step =
@@ -1031,24 +1134,18 @@ uint16_t mode_theater_chase_rainbow(void) {
  * Running lights effect with smooth sine transition.
  */
 uint16_t mode_running_lights(void) {
-    // uint8_t w = ((SEGMENT.colors[0] >> 24) & 0xFF);
-    uint8_t r = ((SEGMENT.colors[0] >> 16) & 0xFF);
-    uint8_t g = ((SEGMENT.colors[0] >> 8) & 0xFF);
-    uint8_t b = (SEGMENT.colors[0] & 0xFF);
+    // One sine period over the segment, in 1/256th of a table step.
+    uint32_t step = (256 << 8) / SEGMENT_LENGTH;
 
-    float radPerLed = (2.0 * 3.14159) / SEGMENT_LENGTH;
     for (uint16_t i = 0; i < SEGMENT_LENGTH; i++) {
-        int lum =
-            map((int)(arm_sin_f32((i + SEGMENT_RUNTIME.counter_mode_step) *
-                                  radPerLed) *
-                      128),
-                -128, 128, 0, 255);
+        uint8_t lum = sine_table[
+            ((i + SEGMENT_RUNTIME.counter_mode_step) * step >> 8) & 0xFF];
+        uint32_t color = color_scale(SEGMENT.colors[0], lum);
+
         if (SEGMENT.reverse) {
-            nsec_neoPixel_set_pixel_color(SEGMENT.start + i, (r * lum) / 256,
-                                          (g * lum) / 256, (b * lum) / 256);
+            nsec_neoPixel_set_pixel_color_packed(SEGMENT.start + i, color);
         } else {
-            nsec_neoPixel_set_pixel_color(SEGMENT.stop - i, (r * lum) / 256,
-                                          (g * lum) / 256, (b * lum) / 256);
+            nsec_neoPixel_set_pixel_color_packed(SEGMENT.stop - i, color);
         }
     }
     SEGMENT_RUNTIME.counter_mode_step =
@@ -1064,10 +1161,11 @@ uint16_t twinkle(uint32_t color) {
         for (uint16_t i = SEGMENT.start; i <= SEGMENT.stop; i++) {
             nsec_neoPixel_set_pixel_color_packed(i, BLACK);
         }
+        // the random range is 8 bits wide, so cap it for long segments
         uint16_t min_leds =
-            max(1, SEGMENT_LENGTH / 5); // make sure, at least one LED is on
+            min(max(1, SEGMENT_LENGTH / 5), 255); // at least one LED is on
         uint16_t max_leds =
-            max(1, SEGMENT_LENGTH / 2); // make sure, at least one LED is on
+            min(max(1, SEGMENT_LENGTH / 2), 256); // at least one LED is on
         SEGMENT_RUNTIME.counter_mode_step =
             nsec_random_get_byte_range(min_leds, max_leds - 1);
     }
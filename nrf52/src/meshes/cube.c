@@ -1,4 +1,4 @@
-NSEC_DECLARE_MESH(nsec_cube, (
+NSEC_DECLARE_MESH(nsec_cube, "Cube", (
     {-1, -1, -1},
     {-1, -1,  1},
     {-1,  1, -1},
@@ -11,4 +11,8 @@ NSEC_DECLARE_MESH(nsec_cube, (
     {0, 1}, {1, 3}, {3, 2}, {2, 0},
     {4, 5}, {5, 7}, {7, 6}, {6, 4},
     {0, 4}, {1, 5}, {2, 6}, {3, 7}
+), (
+    {0, 1, 3}, {0, 3, 2}, {4, 7, 5}, {4, 6, 7},
+    {0, 5, 1}, {0, 4, 5}, {2, 3, 7}, {2, 7, 6},
+    {0, 2, 6}, {0, 6, 4}, {1, 7, 3}, {1, 5, 7}
 ));
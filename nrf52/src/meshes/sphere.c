@@ -1,4 +1,4 @@
-NSEC_DECLARE_MESH(nsec_icosphere, (
+NSEC_DECLARE_MESH(nsec_icosphere, "Icosphere", (
     { 0.000000, -1.000000, 0.000000 },
     { 0.723600, -0.447215, 0.525720 },
     { -0.276385, -0.447215, 0.850640 },
@@ -42,4 +42,25 @@ NSEC_DECLARE_MESH(nsec_icosphere, (
     { 11, 7 },
     { 11, 8 },
     { 11, 9 },
+), (
+    { 0, 1, 2 },
+    { 0, 5, 1 },
+    { 0, 2, 3 },
+    { 0, 3, 4 },
+    { 0, 4, 5 },
+    { 1, 6, 2 },
+    { 1, 5, 10 },
+    { 1, 10, 6 },
+    { 2, 7, 3 },
+    { 2, 6, 7 },
+    { 3, 8, 4 },
+    { 3, 7, 8 },
+    { 4, 9, 5 },
+    { 4, 8, 9 },
+    { 5, 9, 10 },
+    { 6, 11, 7 },
+    { 6, 10, 11 },
+    { 7, 11, 8 },
+    { 8, 11, 9 },
+    { 9, 11, 10 },
 ));
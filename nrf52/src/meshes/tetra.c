@@ -1,4 +1,4 @@
-NSEC_DECLARE_MESH(nsec_tetra, (
+NSEC_DECLARE_MESH(nsec_tetra, "Pyramid", (
     { 0,  1,  0},
     {-1, -1, -1},
     { 1, -1, -1},
@@ -7,4 +7,6 @@ NSEC_DECLARE_MESH(nsec_tetra, (
 ), (
     {0,1}, {0,2}, {0,3}, {0,4},
     {1,2}, {2,3}, {3,4}, {4,1}
+), (
+    {0, 2, 1}, {0, 1, 4}, {0, 3, 2}, {0, 4, 3}, {1, 2, 3}, {1, 3, 4}
 ));
@@ -1,4 +1,4 @@
-NSEC_DECLARE_MESH(nsec_torus, (
+NSEC_DECLARE_MESH(nsec_torus, "Torus", (
     { 1.010000, 0.000000, 0.000000 },
     { 0.635000, 0.216506, 0.000000 },
     { 0.635000, -0.216506, 0.000000 },
@@ -45,4 +45,35 @@ NSEC_DECLARE_MESH(nsec_torus, (
     { 0, 1 },
     { 7, 10 },
     { 6, 7 },
+), (
+    { 0, 4, 1 },
+    { 0, 3, 4 },
+    { 0, 2, 5 },
+    { 0, 5, 3 },
+    { 1, 5, 2 },
+    { 1, 4, 5 },
+    { 0, 1, 13 },
+    { 0, 13, 12 },
+    { 0, 14, 2 },
+    { 0, 12, 14 },
+    { 1, 2, 14 },
+    { 1, 14, 13 },
+    { 3, 7, 4 },
+    { 3, 6, 7 },
+    { 3, 5, 8 },
+    { 3, 8, 6 },
+    { 4, 8, 5 },
+    { 4, 7, 8 },
+    { 6, 10, 7 },
+    { 6, 9, 10 },
+    { 6, 8, 11 },
+    { 6, 11, 9 },
+    { 7, 11, 8 },
+    { 7, 10, 11 },
+    { 9, 13, 10 },
+    { 9, 12, 13 },
+    { 9, 11, 14 },
+    { 9, 14, 12 },
+    { 10, 14, 11 },
+    { 10, 13, 14 },
 ));
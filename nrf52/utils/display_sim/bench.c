@@ -0,0 +1,411 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+// Draw a few scripted scenes with the real graphics stack and report what
+// each frame costs on the display SPI bus.
+//
+//   display_bench [-o DIR] [-t TRACE]
+//
+// -o writes the last frame of every scene to DIR/<scene>.ppm and -t logs
+// every command and data span sent to the panel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app/3d.h"
+#include "app/external_flash.h"
+#include "app/gfx_effect.h"
+#include "app/menu.h"
+#include "app/text_box.h"
+#include "drivers/controls.h"
+#include "gui.h"
+#include "drivers/display.h"
+#include "sim_display.h"
+
+//*****************************************************************************
+//
+// Assets
+//
+//*****************************************************************************
+
+// A slide: flat background, a title bar, a gradient band and a few blocks,
+// kept both raw and RLE encoded in the simulated external flash.
+#define SLIDE_W 160
+#define SLIDE_H 80
+#define CELL 9
+
+static uint8_t flash_image[2 * SLIDE_W * SLIDE_H * 2];
+static struct external_flash_data slide_raw_data, slide_rle_data;
+
+static const struct bitmap_ext slide_raw = {
+    &slide_raw_data, SLIDE_W, SLIDE_H, image_encoding_565bits};
+static const struct bitmap_ext slide_rle = {
+    &slide_rle_data, SLIDE_W, SLIDE_H, image_encoding_565rle};
+
+static uint8_t cell_bytes[(CELL + 1) * (CELL + 1) * 2];
+static const struct bitmap cell = {cell_bytes, CELL + 1, CELL + 1,
+                                   image_encoding_565bits};
+
+static uint16_t slide_pixel(int x, int y)
+{
+    if (y < 12) {
+        return 0x11cc;
+    }
+    if (y >= 30 && y < 50) {
+        return (x * 31 / SLIDE_W) << 11 | (x * 63 / SLIDE_W) << 5 | 0x0f;
+    }
+    if (y >= 56 && y < 72 && (x / 20) % 2 == 0) {
+        return 0xfd20;
+    }
+    return DISPLAY_WHITE;
+}
+
+// Same format as RGB565_to_RLE in utils/gen_image.py.
+static uint32_t rle_encode_row(const uint16_t *row, int width, uint8_t *out)
+{
+    uint32_t len = 0;
+    int i = 0;
+
+    while (i < width) {
+        int run = 1;
+
+        while (i + run < width && run < 128 && row[i + run] == row[i]) {
+            run++;
+        }
+
+        if (run > 1) {
+            out[len++] = 0x80 | (run - 1);
+            out[len++] = row[i] >> 8;
+            out[len++] = row[i];
+            i += run;
+            continue;
+        }
+
+        int lit = 1;
+        while (i + lit < width && lit < 128 &&
+               (i + lit + 1 >= width || row[i + lit] != row[i + lit + 1])) {
+            lit++;
+        }
+
+        out[len++] = lit - 1;
+        for (int j = 0; j < lit; j++) {
+            out[len++] = row[i + j] >> 8;
+            out[len++] = row[i + j];
+        }
+        i += lit;
+    }
+
+    return len;
+}
+
+static void build_assets(void)
+{
+    uint32_t offset = 0;
+    uint16_t row[SLIDE_W];
+
+    slide_raw_data.offset = offset;
+    for (int y = 0; y < SLIDE_H; y++) {
+        for (int x = 0; x < SLIDE_W; x++) {
+            uint16_t c = slide_pixel(x, y);
+
+            flash_image[offset++] = c >> 8;
+            flash_image[offset++] = c;
+        }
+    }
+    slide_raw_data.size = offset;
+
+    slide_rle_data.offset = offset;
+    for (int y = 0; y < SLIDE_H; y++) {
+        for (int x = 0; x < SLIDE_W; x++) {
+            row[x] = slide_pixel(x, y);
+        }
+        offset += rle_encode_row(row, SLIDE_W, &flash_image[offset]);
+    }
+    slide_rle_data.size = offset - slide_rle_data.offset;
+
+    sim_flash_set_image(flash_image, offset);
+
+    // A raised tile like the mines_pattern_blank image.
+    for (int y = 0; y <= CELL; y++) {
+        for (int x = 0; x <= CELL; x++) {
+            uint16_t c = 0xce79;
+
+            if (x == 0 || y == 0) {
+                c = DISPLAY_WHITE;
+            } else if (x == CELL || y == CELL) {
+                c = 0x7bef;
+            }
+            cell_bytes[(y * (CELL + 1) + x) * 2] = c >> 8;
+            cell_bytes[(y * (CELL + 1) + x) * 2 + 1] = c;
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Scenes
+//
+//*****************************************************************************
+
+static void fill_frame(int i)
+{
+    gfx_fill_screen(i % 2 ? DISPLAY_BLUE : DISPLAY_BLACK);
+}
+
+static void text_frame(int i)
+{
+    gfx_fill_screen(DISPLAY_BLACK);
+    gfx_set_cursor(0, 0);
+    gfx_set_text_size(1);
+    gfx_set_text_background_color(DISPLAY_WHITE, DISPLAY_BLACK);
+    gfx_puts("NorthSec 2019\n\nThe badge talks to its screen over a "
+             "single SPI bus. Every byte counts, this page is mostly "
+             "text drawn with the 5x7 font.");
+}
+
+static menu_item_s menu_items[] = {
+    {"Conference schedule", NULL}, {"Nearby badges", NULL},
+    {"LED settings", NULL},        {"Screen settings", NULL},
+    {"Games", NULL},               {"Slideshow", NULL},
+    {"Flashlight", NULL},          {"Identity", NULL},
+    {"Battery status", NULL},      {"Pairing", NULL},
+    {"Warning", NULL},             {"About", NULL},
+};
+
+static void menu_setup(void)
+{
+    gfx_fill_screen(DISPLAY_BLACK);
+    menu_init(0, 0, gfx_get_screen_width(), gfx_get_screen_height(),
+              sizeof(menu_items) / sizeof(menu_items[0]), menu_items,
+              DISPLAY_WHITE, DISPLAY_BLACK);
+}
+
+static void menu_frame(int i)
+{
+    menu_change_selected_item(MENU_DIRECTION_DOWN);
+}
+
+// A talk abstract in the schedule viewer, with DOWN held from the first
+// frame: every frame after it is one repeat of text_box_process.
+static struct text_box_config abstract_config = {
+    CONF_POS_X, CONF_POS_Y, CONF_WIDTH, CONF_HEIGHT, HOME_MENU_BG_COLOR,
+    DISPLAY_WHITE};
+
+static void abstract_setup(void)
+{
+    gfx_fill_screen(DISPLAY_BLACK);
+    text_box_init(
+        "Badges are small computers with a tight power budget, a slow bus "
+        "to their screen and very little RAM. This talk walks through the "
+        "changes made to the NorthSec badge firmware this year: how the "
+        "display driver batches pixels into EasyDMA transfers, how text is "
+        "drawn one glyph at a time instead of one pixel at a time, and how "
+        "long pages of text scroll without drawing everything again. We "
+        "will also look at the LED effects, the flash layout and the tools "
+        "used to measure all of it on a laptop before it ever reaches the "
+        "hardware. Bring your badge, the firmware is open source and every "
+        "change shown here can be flashed during the conference.",
+        &abstract_config);
+}
+
+static void abstract_frame(int i)
+{
+    if (i == 0) {
+        sim_controls_send(BUTTON_DOWN);
+    } else {
+        sim_timers_fire();
+        text_box_process();
+    }
+}
+
+static void slide_raw_frame(int i)
+{
+    display_draw_16bit_ext_bitmap(0, 0, &slide_raw, 0);
+}
+
+static void slide_rle_frame(int i)
+{
+    display_draw_16bit_ext_bitmap(0, 0, &slide_rle, 0);
+}
+
+// The canvas of game_mines.c, with the slide standing in for its
+// background and sidebar images.
+static void mines_frame(int i)
+{
+    const int width = 11, height = 8;
+    const int ox = (120 - width * CELL) / 2;
+    const int oy = (80 - height * CELL) / 2 + 1;
+
+    display_draw_16bit_ext_bitmap(0, 0, &slide_rle, 0);
+
+    gfx_fill_rect(ox - 4, oy - 4, width * CELL + 7, height * CELL + 7, 0x0063);
+    gfx_fill_rect(ox - 2, oy - 2, width * CELL + 3, height * CELL + 3, 0x11cc);
+    gfx_fill_rect(ox, oy, width * CELL, height * CELL, DISPLAY_WHITE);
+
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            gfx_draw_16bit_bitmap(ox + x * CELL - 1, oy + y * CELL - 1, &cell,
+                                  0);
+        }
+    }
+
+    gfx_draw_rect(ox + (i % width) * CELL, oy + (i / width % height) * CELL,
+                  CELL - 1, CELL - 1, 0xf000);
+}
+
+static void cube_frame(int i)
+{
+    int center[2] = {80, 40};
+    float angles[3] = {i * 0.1f, i * 0.07f, i * 0.05f};
+
+    gfx_fill_rect(40, 0, 80, 80, DISPLAY_BLACK);
+    nsec_draw_rotated_mesh(nsec_cube, center, 20, angles);
+}
+
+// Same loop as app_3d.c: erase the last bounding box, draw the next frame.
+static int16_t mesh_bbox[4];
+
+static void mesh_setup(void)
+{
+    gfx_fill_screen(DISPLAY_BLACK);
+    mesh_bbox[0] = mesh_bbox[1] = 0;
+    mesh_bbox[2] = mesh_bbox[3] = -1;
+}
+
+static void filled_mesh_frame(nsec_mesh_t *mesh, int size, int i)
+{
+    int center[2] = {80, 44};
+    float angles[3] = {i * 0.05f, i * 0.03f, i * 0.02f};
+    nsec_rotation_t rotation;
+
+    nsec_rotation_from_angles(&rotation, angles);
+    gfx_fill_rect(mesh_bbox[0], mesh_bbox[1], mesh_bbox[2] - mesh_bbox[0] + 1,
+                  mesh_bbox[3] - mesh_bbox[1] + 1, DISPLAY_BLACK);
+    nsec_draw_filled_mesh(mesh, center, size, &rotation, DISPLAY_CYAN,
+                          mesh_bbox);
+}
+
+static void torus_frame(int i)
+{
+    filled_mesh_frame(nsec_torus, 33, i);
+}
+
+static void sphere_frame(int i)
+{
+    filled_mesh_frame(nsec_icosphere, 34, i);
+}
+
+struct scene {
+    const char *name;
+    int frames;
+    void (*setup)(void);
+    void (*frame)(int i);
+};
+
+static const struct scene scenes[] = {
+    {"fill_screen", 4, NULL, fill_frame},
+    {"text_page", 4, NULL, text_frame},
+    {"menu_scroll", 24, menu_setup, menu_frame},
+    {"text_scroll", 16, abstract_setup, abstract_frame},
+    {"slideshow_raw", 4, NULL, slide_raw_frame},
+    {"slideshow_rle", 4, NULL, slide_rle_frame},
+    {"mines_board", 4, NULL, mines_frame},
+    {"3d_cube", 32, NULL, cube_frame},
+    {"3d_torus", 32, mesh_setup, torus_frame},
+    {"3d_sphere", 32, mesh_setup, sphere_frame},
+};
+
+//*****************************************************************************
+//
+// Benchmark
+//
+//*****************************************************************************
+
+static void run_scene(const struct scene *scene, const char *dump_dir)
+{
+    struct sim_display_stats frame, total = {0}, worst = {0};
+
+    if (scene->setup) {
+        scene->setup();
+        display_update();
+    }
+
+    for (int i = 0; i < scene->frames; i++) {
+        sim_display_reset_stats();
+        scene->frame(i);
+        display_update();
+        sim_display_get_stats(&frame);
+
+        total.commands += frame.commands;
+        total.windows += frame.windows;
+        total.data_bytes += frame.data_bytes;
+        total.pixels += frame.pixels;
+        total.transfers += frame.transfers;
+        total.wire_us += frame.wire_us;
+        if (frame.wire_us > worst.wire_us) {
+            worst = frame;
+        }
+    }
+
+    int n = scene->frames;
+    printf("%-14s %6d %8u %8u %9u %9u %10.0f %10.0f\n", scene->name, n,
+           total.commands / n, total.windows / n, total.data_bytes / n,
+           total.transfers / n, total.wire_us / n, worst.wire_us);
+
+    if (dump_dir) {
+        char path[256];
+
+        snprintf(path, sizeof(path), "%s/%s.ppm", dump_dir, scene->name);
+        if (sim_display_dump_ppm(path) != 0) {
+            perror(path);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *dump_dir = NULL;
+    FILE *trace = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:t:")) != -1) {
+        switch (opt) {
+        case 'o':
+            dump_dir = optarg;
+            break;
+        case 't':
+            trace = fopen(optarg, "w");
+            if (!trace) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-o DIR] [-t TRACE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    build_assets();
+    display_init();
+    sim_display_trace(trace);
+
+    // Per frame averages, the last column is the most expensive frame.
+    printf("%-14s %6s %8s %8s %9s %9s %10s %10s\n", "scene", "frames",
+           "commands", "windows", "bytes", "transfers", "wire_us",
+           "worst_us");
+
+    for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+        run_scene(&scenes[i], dump_dir);
+    }
+
+    if (trace) {
+        fclose(trace);
+    }
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_APP_TIMER_H
+#define SIM_APP_TIMER_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// Timers only fire when a scene calls sim_timers_fire, see sim_display.h.
+typedef enum {
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED,
+} app_timer_mode_t;
+
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+
+typedef struct {
+    app_timer_timeout_handler_t handler;
+    app_timer_mode_t mode;
+    void *context;
+    int running;
+} app_timer_t;
+
+typedef app_timer_t *app_timer_id_t;
+
+#define APP_TIMER_DEF(timer_id)                                                \
+    static app_timer_t timer_id##_data;                                        \
+    static const app_timer_id_t timer_id = &timer_id##_data
+
+#define APP_TIMER_TICKS(ms) (ms)
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id,
+                            app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler);
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks,
+                           void *p_context);
+ret_code_t app_timer_stop(app_timer_id_t timer_id);
+
+#endif
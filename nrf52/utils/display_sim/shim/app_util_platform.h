@@ -0,0 +1,29 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_APP_UTIL_PLATFORM_H
+#define SIM_APP_UTIL_PLATFORM_H
+
+#include "app_error.h"
+#include "app_util.h"
+#include "nrf.h"
+
+#define APP_IRQ_PRIORITY_HIGH 2
+#define APP_IRQ_PRIORITY_MID 4
+#define APP_IRQ_PRIORITY_LOW 6
+#define APP_IRQ_PRIORITY_LOWEST 7
+#define APP_IRQ_PRIORITY_THREAD 15
+
+// Everything runs in thread mode.
+static inline uint8_t current_int_priority_get(void)
+{
+    return APP_IRQ_PRIORITY_THREAD;
+}
+
+// The simulator is single threaded, there is nothing to protect against.
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT() }
+
+#endif
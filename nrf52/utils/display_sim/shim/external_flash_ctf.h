@@ -0,0 +1,16 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+// Used when utils/pack_flash.py hasn't generated the real table of contents,
+// the benchmark builds its own external flash image in RAM.
+
+#ifndef SIM_EXTERNAL_FLASH_CTF_H
+#define SIM_EXTERNAL_FLASH_CTF_H
+
+struct external_flash_data {
+    unsigned int offset, size;
+};
+
+#endif
@@ -0,0 +1,13 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NORDIC_COMMON_H
+#define SIM_NORDIC_COMMON_H
+
+#include "app_util.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#endif
@@ -0,0 +1,24 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF_H
+#define SIM_NRF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// SPI transfers complete synchronously, waiting for an event never blocks.
+#define __WFE()
+
+// No interrupt is ever left pending.
+typedef enum {
+    SPIM2_SPIS2_SPI2_IRQn = 35,
+} IRQn_Type;
+
+#define NVIC_GetPendingIRQ(irq) 0
+#define NVIC_ClearPendingIRQ(irq)
+
+#endif
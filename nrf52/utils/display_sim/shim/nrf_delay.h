@@ -0,0 +1,15 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF_DELAY_H
+#define SIM_NRF_DELAY_H
+
+#include <stdint.h>
+
+// Only accounted for, see sim_display.h.
+void nrf_delay_ms(uint32_t ms);
+void nrf_delay_us(uint32_t us);
+
+#endif
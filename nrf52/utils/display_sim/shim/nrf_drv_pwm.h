@@ -0,0 +1,66 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF_DRV_PWM_H
+#define SIM_NRF_DRV_PWM_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+#define NRF_DRV_PWM_PIN_NOT_USED 0xFF
+#define NRF_DRV_PWM_FLAG_LOOP 0x01
+
+typedef struct {
+    uint8_t drv_inst_idx;
+} nrf_drv_pwm_t;
+
+#define NRF_DRV_PWM_INSTANCE(id) {.drv_inst_idx = (id)}
+
+typedef enum { NRF_PWM_CLK_16MHz } nrf_pwm_clk_t;
+typedef enum { NRF_PWM_MODE_UP } nrf_pwm_mode_t;
+typedef enum { NRF_PWM_LOAD_INDIVIDUAL } nrf_pwm_dec_load_t;
+typedef enum { NRF_PWM_STEP_AUTO } nrf_pwm_dec_step_t;
+
+typedef struct {
+    uint16_t channel_0;
+    uint16_t channel_1;
+    uint16_t channel_2;
+    uint16_t channel_3;
+} nrf_pwm_values_individual_t;
+
+typedef union {
+    nrf_pwm_values_individual_t const *p_individual;
+} nrf_pwm_values_t;
+
+typedef struct {
+    nrf_pwm_values_t values;
+    uint16_t length;
+    uint32_t repeats;
+    uint32_t end_delay;
+} nrf_pwm_sequence_t;
+
+#define NRF_PWM_VALUES_LENGTH(array) (sizeof(array) / (sizeof(uint16_t)))
+
+typedef struct {
+    uint8_t output_pins[4];
+    uint8_t irq_priority;
+    nrf_pwm_clk_t base_clock;
+    nrf_pwm_mode_t count_mode;
+    uint16_t top_value;
+    nrf_pwm_dec_load_t load_mode;
+    nrf_pwm_dec_step_t step_mode;
+} nrf_drv_pwm_config_t;
+
+typedef void (*nrf_drv_pwm_handler_t)(int event_type);
+
+ret_code_t nrf_drv_pwm_init(nrf_drv_pwm_t const *const p_instance,
+                            nrf_drv_pwm_config_t const *p_config,
+                            nrf_drv_pwm_handler_t handler);
+uint32_t nrf_drv_pwm_simple_playback(nrf_drv_pwm_t const *const p_instance,
+                                     nrf_pwm_sequence_t const *p_sequence,
+                                     uint16_t playback_count, uint32_t flags);
+
+#endif
@@ -0,0 +1,77 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF_DRV_SPI_H
+#define SIM_NRF_DRV_SPI_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+#define NRF_DRV_SPI_PIN_NOT_USED 0xFF
+
+typedef struct {
+    uint8_t inst_idx;
+} nrf_drv_spi_t;
+
+#define NRF_DRV_SPI_INSTANCE(id) {.inst_idx = (id)}
+
+// The values are the SCK frequency in kHz, the SDK uses register values.
+typedef enum {
+    NRF_DRV_SPI_FREQ_125K = 125,
+    NRF_DRV_SPI_FREQ_250K = 250,
+    NRF_DRV_SPI_FREQ_500K = 500,
+    NRF_DRV_SPI_FREQ_1M = 1000,
+    NRF_DRV_SPI_FREQ_2M = 2000,
+    NRF_DRV_SPI_FREQ_4M = 4000,
+    NRF_DRV_SPI_FREQ_8M = 8000,
+} nrf_drv_spi_frequency_t;
+
+typedef enum {
+    NRF_DRV_SPI_MODE_0,
+    NRF_DRV_SPI_MODE_1,
+    NRF_DRV_SPI_MODE_2,
+    NRF_DRV_SPI_MODE_3,
+} nrf_drv_spi_mode_t;
+
+typedef enum {
+    NRF_DRV_SPI_BIT_ORDER_MSB_FIRST,
+    NRF_DRV_SPI_BIT_ORDER_LSB_FIRST,
+} nrf_drv_spi_bit_order_t;
+
+typedef struct {
+    uint8_t sck_pin;
+    uint8_t mosi_pin;
+    uint8_t miso_pin;
+    uint8_t ss_pin;
+    uint8_t irq_priority;
+    uint8_t orc;
+    nrf_drv_spi_frequency_t frequency;
+    nrf_drv_spi_mode_t mode;
+    nrf_drv_spi_bit_order_t bit_order;
+} nrf_drv_spi_config_t;
+
+typedef enum {
+    NRF_DRV_SPI_EVENT_DONE,
+} nrf_drv_spi_evt_type_t;
+
+typedef struct {
+    nrf_drv_spi_evt_type_t type;
+} nrf_drv_spi_evt_t;
+
+typedef void (*nrf_drv_spi_evt_handler_t)(nrf_drv_spi_evt_t const *p_event,
+                                          void *p_context);
+
+ret_code_t nrf_drv_spi_init(nrf_drv_spi_t const *const p_instance,
+                            nrf_drv_spi_config_t const *p_config,
+                            nrf_drv_spi_evt_handler_t handler, void *p_context);
+void nrf_drv_spi_uninit(nrf_drv_spi_t const *const p_instance);
+ret_code_t nrf_drv_spi_transfer(nrf_drv_spi_t const *const p_instance,
+                                uint8_t const *p_tx_buffer,
+                                uint8_t tx_buffer_length,
+                                uint8_t *p_rx_buffer,
+                                uint8_t rx_buffer_length);
+
+#endif
@@ -0,0 +1,18 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF_GPIO_H
+#define SIM_NRF_GPIO_H
+
+#include <stdint.h>
+
+// The simulated panel samples the D/C pin, see sim_display.c.
+void nrf_gpio_cfg_output(uint32_t pin);
+void nrf_gpio_pin_write(uint32_t pin, uint32_t value);
+void nrf_gpio_pin_set(uint32_t pin);
+void nrf_gpio_pin_clear(uint32_t pin);
+void nrf_gpio_pin_toggle(uint32_t pin);
+
+#endif
@@ -0,0 +1,23 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+// Host stand-ins for the parts of the nRF5 SDK used by the display stack.
+
+#ifndef SIM_SDK_ERRORS_H
+#define SIM_SDK_ERRORS_H
+
+#include <stdint.h>
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS 0
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_INVALID_LENGTH 9
+#define NRF_ERROR_NO_MEM 4
+#define NRF_ERROR_NULL 14
+#define NRF_ERROR_INVALID_ADDR 16
+#define NRF_ERROR_BUSY 17
+
+#endif
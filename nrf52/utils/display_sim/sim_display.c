@@ -0,0 +1,267 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+// A ST7735 on the other end of a simulated SPI bus.  The driver talks to it
+// through the nrf_drv_spi and nrf_gpio stand-ins below, every byte is decoded
+// like the controller would and pixels land in an emulated GRAM.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <boards.h>
+#include <nrf_delay.h>
+#include <nrf_drv_pwm.h>
+#include <nrf_drv_spi.h>
+#include <nrf_gpio.h>
+
+#include "drivers/ST7735.h"
+#include "sim_display.h"
+
+// The address space of the controller, larger than the panel.
+#define GRAM_COLS 162
+#define GRAM_ROWS 162
+
+static uint16_t gram[GRAM_ROWS][GRAM_COLS];
+
+static struct {
+    bool dc;
+    nrf_drv_spi_evt_handler_t handler;
+    void *context;
+    uint32_t khz;
+
+    uint8_t command;
+    uint8_t params[4];
+    uint8_t n_params;
+
+    uint16_t xs, xe, ys, ye;
+    uint16_t x, y;
+    bool ramwr;
+    uint8_t pixel_msb;
+    bool pixel_half;
+
+    uint8_t madctl;
+    int col_offset, row_offset;
+} panel = {.dc = true, .khz = NRF_DRV_SPI_FREQ_8M, .col_offset = 1,
+           .row_offset = 26};
+
+static struct sim_display_stats stats;
+static FILE *trace;
+
+void sim_display_set_offsets(int col, int row)
+{
+    panel.col_offset = col;
+    panel.row_offset = row;
+}
+
+void sim_display_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sim_display_get_stats(struct sim_display_stats *out)
+{
+    *out = stats;
+}
+
+void sim_display_trace(FILE *file)
+{
+    trace = file;
+}
+
+static void panel_command(uint8_t command)
+{
+    stats.commands++;
+    panel.command = command;
+    panel.n_params = 0;
+    panel.ramwr = command == ST7735_RAMWR;
+    panel.pixel_half = false;
+
+    if (command == ST7735_RAMWR) {
+        panel.x = panel.xs;
+        panel.y = panel.ys;
+    } else if (command == ST7735_CASET) {
+        stats.windows++;
+    }
+
+    if (trace) {
+        fprintf(trace, "C %02x\n", command);
+    }
+}
+
+static void panel_pixel(uint16_t colour)
+{
+    if (panel.y < GRAM_ROWS && panel.x < GRAM_COLS) {
+        gram[panel.y][panel.x] = colour;
+    }
+    stats.pixels++;
+
+    if (panel.x < panel.xe) {
+        panel.x++;
+    } else {
+        panel.x = panel.xs;
+        panel.y = panel.y < panel.ye ? panel.y + 1 : panel.ys;
+    }
+}
+
+static void panel_data(uint8_t data)
+{
+    if (panel.ramwr) {
+        if (!panel.pixel_half) {
+            panel.pixel_msb = data;
+        } else {
+            panel_pixel((uint16_t)panel.pixel_msb << 8 | data);
+        }
+        panel.pixel_half = !panel.pixel_half;
+        return;
+    }
+
+    if (panel.n_params < sizeof(panel.params)) {
+        panel.params[panel.n_params++] = data;
+    }
+
+    switch (panel.command) {
+    case ST7735_CASET:
+        if (panel.n_params == 4) {
+            panel.xs = panel.params[0] << 8 | panel.params[1];
+            panel.xe = panel.params[2] << 8 | panel.params[3];
+        }
+        break;
+    case ST7735_RASET:
+        if (panel.n_params == 4) {
+            panel.ys = panel.params[0] << 8 | panel.params[1];
+            panel.ye = panel.params[2] << 8 | panel.params[3];
+        }
+        break;
+    case ST7735_MADCTL:
+        panel.madctl = data;
+        break;
+    }
+}
+
+ret_code_t nrf_drv_spi_init(nrf_drv_spi_t const *const p_instance,
+                            nrf_drv_spi_config_t const *p_config,
+                            nrf_drv_spi_evt_handler_t handler, void *p_context)
+{
+    panel.khz = p_config->frequency;
+    panel.handler = handler;
+    panel.context = p_context;
+
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_spi_uninit(nrf_drv_spi_t const *const p_instance)
+{
+    panel.handler = NULL;
+}
+
+ret_code_t nrf_drv_spi_transfer(nrf_drv_spi_t const *const p_instance,
+                                uint8_t const *p_tx_buffer,
+                                uint8_t tx_buffer_length,
+                                uint8_t *p_rx_buffer, uint8_t rx_buffer_length)
+{
+    stats.transfers++;
+    stats.wire_us += tx_buffer_length * 8 * 1000.0 / panel.khz;
+
+    if (panel.dc) {
+        stats.data_bytes += tx_buffer_length;
+        if (trace) {
+            fprintf(trace, "D %u\n", tx_buffer_length);
+        }
+        for (uint8_t i = 0; i < tx_buffer_length; i++) {
+            panel_data(p_tx_buffer[i]);
+        }
+    } else {
+        for (uint8_t i = 0; i < tx_buffer_length; i++) {
+            panel_command(p_tx_buffer[i]);
+        }
+    }
+
+    // The transfer is over as soon as it started, the driver chains the
+    // next packet from here like it does from the SPIM interrupt.
+    if (panel.handler) {
+        nrf_drv_spi_evt_t event = {.type = NRF_DRV_SPI_EVENT_DONE};
+        panel.handler(&event, panel.context);
+    }
+
+    return NRF_SUCCESS;
+}
+
+void nrf_gpio_cfg_output(uint32_t pin) {}
+
+void nrf_gpio_pin_write(uint32_t pin, uint32_t value)
+{
+    if (pin == PIN_OLED_DC_MODE) {
+        panel.dc = value != 0;
+    }
+}
+
+void nrf_gpio_pin_set(uint32_t pin)
+{
+    nrf_gpio_pin_write(pin, 1);
+}
+
+void nrf_gpio_pin_clear(uint32_t pin)
+{
+    nrf_gpio_pin_write(pin, 0);
+}
+
+void nrf_gpio_pin_toggle(uint32_t pin)
+{
+    if (pin == PIN_OLED_DC_MODE) {
+        panel.dc = !panel.dc;
+    }
+}
+
+ret_code_t nrf_drv_pwm_init(nrf_drv_pwm_t const *const p_instance,
+                            nrf_drv_pwm_config_t const *p_config,
+                            nrf_drv_pwm_handler_t handler)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_pwm_simple_playback(nrf_drv_pwm_t const *const p_instance,
+                                     nrf_pwm_sequence_t const *p_sequence,
+                                     uint16_t playback_count, uint32_t flags)
+{
+    return 0;
+}
+
+void nrf_delay_ms(uint32_t ms)
+{
+    stats.delay_us += ms * 1000.0;
+}
+
+void nrf_delay_us(uint32_t us)
+{
+    stats.delay_us += us;
+}
+
+int sim_display_dump_ppm(const char *path)
+{
+    // With MV set the column address runs along the long side.
+    bool mv = panel.madctl & MADCTL_MV;
+    int width = mv ? ST7735_HEIGHT : ST7735_WIDTH;
+    int height = mv ? ST7735_WIDTH : ST7735_HEIGHT;
+    FILE *file = fopen(path, "wb");
+
+    if (!file) {
+        return -1;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint16_t c = gram[y + panel.row_offset][x + panel.col_offset];
+            uint8_t rgb[3] = {(c >> 11) * 255 / 31, ((c >> 5) & 0x3f) * 255 / 63,
+                              (c & 0x1f) * 255 / 31};
+
+            fwrite(rgb, 1, sizeof(rgb), file);
+        }
+    }
+
+    return fclose(file);
+}
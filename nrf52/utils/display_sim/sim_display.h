@@ -0,0 +1,48 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_DISPLAY_H
+#define SIM_DISPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// What went over the display SPI bus since the last sim_display_reset_stats.
+struct sim_display_stats {
+    uint32_t commands;
+    // CASET/RASET pairs, each one costs 2 commands and 8 bytes of data.
+    uint32_t windows;
+    uint32_t data_bytes;
+    uint32_t pixels;
+    // EasyDMA transfers, at most 255 bytes each.
+    uint32_t transfers;
+    // Bit times at the SPI clock in use, in microseconds.
+    double wire_us;
+    // Busy waits from nrf_delay_ms and friends, in microseconds.
+    double delay_us;
+};
+
+// Panel offsets of the visible area, see st7735_apply_model.
+void sim_display_set_offsets(int col, int row);
+
+void sim_display_reset_stats(void);
+void sim_display_get_stats(struct sim_display_stats *stats);
+
+// Log every command and data span to this file, NULL to stop.
+void sim_display_trace(FILE *file);
+
+// Write the visible area, in the orientation it was drawn, as a binary PPM.
+int sim_display_dump_ppm(const char *path);
+
+// Feed a button event to the handlers, as nsec_controls_process would.
+void sim_controls_send(int button);
+
+// Expire every running app_timer once.
+void sim_timers_fire(void);
+
+// Back the external flash with this buffer, see sim_platform.c.
+void sim_flash_set_image(const uint8_t *image, uint32_t size);
+
+#endif
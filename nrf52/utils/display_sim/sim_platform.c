@@ -0,0 +1,213 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+// Everything else the graphics stack links against: the external flash is a
+// buffer in RAM, random numbers are reproducible, buttons and timers are
+// driven by the scenes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <app_error.h>
+#include <app_timer.h>
+
+#include "app/random.h"
+#include "drivers/controls.h"
+#include "drivers/flash.h"
+#include "drivers/ws2812fx.h"
+#include "sim_display.h"
+
+static const uint8_t *flash_image;
+static uint32_t flash_size;
+static bool stream_open;
+
+void sim_flash_set_image(const uint8_t *image, uint32_t size)
+{
+    flash_image = image;
+    flash_size = size;
+}
+
+static void flash_copy(uint32_t address, uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        // Erased flash past the end of the image.
+        data[i] = address + i < flash_size ? flash_image[address + i] : 0xFF;
+    }
+}
+
+ret_code_t flash_read(uint32_t address, uint8_t *data, size_t len)
+{
+    if (stream_open) {
+        return NRF_ERROR_BUSY;
+    }
+
+    flash_copy(address, data, len);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t flash_stream_open(struct flash_stream *stream, uint32_t address)
+{
+    if (stream_open) {
+        return NRF_ERROR_BUSY;
+    }
+
+    stream_open = true;
+    stream->address = address;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t flash_stream_read(struct flash_stream *stream, uint8_t *data,
+                             size_t len)
+{
+    flash_copy(stream->address, data, len);
+    stream->address += len;
+
+    return NRF_SUCCESS;
+}
+
+void flash_stream_close(struct flash_stream *stream)
+{
+    stream_open = false;
+}
+
+static uint32_t random_state = 0x4e534543;
+
+void nsec_random_get(uint8_t *buffer, size_t buffer_size)
+{
+    for (size_t i = 0; i < buffer_size; i++) {
+        random_state = random_state * 1103515245 + 12345;
+        buffer[i] = random_state >> 16;
+    }
+}
+
+static button_handler handlers[NSEC_CONTROLS_LIMIT_MAX_HANDLERS];
+static int handler_count = 0;
+
+bool nsec_controls_add_handler(button_handler handler)
+{
+    for (int i = 0; i < handler_count; i++) {
+        if (handlers[i] == handler) {
+            return true;
+        }
+    }
+
+    if (handler_count >= NSEC_CONTROLS_LIMIT_MAX_HANDLERS) {
+        return false;
+    }
+
+    handlers[handler_count++] = handler;
+    return true;
+}
+
+void sim_controls_send(int button)
+{
+    for (int i = 0; i < handler_count; i++) {
+        handlers[i](button);
+    }
+}
+
+//*****************************************************************************
+//
+// Timers
+//
+//*****************************************************************************
+
+#define SIM_MAX_TIMERS 16
+
+static app_timer_t *timers[SIM_MAX_TIMERS];
+static int timer_count = 0;
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id,
+                            app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t *timer = *p_timer_id;
+
+    timer->handler = timeout_handler;
+    timer->mode = mode;
+    timer->running = 0;
+
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i] == timer) {
+            return NRF_SUCCESS;
+        }
+    }
+
+    APP_ERROR_CHECK_BOOL(timer_count < SIM_MAX_TIMERS);
+    timers[timer_count++] = timer;
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks,
+                           void *p_context)
+{
+    timer_id->context = p_context;
+    timer_id->running = 1;
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->running = 0;
+    return NRF_SUCCESS;
+}
+
+void sim_timers_fire(void)
+{
+    for (int i = 0; i < timer_count; i++) {
+        app_timer_t *timer = timers[i];
+
+        if (!timer->running) {
+            continue;
+        }
+
+        if (timer->mode == APP_TIMER_MODE_SINGLE_SHOT) {
+            timer->running = 0;
+        }
+        timer->handler(timer->context);
+    }
+}
+
+//*****************************************************************************
+//
+// LEDs, only there for led_show_error in utils.c
+//
+//*****************************************************************************
+
+bool isRunning_WS2812FX(void)
+{
+    return false;
+}
+
+void start_WS2812FX(void)
+{
+}
+
+void stop_WS2812FX(void)
+{
+}
+
+void service_WS2812FX(void)
+{
+}
+
+void setSegment_WS2812FX(uint8_t n, uint16_t start, uint16_t stop,
+                         uint8_t mode, uint32_t color, uint16_t speed,
+                         bool reverse)
+{
+}
+
+void app_error_handler(ret_code_t error_code, int line, const char *file)
+{
+    fprintf(stderr, "%s:%d: error 0x%x\n", file, line, (unsigned)error_code);
+    abort();
+}
+
+void SPIM2_SPIS2_SPI2_IRQHandler(void)
+{
+}
@@ -18,17 +18,24 @@
 #  pc <- badge: <command> error <an error message>
 #
 # The protocol is all line-based, and each message, each line ends with a \n.
+#
+# The "binary" command switches to a framed protocol, see BinaryFlashClient,
+# which writes whole sectors and keeps several of them in flight.
 
 import serial
 import binascii
 import argparse
+import struct
+import time
 
 # Complete size of the flash.
 FLASH_SIZE_IN_BYTES = 512 * 1024
 
-# The space available for this stuff: everything minus the last 4096 bytes
-# block, reserved for persistent config.
-FLASH_AVAILABLE_SIZE_IN_BYTES = FLASH_SIZE_IN_BYTES - 4096
+# The space available for this stuff: everything minus the last four 4096 bytes
+# blocks, reserved for persistent config (see persistency.c).
+FLASH_AVAILABLE_SIZE_IN_BYTES = FLASH_SIZE_IN_BYTES - 4 * 4096
+
+SECTOR_SIZE = 4096
 
 
 class FlashClient:
@@ -159,6 +166,292 @@ class FlashClient:
         return int(checksum_hex, 16)
 
 
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+
+    for b in data:
+        if b == 0:
+            out.append(len(block) + 1)
+            out += block
+            block = bytearray()
+            continue
+
+        block.append(b)
+        if len(block) == 254:
+            out.append(255)
+            out += block
+            block = bytearray()
+
+    out.append(len(block) + 1)
+    out += block
+    out.append(0)
+
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError('bad COBS encoding')
+
+        out += data[i + 1:i + code]
+        i += code
+        if code != 255 and i < len(data):
+            out.append(0)
+
+    return bytes(out)
+
+
+class BinaryFlashClient:
+    """Client for the binary mode of the flash mode.
+
+    Each packet is COBS-encoded and ends with a 0 byte.  Once decoded, it
+    holds a command, a sequence number, the arguments and the CRC32 of all
+    that.  The badge answers every packet, in order, with the command | 0x80,
+    the same sequence number, a status byte, the results and a CRC32.
+
+    The badge buffers a few packets (the window), so the next sector is
+    already on the wire while the previous one is being written.  Writes are
+    idempotent, so a packet that got corrupted or lost is simply sent again.
+    """
+
+    CMD_WRITE = 0x01
+    CMD_READ = 0x02
+    CMD_CHECKSUM = 0x03
+    CMD_SECTOR_CRCS = 0x04
+    RESPONSE = 0x80
+    BAD_PACKET = 0xff
+
+    WRITE_ERASE = 0x01
+
+    # What fits in the answer to a CMD_SECTOR_CRCS.
+    MAX_SECTOR_CRCS = 128
+
+    STATUS_OK = 0
+
+    # Resend a packet after this long without an answer.
+    TIMEOUT = 2.0
+
+    # Give up after sending the same packet this many times.
+    MAX_TRIES = 5
+
+    def __init__(self, ser, verbose, baud=None):
+        self._ser = ser
+        self._verbose = verbose
+        self._seq = 0
+        self._rx = bytearray()
+
+        # Clear the command buffer, drain what might be coming our way.
+        self._ser.write(b'\x00')
+        prev_timeout = self._ser.timeout
+        self._ser.timeout = 0.1
+        while self._ser.read(4096):
+            pass
+
+        self._ser.write('binary {}\n'.format(baud or 0).encode())
+        self._ser.timeout = self.TIMEOUT
+        line = self._ser.readline()
+        if self._verbose:
+            print('pc <- badge: ', line)
+
+        if not line.startswith(b'binary ok '):
+            raise RuntimeError('no binary mode: {}'.format(line))
+
+        fields = line.split()
+        self.baud = int(fields[2])
+        self.window = int(fields[3])
+        self.max_data = int(fields[4])
+
+        if self.baud != self._ser.baudrate:
+            time.sleep(0.01)
+            self._ser.baudrate = self.baud
+
+        self._ser.timeout = prev_timeout
+
+    def _packet(self, cmd, args):
+        seq = self._seq
+        self._seq = (self._seq + 1) & 0xff
+        body = bytes([cmd, seq]) + args
+        body += struct.pack('<I', binascii.crc32(body))
+
+        return seq, cobs_encode(body)
+
+    def _receive(self, timeout):
+        """Return the next (cmd, seq, status, payload), or None on timeout."""
+        deadline = time.monotonic() + timeout
+
+        while True:
+            end = self._rx.find(b'\x00')
+            if end >= 0:
+                frame = bytes(self._rx[:end])
+                del self._rx[:end + 1]
+                if not frame:
+                    continue
+
+                try:
+                    body = cobs_decode(frame)
+                except ValueError:
+                    continue
+
+                if len(body) < 7:
+                    continue
+
+                crc, = struct.unpack('<I', body[-4:])
+                if binascii.crc32(body[:-4]) != crc:
+                    continue
+
+                if self._verbose:
+                    print('pc <- badge: ', body.hex())
+
+                return body[0], body[1], body[2], body[3:-4]
+
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+
+            self._ser.timeout = min(remaining, 0.1)
+            self._rx += self._ser.read(max(1, self._ser.in_waiting))
+
+    def _run(self, packets):
+        """Send PACKETS, a list of (cmd, args, check), keeping the window
+        full.  CHECK is called with the payload of the response and returns
+        whether it is right.  Return the payloads, in order."""
+        results = [None] * len(packets)
+        todo = list(range(len(packets)))
+        tries = [0] * len(packets)
+        # seq -> packet index, in the order they were sent.
+        in_flight = {}
+
+        def retry(indices, why):
+            for index in indices:
+                tries[index] += 1
+                if tries[index] >= self.MAX_TRIES:
+                    raise RuntimeError(
+                        'command 0x{:x} at index {}: {} after {} tries'.format(
+                            packets[index][0], index, why, tries[index]))
+            return list(indices)
+
+        while todo or in_flight:
+            while todo and len(in_flight) < self.window:
+                index = todo.pop(0)
+                cmd, args, check = packets[index]
+                seq, encoded = self._packet(cmd, args)
+                if self._verbose:
+                    print('pc -> badge: ', cmd, seq, len(args))
+                self._ser.write(encoded)
+                in_flight[seq] = index
+
+            response = self._receive(self.TIMEOUT)
+            if response is None:
+                # Lost, send everything in flight again.
+                todo = retry(in_flight.values(), 'no answer') + todo
+                in_flight = {}
+                continue
+
+            cmd, seq, status, payload = response
+            if seq not in in_flight:
+                continue
+
+            # Answers come in order: whatever was sent before SEQ got lost.
+            lost = []
+            for other in list(in_flight):
+                if other == seq:
+                    break
+                lost.append(in_flight.pop(other))
+            todo = retry(lost, 'no answer') + todo
+
+            index = in_flight.pop(seq)
+            pcmd, args, check = packets[index]
+
+            if cmd == self.BAD_PACKET:
+                todo = retry([index], 'corrupted') + todo
+                continue
+
+            if cmd != pcmd | self.RESPONSE or status != self.STATUS_OK:
+                raise RuntimeError(
+                    'command 0x{:x} at index {} failed with status {}'.format(
+                        pcmd, index, status))
+
+            if check is not None and not check(payload):
+                todo = retry([index], 'check failed') + todo
+                continue
+
+            results[index] = payload
+
+        return results
+
+    def sector_crcs(self, address, count):
+        """Return the CRC32 of COUNT sectors starting at ADDRESS."""
+        packets = []
+        for first in range(0, count, self.MAX_SECTOR_CRCS):
+            n = min(count - first, self.MAX_SECTOR_CRCS)
+            args = struct.pack('<IH', address + first * SECTOR_SIZE, n)
+            packets.append((self.CMD_SECTOR_CRCS, args, None))
+
+        crcs = []
+        for payload in self._run(packets):
+            crcs += struct.unpack('<{}I'.format(len(payload) // 4), payload)
+
+        return crcs
+
+    def write_sectors(self, address, contents, progress=None, diff=True):
+        """Erase and write CONTENTS at ADDRESS, which must be sector-aligned.
+
+        With DIFF, the CRC32 of the sectors in flash are fetched first and
+        only the sectors that differ are written.  The trailing 0xff of each
+        sector are not sent, they are already there after the erase.
+
+        Return the number of sectors written."""
+
+        if address % SECTOR_SIZE != 0:
+            raise ValueError('address should be sector-aligned.')
+
+        offsets = range(0, len(contents), SECTOR_SIZE)
+        if diff:
+            crcs = self.sector_crcs(address, len(offsets))
+            # A short last sector is followed by the 0xff of the erase.
+            offsets = [offset for offset, crc in zip(offsets, crcs)
+                       if binascii.crc32(contents[offset:offset + SECTOR_SIZE]
+                                         .ljust(SECTOR_SIZE, b'\xff')) != crc]
+
+        packets = []
+        for offset in offsets:
+            data = contents[offset:offset + SECTOR_SIZE].rstrip(b'\xff')
+            args = struct.pack('<IB', address + offset, self.WRITE_ERASE) + data
+            crc = binascii.crc32(data) if data else 0
+
+            packets.append((self.CMD_WRITE, args,
+                            lambda payload, crc=crc:
+                            struct.unpack('<I', payload)[0] == crc))
+
+        # Split in chunks to report progress.
+        step = 16
+        for i in range(0, len(packets), step):
+            self._run(packets[i:i + step])
+            if progress:
+                progress(min(i + step, len(packets)), len(packets))
+
+        return len(packets)
+
+    def read(self, address, length):
+        """Read LENGTH bytes at ADDRESS, LENGTH must be at most 512."""
+        args = struct.pack('<IH', address, length)
+
+        return self._run([(self.CMD_READ, args, None)])[0]
+
+    def checksum(self, address, length):
+        """Compute the CRC32 of a region of flash."""
+        args = struct.pack('<II', address, length)
+        payload = self._run([(self.CMD_CHECKSUM, args, None)])[0]
+
+        return struct.unpack('<I', payload)[0]
+
+
 def erase_as_needed(client, size):
     '''Erase as much as needed to fit SIZE bytes of data.'''
 
@@ -174,9 +467,17 @@ def main():
     argparser = argparse.ArgumentParser()
     argparser.add_argument('file-to-flash', help='File to write on the flash.')
     argparser.add_argument('--verbose', '-v', help='Be verbose.', action='store_true')
+    argparser.add_argument('--port', default='/dev/ttyACM1',
+                           help='Serial port of the badge.')
+    argparser.add_argument('--baud', type=int, default=115200,
+                           help='Baud rate of the binary mode (up to 1000000).')
+    argparser.add_argument('--text', action='store_true',
+                           help='Use the line-based protocol of older badges.')
+    argparser.add_argument('--full', action='store_true',
+                           help='Rewrite every sector, even unchanged ones.')
     args = argparser.parse_args()
 
-    with serial.Serial('/dev/ttyACM1', 115200) as ser:
+    with serial.Serial(args.port, 115200) as ser:
         with open(vars(args)['file-to-flash'], 'rb') as inputfile:
             contents = inputfile.read()
 
@@ -190,6 +491,25 @@ def main():
             raise ValueError('Data exceeds available space: {} > {}'.format(
                 len(contents), FLASH_AVAILABLE_SIZE_IN_BYTES))
 
+        if not args.text:
+            client = BinaryFlashClient(ser, args.verbose, args.baud)
+            start = time.monotonic()
+
+            def progress(done, total):
+                print(' > sector {}/{}'.format(done, total))
+
+            written = client.write_sectors(0, contents, progress,
+                                           diff=not args.full)
+            print(' > {} of {} sectors written'.format(
+                written, (len(contents) + SECTOR_SIZE - 1) // SECTOR_SIZE))
+
+            print(' > checksuming')
+            our_checksum = binascii.crc32(contents)
+            target_checksum = client.checksum(0, len(contents))
+            assert target_checksum == our_checksum
+            print(' > done in {:.1f} s'.format(time.monotonic() - start))
+            return
+
         nsegments = len(contents) // 128
         cursegment = 1
 
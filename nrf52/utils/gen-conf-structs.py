@@ -22,41 +22,56 @@
 # SOFTWARE.
 #
 
-# Process html files downloaded with download-conf-html.py.
+# Build the conference schedule database stored in the external flash.
 #
-# Use as:
+# The schedule is kept in src/app/conf_sched.json.  To refresh it from the html
+# files downloaded with download-conf-html.py, run in the download directory:
 #
-#     python3 gen-conf-structs.py > ../src/app/conf_sched.inc
+#     python3 gen-conf-structs.py scrape > ../src/app/conf_sched.json
+#
+# The build then packs it with:
+#
+#     python3 gen-conf-structs.py pack conf_sched.json conf_sched.db
+#
+# The database layout (all little endian) is described in
+# src/app/conf_sched.h, and must be kept in sync with it.
 
-import bs4
-import sys
-import re
+import argparse
 import glob
+import json
+import re
+import struct
+import sys
 
-loc2track = {
-    'Conf 1': 0,
-    'Conf 2': 1,
-    'Workshop 1': 2,
-    'Workshop 2': 3,
-    'Workshop 3': 4,
-    'Workshop 4 (Salon du president)': 5,
+tracks = [
+    'Conf 1',
+    'Conf 2',
+    'Workshop 1',
+    'Workshop 2',
+    'Workshop 3',
+    'Workshop 4 (Salon du president)',
+]
+
+days = {
+    '16': 'Thursday, May 16th',
+    '17': 'Friday, May 17th',
 }
 
-files = glob.glob('talk_*.html')
-speaker_files = glob.glob('speaker_*.html')
-
-list_of_talks_16 = []
-list_of_talks_17 = []
-list_of_speakers = []
+CONF_SCHED_MAGIC = b'NSCD'
+CONF_SCHED_VERSION = 1
+CONF_SCHED_STRING_MAX = 4096
 
-def sort_by_start_then_track(talk):
-    return (talk['start_h'] * 100 + talk['start_m'], talk['track'])
+HEADER = struct.Struct('<4sHBBHH7I')
+DAY = struct.Struct('<IHHHH')
+TALK = struct.Struct('<IIIIHHBBH')
+SPEAKER = struct.Struct('<II')
+TRACK = struct.Struct('<I')
+SLOT = struct.Struct('<HHBB')
+SLOT_TALK = struct.Struct('<H')
 
-def sort_by_name(speaker):
-    return speaker['name']
 
 def sanitize(s):
-    s = s.replace('\\', '\\\\').replace('"', '\\"').replace('\n', ' ').replace('\u2028', ' ').replace('“', '\\"').replace('”', '\\"').replace('’', "'").replace('‘', "'").replace('—', '-').replace('–', '-').replace('†', '').replace('\xe4', 'a').replace('\xe9', 'e').replace('\xc9', 'E').replace('\u0151', 'o').replace('\xa9', '').replace('\xab', '\\"').replace('\xbb', '\\"').replace('\u2009', ' ').replace('\xa0', ' ').replace('\xe8', 'e')
+    s = s.replace('\n', ' ').replace('\u2028', ' ').replace('“', '"').replace('”', '"').replace('’', "'").replace('‘', "'").replace('—', '-').replace('–', '-').replace('†', '').replace('\xe4', 'a').replace('\xe9', 'e').replace('\xc9', 'E').replace('\u0151', 'o').replace('\xa9', '').replace('\xab', '"').replace('\xbb', '"').replace('\u2009', ' ').replace('\xa0', ' ').replace('\xe8', 'e')
 
     # Make sure that we didn't miss any non ascii character.
     # This will raise an exception if there is still one.
@@ -64,138 +79,198 @@ def sanitize(s):
 
     return s
 
-longest_text = 0
-longest_title = 0
-
-for name in files:
-    with open(name) as f:
-        yo = f.read()
-
-    soup = bs4.BeautifulSoup(yo, 'lxml')
-
-    title = soup.select_one('h3.talk-title').text
-    m = re.search('»(.*)«', title)
-    title = m.group(1)
-    assert title
-
-    if title in ('Registration', 'Thursday Lunch', 'Friday Lunch', 'Sponsor event'):
-        continue
-
-    names = [sanitize(x.text.strip()) for x in soup.select('div.name')]
-    assert names
-
-    abstract = soup.select_one('section.abstract').text.strip()
-    detailed = soup.select_one('section.description').text.strip()
-
-    time_place = soup.select_one('h3.talk-title > small').text.strip()
-    m = re.match(
-        r'2019-05-(16|17), (\d\d):(\d\d)–(\d\d):(\d\d), (.*)', time_place)
-    date = m.group(1)
-    assert date in ['16', '17']
-    start_h = m.group(2)
-    start_m = m.group(3)
-    end_h = m.group(4)
-    end_m = m.group(5)
-    loc = m.group(6)
-    if loc == 'Other':
-        continue
-    track = loc2track[loc]
-
-    talk = {
-        'title': sanitize(title),
-        'names': names,
-        'start_h': start_h,
-        'start_m': start_m,
-        'end_h': end_h,
-        'end_m': end_m,
-        'abstract': sanitize(abstract),
-        'detailed': sanitize(detailed),
-        'track': track,
-    }
-    longest_title = max(longest_title, len(talk['title']))
-    longest_text = max(longest_text, len(talk['abstract']));
-    if date == '16':
-        list_of_talks_16.append(talk)
-    else:
-        list_of_talks_17.append(talk)
 
-list_of_talks_16.sort(key=sort_by_start_then_track)
-list_of_talks_17.sort(key=sort_by_start_then_track)
-
-for name in speaker_files:
-    with open(name) as f:
-        yo = f.read()
-
-    soup = bs4.BeautifulSoup(yo, 'lxml')
-    speaker_name = soup.select_one('h3').text.strip().split('\n')[1].strip()
-	
-    bio = soup.select_one('div.speaker-bio').text.strip()
-
-    list_of_speakers.append({
-        'name': sanitize(speaker_name),
-        'bio': sanitize(bio),
-    })
-    longest_text = max(longest_text, len(list_of_speakers[-1]['bio']));
-
-list_of_speakers.sort(key=sort_by_name)
-
-print('''
-// THIS FILE HAS BEEN GENERATED USING gen-conf-structs.py !!!"1🤖!
-
-#include "conf_sched.h"
+def scrape():
+    """Process html files downloaded with download-conf-html.py, print the
+    schedule as json."""
+
+    import bs4
+
+    loc2track = {name: i for i, name in enumerate(tracks)}
+    talks_by_day = {date: [] for date in days}
+    speakers = []
+
+    for name in glob.glob('talk_*.html'):
+        with open(name) as f:
+            yo = f.read()
+
+        soup = bs4.BeautifulSoup(yo, 'lxml')
+
+        title = soup.select_one('h3.talk-title').text
+        m = re.search('»(.*)«', title)
+        title = m.group(1)
+        assert title
+
+        if title in ('Registration', 'Thursday Lunch', 'Friday Lunch', 'Sponsor event'):
+            continue
+
+        names = [sanitize(x.text.strip()) for x in soup.select('div.name')]
+        assert names
+
+        abstract = soup.select_one('section.abstract').text.strip()
+        detailed = soup.select_one('section.description').text.strip()
+
+        time_place = soup.select_one('h3.talk-title > small').text.strip()
+        m = re.match(
+            r'2019-05-(16|17), (\d\d:\d\d)–(\d\d:\d\d), (.*)', time_place)
+        date = m.group(1)
+        assert date in days
+        loc = m.group(4)
+        if loc == 'Other':
+            continue
+
+        talks_by_day[date].append({
+            'title': sanitize(title),
+            'names': ', '.join(names),
+            'start': m.group(2),
+            'end': m.group(3),
+            'track': loc2track[loc],
+            'abstract': sanitize(abstract),
+            'detailed': sanitize(detailed),
+        })
+
+    for name in glob.glob('speaker_*.html'):
+        with open(name) as f:
+            yo = f.read()
+
+        soup = bs4.BeautifulSoup(yo, 'lxml')
+        speaker_name = soup.select_one('h3').text.strip().split('\n')[1].strip()
+        bio = soup.select_one('div.speaker-bio').text.strip()
+
+        speakers.append({
+            'name': sanitize(speaker_name),
+            'bio': sanitize(bio),
+        })
+
+    sched = {
+        'tracks': tracks,
+        'days': [{'name': days[date], 'talks': talks_by_day[date]}
+                 for date in sorted(days)],
+        'speakers': speakers,
+    }
 
-const char * const tracks[] = {
-    "Conf 1",
-    "Conf 2",
-    "Workshop 1",
-    "Workshop 2",
-    "Workshop 3",
-    "Workshop 4 (Salon du president)",
-};
+    json.dump(sched, sys.stdout, indent=2)
+    print()
+
+
+def minutes(hh_mm):
+    h, m = hh_mm.split(':')
+    return int(h) * 60 + int(m)
+
+
+class StringTable:
+    """Deduplicated blob of NUL-terminated strings."""
+
+    def __init__(self):
+        self.blob = bytearray()
+        self.offsets = {}
+
+    def ref(self, s):
+        assert len(s) < CONF_SCHED_STRING_MAX, s
+        if s not in self.offsets:
+            self.offsets[s] = len(self.blob)
+            self.blob += s.encode('ascii') + b'\0'
+
+        return self.offsets[s]
+
+
+def pack(sched):
+    strings = StringTable()
+    days_data = bytearray()
+    talks_data = bytearray()
+    slots_data = bytearray()
+    slot_talks_data = bytearray()
+    num_talks = 0
+    num_slots = 0
+    num_slot_talks = 0
+
+    for day_num, day in enumerate(sched['days']):
+        talks = sorted(day['talks'],
+                       key=lambda t: (minutes(t['start']), t['track']))
+        first_talk = num_talks
+
+        for t in talks:
+            start, end = minutes(t['start']), minutes(t['end'])
+            assert start < end, t['title']
+            assert t['track'] < len(sched['tracks']), t['title']
+            talks_data += TALK.pack(strings.ref(t['title']),
+                                    strings.ref(t['names']),
+                                    strings.ref(t['abstract']),
+                                    strings.ref(t['detailed']),
+                                    start, end, t['track'], day_num, 0)
+
+        # The time index: a slot starts at every minute where a talk starts
+        # or ends, and lists the talks running until the next slot.
+        boundaries = sorted({minutes(t['start']) for t in talks} |
+                            {minutes(t['end']) for t in talks})
+        first_slot = num_slots
+
+        for b in boundaries:
+            running = [first_talk + i for i, t in enumerate(talks)
+                       if minutes(t['start']) <= b < minutes(t['end'])]
+            assert len(running) < 256
+            slots_data += SLOT.pack(b, num_slot_talks, len(running), 0)
+            for i in running:
+                slot_talks_data += SLOT_TALK.pack(i)
+            num_slot_talks += len(running)
+
+        num_talks += len(talks)
+        num_slots += len(boundaries)
+        days_data += DAY.pack(strings.ref(day['name']), first_talk,
+                              len(talks), first_slot, len(boundaries))
+
+    speakers = sorted(sched['speakers'], key=lambda s: s['name'])
+    speakers_data = bytearray()
+    for s in speakers:
+        speakers_data += SPEAKER.pack(strings.ref(s['name']),
+                                      strings.ref(s['bio']))
+
+    tracks_data = bytearray()
+    for name in sched['tracks']:
+        tracks_data += TRACK.pack(strings.ref(name))
+
+    assert num_talks < 0x10000 and num_slot_talks < 0x10000
+
+    # Fixed size tables first, so the records are 4-byte aligned.
+    sections = [days_data, talks_data, speakers_data, tracks_data,
+                slots_data, slot_talks_data, strings.blob]
+    offsets = []
+    offset = HEADER.size
+    for data in sections:
+        offset = (offset + 3) & ~3
+        offsets.append(offset)
+        offset += len(data)
+
+    out = bytearray(offset)
+    out[:HEADER.size] = HEADER.pack(CONF_SCHED_MAGIC, CONF_SCHED_VERSION,
+                                    len(sched['days']), len(sched['tracks']),
+                                    num_talks, len(speakers), *offsets)
+    for data, offset in zip(sections, offsets):
+        out[offset:offset + len(data)] = data
+
+    return bytes(out)
+
+
+def main():
+    argparser = argparse.ArgumentParser()
+    subparsers = argparser.add_subparsers(dest='command')
+    subparsers.required = True
+    subparsers.add_parser('scrape')
+    pack_parser = subparsers.add_parser('pack')
+    pack_parser.add_argument('json')
+    pack_parser.add_argument('output')
+
+    args = argparser.parse_args()
+
+    if args.command == 'scrape':
+        scrape()
+    else:
+        with open(args.json) as f:
+            sched = json.load(f)
 
-''')
+        with open(args.output, 'wb') as f:
+            f.write(pack(sched))
 
 
-def t(tm):
-    if tm[0] == '0':
-        return tm[1]
-    else:
-        return tm
-
-
-def gen_talk(talk):
-    print('  {')
-    print('    .title = "{}",'.format(talk['title']))
-    print('    .names = "{}",'.format(', '.join(talk['names'])))
-    print('    .abstract = "{}",'.format(talk['abstract']))
-    print('    .detailed = "{}",'.format(talk['detailed']))
-    print('    .start_h = {}, .start_m = {}, .end_h = {}, .end_m = {},'.format(
-        t(talk['start_h']), t(talk['start_m']), t(talk['end_h']), t(talk['end_m'])))
-    print('    .track = {},'.format(talk['track']))
-    print('  },')
-
-
-print('const struct talk talks_16[] = {')
-for talk in list_of_talks_16:
-    gen_talk(talk)
-print('};')
-
-print('const int num_talks_16 = {};'.format(len(list_of_talks_16)))
-
-print('const struct talk talks_17[] = {')
-for talk in list_of_talks_17:
-    gen_talk(talk)
-print('};')
-print('const int num_talks_17 = {};'.format(len(list_of_talks_17)))
-
-print('const struct speaker speakers[] = {')
-for sp in list_of_speakers:
-    print('{')
-    print('    .name = "{}",'.format(sp['name']))
-    print('    .bio = "{}",'.format(sp['bio']))
-    print('},')
-print('};')
-print('const int num_speakers = {};'.format(len(list_of_speakers)))
-
-print('const int longest_text = {};'.format(longest_text))
-print('const int longest_title = {};'.format(longest_title))
+if __name__ == '__main__':
+    main()
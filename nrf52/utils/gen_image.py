@@ -104,6 +104,50 @@ def RGB888_to_RGB565(image):
     return _bytes
 
 
+def RGB565_to_RLE(pixels, width):
+    """ _in: bytearray(RGB565), row width in pixels
+        _out: bytearray(RLE)
+
+    Each row is encoded as packets which never span two rows.  A packet starts
+    with a header byte: if bit 7 is set, the next pixel is repeated
+    (header & 0x7f) + 1 times, otherwise (header + 1) literal pixels follow.
+    """
+    _bytes = bytearray()
+    row_size = width * 2
+
+    for row_start in range(0, len(pixels), row_size):
+        row = [bytes(pixels[i:i + 2])
+               for i in range(row_start, row_start + row_size, 2)]
+        literals = []
+
+        def flush_literals():
+            while literals:
+                chunk = literals[:128]
+                del literals[:128]
+                _bytes.append(len(chunk) - 1)
+                for pixel in chunk:
+                    _bytes.extend(pixel)
+
+        i = 0
+        while i < len(row):
+            run = 1
+            while i + run < len(row) and run < 128 and row[i + run] == row[i]:
+                run += 1
+
+            # A run of two pixels only pays off between other runs.
+            if run > 2 or (run == 2 and not literals):
+                flush_literals()
+                _bytes.append(0x80 | (run - 1))
+                _bytes.extend(row[i])
+            else:
+                literals.extend(row[i:i + run])
+            i += run
+
+        flush_literals()
+
+    return _bytes
+
+
 def encode_image_BW(image):
     return image.tobytes()
 
@@ -113,7 +157,8 @@ def encode_image_RGBA(image):
     return RGB888_to_RGB565(image_RGB888)
 
 
-def encode_image(input_file_path, output_file_path, external_flash, rotate):
+def encode_image(input_file_path, output_file_path, external_flash, rotate,
+                 compress):
     image = Image.open(input_file_path)
 
     if rotate:
@@ -125,6 +170,14 @@ def encode_image(input_file_path, output_file_path, external_flash, rotate):
     elif 'RGBA' in image.mode:
         encoding = '565bits'
         byte_array = encode_image_RGBA(image)
+
+        # Only the external flash reader knows how to decode RLE images, and
+        # it's only worth it if it's actually smaller.
+        if external_flash and compress:
+            rle = RGB565_to_RLE(byte_array, image.width)
+            if len(rle) < len(byte_array):
+                encoding = '565rle'
+                byte_array = rle
     else:
         sys.exit("Image must be in 1-bit or 2-bit color mode ({}).".format(image.mode))
 
@@ -184,6 +237,8 @@ if __name__ == "__main__":
                         help='Rotate image by 90 degrees')
     parser.add_argument('--external-flash', action='store_true',
                         help='Export files such that the image ends up in the external flash.')
+    parser.add_argument('--no-compress', action='store_true',
+                        help='Never RLE-compress images for the external flash.')
     parser.add_argument('infile', help='Input file')
     parser.add_argument('outfile', help='Output file')
 
@@ -198,4 +253,5 @@ if __name__ == "__main__":
         decode_image(args.infile, args.outfile, args.width, args.rotate)
 
     else:
-        encode_image(args.infile, args.outfile, args.external_flash, args.rotate)
+        encode_image(args.infile, args.outfile, args.external_flash,
+                     args.rotate, not args.no_compress)
@@ -0,0 +1,147 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+// Run every WS2812FX mode with the real effects engine and report what a
+// frame costs on the host.
+//
+//   led_bench [-f FRAMES] [-m MODE] [-d DUMP]
+//
+// -d writes every frame shown, one line each, so the output of two builds
+// can be diffed to spot effects that changed behaviour.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "app/timer.h"
+#include "drivers/ws2812fx.h"
+#include "sim_leds.h"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void dump_frame(FILE *dump, int mode, int frame)
+{
+    const uint32_t *shown = sim_leds_shown();
+
+    fprintf(dump, "%d %d %llu", mode, frame,
+            (unsigned long long)get_current_time_millis());
+    for (int i = 0; i < NEOPIXEL_COUNT; i++) {
+        fprintf(dump, " %06x", shown[i]);
+    }
+    fprintf(dump, "\n");
+}
+
+static void run_mode(int mode, int frames, FILE *dump)
+{
+    const uint32_t colors[NUM_COLORS] = {RED, GREEN, BLUE};
+    struct sim_leds_stats after, total = {0};
+    uint64_t total_ns = 0, worst_ns = 0;
+    uint64_t start_ms;
+    int shown = 0;
+
+    setSegment_color_array_WS2812FX(0, 0, NEOPIXEL_COUNT - 1, mode, colors,
+                                    DEFAULT_SPEED, false);
+    start_WS2812FX();
+    start_ms = get_current_time_millis();
+
+    for (int i = 0; i < frames; i++) {
+        sim_leds_reset_stats();
+        uint64_t t0 = now_ns();
+        service_WS2812FX();
+        uint64_t ns = now_ns() - t0;
+        sim_leds_get_stats(&after);
+
+        total.pixel_writes += after.pixel_writes;
+        total.allocations += after.allocations;
+        if (after.shows) {
+            shown++;
+            total_ns += ns;
+            if (ns > worst_ns) {
+                worst_ns = ns;
+            }
+            if (dump) {
+                dump_frame(dump, mode, shown);
+            }
+        }
+
+        if (!sim_timers_run_next()) {
+            break;
+        }
+    }
+
+    uint64_t elapsed_ms = get_current_time_millis() - start_ms;
+    stop_WS2812FX();
+
+    if (shown == 0) {
+        shown = 1;
+    }
+    printf("%-26s %6d %8llu %8llu %7u %6u %8.1f\n",
+           getModeName_WS2812FX(mode), shown,
+           (unsigned long long)(total_ns / shown),
+           (unsigned long long)worst_ns, total.pixel_writes / shown,
+           total.allocations, (double)elapsed_ms / shown);
+}
+
+int main(int argc, char **argv)
+{
+    struct sim_leds_stats init;
+    FILE *dump = NULL;
+    int frames = 200;
+    int only = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:m:d:")) != -1) {
+        switch (opt) {
+        case 'f':
+            frames = atoi(optarg);
+            break;
+        case 'm':
+            only = atoi(optarg);
+            break;
+        case 'd':
+            dump = fopen(optarg, "w");
+            if (!dump) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f FRAMES] [-m MODE] [-d DUMP]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    sim_leds_reset_stats();
+    init_WS2812FX();
+    sim_leds_get_stats(&init);
+
+    printf("%d LEDs, %u allocations in init_WS2812FX\n", NEOPIXEL_COUNT,
+           init.allocations);
+    // Host time of the frames that were shown, pixel writes per frame,
+    // allocations over the whole run and the average time between frames.
+    printf("%-26s %6s %8s %8s %7s %6s %8s\n", "mode", "frames", "ns", "worst_ns",
+           "writes", "allocs", "every_ms");
+
+    for (int mode = 0; mode < MODE_COUNT; mode++) {
+        if (only < 0 || only == mode) {
+            run_mode(mode, frames, dump);
+        }
+    }
+
+    if (dump) {
+        fclose(dump);
+    }
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_APP_ERROR_H
+#define SIM_APP_ERROR_H
+
+#include "sdk_errors.h"
+
+void app_error_handler(ret_code_t error_code, int line, const char *file);
+
+#define APP_ERROR_CHECK(err_code)                                              \
+    do {                                                                       \
+        const ret_code_t local_err_code = (err_code);                          \
+        if (local_err_code != NRF_SUCCESS) {                                   \
+            app_error_handler(local_err_code, __LINE__, __FILE__);             \
+        }                                                                      \
+    } while (0)
+
+#endif
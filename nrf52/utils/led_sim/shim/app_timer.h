@@ -0,0 +1,51 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_APP_TIMER_H
+#define SIM_APP_TIMER_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// Same tick rate as the badge, the simulated RTC is in sim_platform.c.
+#define APP_TIMER_CLOCK_FREQ 32768
+#define APP_TIMER_CONFIG_RTC_FREQUENCY 0
+#define APP_TIMER_MIN_TIMEOUT_TICKS 5
+
+#define APP_TIMER_TICKS(ms)                                                    \
+    ((uint32_t)(((uint64_t)(ms) * APP_TIMER_CLOCK_FREQ + 500) / 1000))
+
+typedef enum {
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED,
+} app_timer_mode_t;
+
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+
+typedef struct {
+    app_timer_timeout_handler_t handler;
+    app_timer_mode_t mode;
+    void *context;
+    // Absolute expiry in ticks, valid while running.
+    uint64_t expiry;
+    uint32_t period;
+    int running;
+} app_timer_t;
+
+typedef app_timer_t *app_timer_id_t;
+
+#define APP_TIMER_DEF(timer_id)                                                \
+    static app_timer_t timer_id##_data;                                        \
+    static const app_timer_id_t timer_id = &timer_id##_data
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id,
+                            app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler);
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks,
+                           void *p_context);
+ret_code_t app_timer_stop(app_timer_id_t timer_id);
+
+#endif
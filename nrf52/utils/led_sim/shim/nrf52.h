@@ -0,0 +1,11 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF52_H
+#define SIM_NRF52_H
+
+#include "nrf.h"
+
+#endif
@@ -0,0 +1,11 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF_SDH_H
+#define SIM_NRF_SDH_H
+
+#include "app_error.h"
+
+#endif
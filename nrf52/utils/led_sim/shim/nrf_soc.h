@@ -0,0 +1,18 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_NRF_SOC_H
+#define SIM_NRF_SOC_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// The SoftDevice RNG, reproducible from run to run, see sim_platform.c.
+ret_code_t sd_rand_application_bytes_available_get(uint8_t *p_bytes_available);
+ret_code_t sd_rand_application_vector_get(uint8_t *p_buff, uint8_t length);
+ret_code_t sd_app_evt_wait(void);
+
+#endif
@@ -0,0 +1,31 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+#ifndef SIM_LEDS_H
+#define SIM_LEDS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// What the effects did since the last sim_leds_reset_stats.
+struct sim_leds_stats {
+    // nsec_neoPixel_set_pixel_color* calls.
+    uint32_t pixel_writes;
+    uint32_t shows;
+    // malloc, calloc and realloc calls.
+    uint32_t allocations;
+};
+
+void sim_leds_reset_stats(void);
+void sim_leds_get_stats(struct sim_leds_stats *stats);
+
+// The colours last shown, 0xRRGGBB before gamma and brightness.
+const uint32_t *sim_leds_shown(void);
+
+// Move the clock to the earliest running app_timer and fire it. Returns
+// false if no timer is running.
+bool sim_timers_run_next(void);
+
+#endif
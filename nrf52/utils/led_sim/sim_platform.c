@@ -0,0 +1,251 @@
+//  Copyright (c) 2019
+//  NorthSec badge team <https://github.com/nsec>
+//
+//  License: MIT (see LICENSE for details)
+
+// Everything ws2812fx.c links against: the LEDs are an array, the clock is a
+// simulated RTC that only moves with the timers, and the SoftDevice RNG is
+// reproducible so two runs draw the same frames.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <app_error.h>
+#include <app_timer.h>
+#include <nrf_delay.h>
+#include <nrf_soc.h>
+
+#include "app/timer.h"
+#include "drivers/led_effects.h"
+#include "sim_leds.h"
+
+static struct sim_leds_stats stats;
+
+void sim_leds_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sim_leds_get_stats(struct sim_leds_stats *out)
+{
+    *out = stats;
+}
+
+//*****************************************************************************
+//
+// Allocations, counted through the linker's --wrap
+//
+//*****************************************************************************
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    stats.allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    stats.allocations++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    stats.allocations++;
+    return __real_realloc(p, size);
+}
+
+//*****************************************************************************
+//
+// Clock and timers
+//
+//*****************************************************************************
+
+#define SIM_MAX_TIMERS 8
+
+static uint64_t clock_ticks = 0;
+static app_timer_t *timers[SIM_MAX_TIMERS];
+static int timer_count = 0;
+
+uint64_t get_current_time_millis(void)
+{
+    return clock_ticks * 1000 / APP_TIMER_CLOCK_FREQ;
+}
+
+void nrf_delay_ms(uint32_t ms)
+{
+    clock_ticks += APP_TIMER_TICKS(ms);
+}
+
+void nrf_delay_us(uint32_t us)
+{
+    clock_ticks += (uint64_t)us * APP_TIMER_CLOCK_FREQ / 1000000;
+}
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id,
+                            app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t *timer = *p_timer_id;
+
+    timer->handler = timeout_handler;
+    timer->mode = mode;
+    timer->running = 0;
+
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i] == timer) {
+            return NRF_SUCCESS;
+        }
+    }
+
+    if (timer_count >= SIM_MAX_TIMERS) {
+        return NRF_ERROR_NO_MEM;
+    }
+    timers[timer_count++] = timer;
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks,
+                           void *p_context)
+{
+    timer_id->context = p_context;
+    timer_id->period = timeout_ticks;
+    timer_id->expiry = clock_ticks + timeout_ticks;
+    timer_id->running = 1;
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->running = 0;
+    return NRF_SUCCESS;
+}
+
+bool sim_timers_run_next(void)
+{
+    app_timer_t *next = NULL;
+
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i]->running &&
+            (next == NULL || timers[i]->expiry < next->expiry)) {
+            next = timers[i];
+        }
+    }
+
+    if (next == NULL) {
+        return false;
+    }
+
+    clock_ticks = next->expiry;
+    if (next->mode == APP_TIMER_MODE_REPEATED) {
+        next->expiry += next->period;
+    } else {
+        next->running = 0;
+    }
+    next->handler(next->context);
+    return true;
+}
+
+//*****************************************************************************
+//
+// SoftDevice RNG, seeds the lfsr113 of random.c
+//
+//*****************************************************************************
+
+static uint32_t rng_state = 0x4e534543;
+
+ret_code_t sd_rand_application_bytes_available_get(uint8_t *p_bytes_available)
+{
+    *p_bytes_available = 64;
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_rand_application_vector_get(uint8_t *p_buff, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++) {
+        rng_state = rng_state * 1103515245 + 12345;
+        p_buff[i] = rng_state >> 16;
+    }
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_app_evt_wait(void)
+{
+    return NRF_SUCCESS;
+}
+
+//*****************************************************************************
+//
+// Pixel sink, stands in for led_effects.c
+//
+//*****************************************************************************
+
+static uint32_t pixels[NEOPIXEL_COUNT];
+static uint32_t shown[NEOPIXEL_COUNT];
+static uint8_t brightness = 255;
+
+const uint32_t *sim_leds_shown(void)
+{
+    return shown;
+}
+
+void nsec_neoPixel_init(void)
+{
+    memset(pixels, 0, sizeof(pixels));
+}
+
+// Frames are sent instantly.
+bool nsec_neoPixel_is_busy(void)
+{
+    return false;
+}
+
+void nsec_neoPixel_clear(void)
+{
+    memset(pixels, 0, sizeof(pixels));
+}
+
+void nsec_neoPixel_set_pixel_color(uint16_t n, uint8_t r, uint8_t g, uint8_t b)
+{
+    nsec_neoPixel_set_pixel_color_packed(n, (uint32_t)r << 16 | g << 8 | b);
+}
+
+void nsec_neoPixel_set_pixel_color_packed(uint16_t n, uint32_t c)
+{
+    stats.pixel_writes++;
+    if (n < NEOPIXEL_COUNT) {
+        pixels[n] = c & 0xFFFFFF;
+    }
+}
+
+uint32_t nsec_neoPixel_get_pixel_color(uint16_t n)
+{
+    return n < NEOPIXEL_COUNT ? pixels[n] : 0;
+}
+
+void nsec_neoPixel_show(void)
+{
+    stats.shows++;
+    memcpy(shown, pixels, sizeof(shown));
+}
+
+uint8_t nsec_neoPixel_get_brightness(void)
+{
+    return brightness;
+}
+
+void nsec_neoPixel_set_brightness(uint8_t b)
+{
+    brightness = b;
+}
+
+void app_error_handler(ret_code_t error_code, int line, const char *file)
+{
+    fprintf(stderr, "%s:%d: error 0x%x\n", file, line, (unsigned)error_code);
+    abort();
+}